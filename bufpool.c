@@ -0,0 +1,76 @@
+#include <stddef.h>
+
+#include "bufpool.h"
+
+typedef union buf_block {
+    union buf_block *next;          // while free
+    uint8_t         data[BUFPOOL_BLOCK_SIZE];
+} buf_block;
+
+static buf_block     pool[BUFPOOL_BLOCKS];
+static buf_block     *pool_head;    // first free block
+static uint8_t       pool_used[(BUFPOOL_BLOCKS + 7) / 8];   // a bit per block, set while allocated
+static bufpool_stats pool_stats;
+
+void bufpool_init(void) {
+    uint8_t i;
+
+    pool_head = NULL;
+    for (i = BUFPOOL_BLOCKS; i > 0; i--) {
+        pool[i - 1].next = pool_head;
+        pool_head = &pool[i - 1];
+    }
+    for (i = 0; i < sizeof(pool_used); i++) {
+        pool_used[i] = 0;
+    }
+    pool_stats.in_use = 0;
+    pool_stats.high_water = 0;
+    pool_stats.allocs = 0;
+    pool_stats.failures = 0;
+    pool_stats.bad_frees = 0;
+}
+
+uint8_t *bufpool_alloc(void) {
+    buf_block *b = pool_head;
+    uint8_t n;
+
+    if (b == NULL) {
+        pool_stats.failures++;
+        return NULL;
+    }
+    pool_head = b->next;
+    n = b - pool;
+    pool_used[n >> 3] |= 1 << (n & 7);
+    pool_stats.allocs++;
+    if (++pool_stats.in_use > pool_stats.high_water) {
+        pool_stats.high_water = pool_stats.in_use;
+    }
+    return b->data;
+}
+
+void bufpool_free(uint8_t *buf) {
+    buf_block *b = (buf_block *)buf;
+    uint8_t n;
+
+    if (buf == NULL) {
+        return;
+    }
+    if (b < pool || b >= pool + BUFPOOL_BLOCKS || (buf - pool[0].data) % sizeof(buf_block) != 0) {
+        pool_stats.bad_frees++;
+        return;
+    }
+    // a block freed twice would be linked twice and handed out to two services
+    n = b - pool;
+    if (!(pool_used[n >> 3] & (1 << (n & 7)))) {
+        pool_stats.bad_frees++;
+        return;
+    }
+    pool_used[n >> 3] &= ~(1 << (n & 7));
+    b->next = pool_head;
+    pool_head = b;
+    pool_stats.in_use--;
+}
+
+void bufpool_get_stats(bufpool_stats *stats) {
+    *stats = pool_stats;
+}
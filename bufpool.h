@@ -0,0 +1,46 @@
+#ifndef _BUFPOOL_H_
+#define _BUFPOOL_H_
+
+#include <stdint.h>
+
+/*
+    Fixed-block pool of the buffers of the socket services.
+
+    A service borrows a block for one transaction (a request and its answer)
+    and returns it, instead of owning a buffer for ever, so the SRAM of the
+    buffers is sized by the transactions in progress at once, not by the
+    count of services. The free blocks are linked through their first bytes:
+    alloc and free are O(1) and the pool has no overhead but its statistics.
+
+    The size and count of the blocks are fixed at compile time; size the
+    count from the high water mark of bufpool_get_stats(). Alloc and free
+    from the main loop only, not from an ISR.
+ */
+
+#ifndef BUFPOOL_BLOCK_SIZE
+#define BUFPOOL_BLOCK_SIZE  512
+#endif
+
+#ifndef BUFPOOL_BLOCKS
+#define BUFPOOL_BLOCKS      3
+#endif
+
+typedef struct {
+    uint8_t  in_use;        // blocks allocated now
+    uint8_t  high_water;    // most blocks allocated at once
+    uint16_t allocs;
+    uint16_t failures;      // bufpool_alloc() with no block free
+    uint16_t bad_frees;     // bufpool_free() of a pointer not from the pool or already free
+} bufpool_stats;
+
+void     bufpool_init(void);
+
+/* Returns a block of BUFPOOL_BLOCK_SIZE bytes, or NULL if none is free. */
+uint8_t* bufpool_alloc(void);
+
+/* Returns a block to the pool; NULL is ignored, a block already free counted in bad_frees. */
+void     bufpool_free(uint8_t *buf);
+
+void     bufpool_get_stats(bufpool_stats *stats);
+
+#endif
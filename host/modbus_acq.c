@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "modbus_store.h"
+
+/*
+    Acquisition process for the shared register image of modbus_store.c.
+
+    It writes with the seqlock protocol the same pattern as modbus_server -u :
+    a 32-bit counter in the holding and input registers 0-1 and its complement
+    in 7-8, while modbus_server -m serves the image from other processes.
+
+    usage: modbus_acq [-m name] [-u usecs]
+        -m  shared memory object of the image (default /modbus)
+        -u  period of the updates (default 1000)
+ */
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+int main(int argc, char* argv[]) {
+    const char* name = "/modbus";
+    struct timespec period = {0, 1000000};
+    uint16_t regs[MODBUS_HOLDING_NUM];
+    uint32_t count;
+    int i;
+
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-m") && i + 1 < argc) name = argv[++i];
+        else if(!strcmp(argv[i], "-u") && i + 1 < argc) period.tv_nsec = atol(argv[++i]) * 1000;
+        else {
+            fprintf(stderr, "usage: %s [-m name] [-u usecs]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(period.tv_nsec <= 0 || period.tv_nsec >= 1000000000) period.tv_nsec = 1000000;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    if(modbus_store_map(name) != 0) {
+        fprintf(stderr, "%s: can't map the register image\n", name);
+        return 1;
+    }
+    // Go on from the image left by the last run. A run killed in the middle of
+    // a write left it unreadable; the count starts again and the first write
+    // makes the image consistent.
+    if(modbus_read_holding(0, regs, MODBUS_HOLDING_NUM) != 0) {
+        printf("%s: image left in the middle of a write, counter reset\n", name);
+        memset(regs, 0, sizeof(regs));
+    }
+    count = ((uint32_t)regs[0] << 16) | regs[1];
+    printf("%s: image of %u bytes, mapped %u times, counter at %lu\n", name,
+           (unsigned)modbus_regs->image_size, (unsigned)modbus_regs->maps, (unsigned long)count);
+    fflush(stdout);
+
+    while(!stop) {
+        count++;
+        regs[0] = (uint16_t)(count >> 16);
+        regs[1] = (uint16_t)count;
+        regs[7] = (uint16_t)~regs[0];
+        regs[8] = (uint16_t)~regs[1];
+        modbus_write_holding(0, regs, MODBUS_HOLDING_NUM);
+        modbus_write_input_reg(0, regs, MODBUS_INPUT_REG_NUM);
+        nanosleep(&period, NULL);
+    }
+    printf("counter at %lu\n", (unsigned long)count);
+    modbus_store_unmap();
+    return 0;
+}
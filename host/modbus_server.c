@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/sysinfo.h>
+
+#include "wizchip_conf.h"
+#include "socket.h"
+#include "loopback.h"
+#include "modbus.h"
+
+/*
+    Modbus TCP server of modbus.c for a Linux gateway, on the POSIX socket
+    backend (_WIZCHIP_IO_POSIX_).
+
+    Each worker thread has its own event loop (wizchip_posix_attach()), its own
+    SO_REUSEPORT listener on the port and its own range of socket handles, one
+    connection each. The kernel spreads the connections over the listeners, so
+    the workers share nothing but the register store of modbus.c. The state of
+    a worker is aligned on a cache line so the counters of two workers never
+    share one.
+
+    With -u an acquisition thread writes a 32-bit counter to the holding and
+    input registers 0-1 and its complement to 7-8 (two seqlock blocks) in one
+    update, so a client can check that it never reads them half updated.
+
+    With -m the registers are those of the shared image of modbus_store.c,
+    written by another process such as modbus_acq.
+
+    usage: modbus_server [-t threads] [-c connections] [-p port] [-i seconds] [-u usecs] [-m name]
+        -t  worker threads (default: the online CPUs)
+        -c  connections per worker (default 16)
+        -p  TCP port (default 502)
+        -i  interval of the statistics print, 0 to print on exit only (default 10)
+        -u  period of the acquisition updates, 0 for none (default 0)
+        -m  shared memory object of the register image, e.g. /modbus (default: in memory)
+ */
+
+#define SERVER_CACHE_LINE   64
+
+typedef struct {
+    uint64_t requests;      // requests answered
+    uint64_t bytes;         // request bytes received
+    uint64_t connections;   // connections accepted
+    uint64_t errors;        // socket errors
+} server_stats;
+
+typedef struct {
+    pthread_t    tid;
+    uint8_t      base;      // first socket handle of the worker
+    uint8_t      count;     // socket handles of the worker
+    server_stats stats;
+    uint8_t      buf[DATA_BUF_SIZE];
+} __attribute__((aligned(SERVER_CACHE_LINE))) server_worker;
+
+// The counters are written by their worker only and read by the main thread.
+#define STAT_ADD(w, f, n)   __atomic_store_n(&(w)->stats.f, (w)->stats.f + (n), __ATOMIC_RELAXED)
+#define STAT_GET(w, f)      __atomic_load_n(&(w)->stats.f, __ATOMIC_RELAXED)
+
+static volatile sig_atomic_t stop;
+static uint16_t server_port = 502;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+// Runs the socket of sn until it waits on the network : LISTEN or ESTABLISHED.
+static void serve(server_worker* w, uint8_t sn) {
+    int32_t ret;
+    uint8_t sr, n;
+
+    for(n = 0; n < 4; n++) {
+        if((sr = getSn_SR(sn)) == SOCK_ESTABLISHED && (getSn_IR(sn) & Sn_IR_CON)) STAT_ADD(w, connections, 1);
+        ret = loopback_modbus(sn, w->buf, server_port, 0);
+        if(ret < 0) STAT_ADD(w, errors, 1);
+        else if(ret > 0) {
+            STAT_ADD(w, requests, 1);
+            STAT_ADD(w, bytes, ret);
+        }
+        sr = getSn_SR(sn);
+        if(ret < 0 || sr == SOCK_LISTEN || (sr == SOCK_ESTABLISHED && !(getSn_IR(sn) & Sn_IR_RECV))) break;
+    }
+}
+
+static void* worker_main(void* arg) {
+    server_worker* w = arg;
+    uint8_t imr = SIK_CONNECTED | SIK_DISCONNECTED | SIK_RECEIVED;
+    uint8_t ready[_WIZCHIP_SOCK_HANDLE_NUM_];
+    int16_t n, i;
+
+    if(wizchip_posix_attach() != SOCK_OK) {
+        fprintf(stderr, "worker %u: no event loop\n", w->base);
+        return 0;
+    }
+    for(i = 0; i < w->count; i++) {
+        ctlsocket(w->base + i, CS_SET_INTMASK, &imr);
+        serve(w, w->base + i);
+    }
+    while(!stop) {
+        n = wizchip_posix_wait(ready, sizeof(ready), 1000);
+        for(i = 0; i < n; i++) serve(w, ready[i]);
+    }
+    for(i = 0; i < w->count; i++) close(w->base + i);
+    wizchip_posix_detach();
+    return 0;
+}
+
+static void* acquire_main(void* arg) {
+    struct timespec period = {0, (long)(intptr_t)arg * 1000};
+    uint16_t regs[MODBUS_HOLDING_NUM];
+    uint32_t count = 0;
+
+    memset(regs, 0, sizeof(regs));
+    while(!stop) {
+        count++;
+        regs[0] = (uint16_t)(count >> 16);
+        regs[1] = (uint16_t)count;
+        regs[7] = (uint16_t)~regs[0];
+        regs[8] = (uint16_t)~regs[1];
+        modbus_write_holding(0, regs, MODBUS_HOLDING_NUM);
+        modbus_write_input_reg(0, regs, MODBUS_INPUT_REG_NUM);
+        nanosleep(&period, NULL);
+    }
+    return 0;
+}
+
+static void print_stats(server_worker* w, int threads) {
+    server_stats sum;
+    int i;
+
+    memset(&sum, 0, sizeof(sum));
+    for(i = 0; i < threads; i++) {
+        printf("worker %2d: %10llu requests %12llu bytes %8llu connections %6llu errors\n", i,
+               (unsigned long long)STAT_GET(&w[i], requests), (unsigned long long)STAT_GET(&w[i], bytes),
+               (unsigned long long)STAT_GET(&w[i], connections), (unsigned long long)STAT_GET(&w[i], errors));
+        sum.requests += STAT_GET(&w[i], requests);
+        sum.bytes += STAT_GET(&w[i], bytes);
+        sum.connections += STAT_GET(&w[i], connections);
+        sum.errors += STAT_GET(&w[i], errors);
+    }
+    printf("total    : %10llu requests %12llu bytes %8llu connections %6llu errors\n",
+           (unsigned long long)sum.requests, (unsigned long long)sum.bytes,
+           (unsigned long long)sum.connections, (unsigned long long)sum.errors);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    uint8_t bufSize[] = {2, 2, 2, 2, 2, 2, 2, 2};
+    wiz_NetInfo netInfo = {
+        .mac  = {0x00, 0x08, 0xdc, 0xab, 0xcd, 0xef},
+        .ip   = {127, 0, 0, 1},
+        .sn   = {255, 0, 0, 0},
+        .gw   = {127, 0, 0, 1},
+        .dns  = {127, 0, 0, 1},
+        .dhcp = NETINFO_STATIC
+    };
+    struct timespec tick = {1, 0};
+    server_worker* w;
+    pthread_t acq;
+    const char* image = 0;
+    time_t last;
+    int threads = 0, conns = 16, interval = 10, update = 0;
+    int i;
+
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-t") && i + 1 < argc) threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-c") && i + 1 < argc) conns = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-p") && i + 1 < argc) server_port = (uint16_t)atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-i") && i + 1 < argc) interval = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-u") && i + 1 < argc) update = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-m") && i + 1 < argc) image = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [-t threads] [-c connections] [-p port] [-i seconds] [-u usecs] [-m name]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(threads <= 0) threads = get_nprocs();
+    if(threads <= 0) threads = 1;
+    if(conns <= 0) conns = 1;
+    if(update < 0 || update >= 1000000) update = 0;
+    if(threads * conns > _WIZCHIP_SOCK_HANDLE_NUM_) {
+        fprintf(stderr, "%d threads x %d connections : more than %d sockets\n", threads, conns, _WIZCHIP_SOCK_HANDLE_NUM_);
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    if(image && modbus_store_map(image) != 0) {
+        fprintf(stderr, "%s: can't map the register image\n", image);
+        return 1;
+    }
+
+    // The socket table is set up before the workers share it.
+    if(wizchip_init(bufSize, bufSize) != 0) {
+        fprintf(stderr, "wizchip_init failed\n");
+        return 1;
+    }
+    wizchip_setnetinfo(&netInfo);
+
+    w = aligned_alloc(SERVER_CACHE_LINE, sizeof(server_worker) * threads);
+    if(!w) return 1;
+    memset(w, 0, sizeof(server_worker) * threads);
+    for(i = 0; i < threads; i++) {
+        w[i].base = (uint8_t)(i * conns);
+        w[i].count = (uint8_t)conns;
+        if(pthread_create(&w[i].tid, 0, worker_main, &w[i]) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            return 1;
+        }
+    }
+    if(update && pthread_create(&acq, 0, acquire_main, (void*)(intptr_t)update) != 0) {
+        fprintf(stderr, "pthread_create failed\n");
+        return 1;
+    }
+    printf("Modbus TCP server on port %u : %d workers x %d connections\n", server_port, threads, conns);
+    fflush(stdout);
+
+    last = time(NULL);
+    while(!stop) {
+        nanosleep(&tick, NULL);
+        if(interval > 0 && time(NULL) - last >= interval) {
+            last = time(NULL);
+            print_stats(w, threads);
+        }
+    }
+    for(i = 0; i < threads; i++) pthread_join(w[i].tid, 0);
+    if(update) pthread_join(acq, 0);
+    print_stats(w, threads);
+    free(w);
+    if(image) modbus_store_unmap();
+    return 0;
+}
@@ -0,0 +1,316 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+
+#include "posix_os.h"
+
+static void sa_set(struct sockaddr_in* sa, uint8_t* ip, uint16_t port)
+{
+   memset(sa, 0, sizeof(*sa));
+   sa->sin_family = AF_INET;
+   if(ip) memcpy(&sa->sin_addr.s_addr, ip, 4);
+   sa->sin_port = htons(port);
+}
+
+static void sa_get(struct sockaddr_in* sa, uint8_t* ip, uint16_t* port)
+{
+   if(ip) memcpy(ip, &sa->sin_addr.s_addr, 4);
+   if(port) *port = ntohs(sa->sin_port);
+}
+
+static int os_open(int type, uint16_t port, int reuseport)
+{
+   struct sockaddr_in sa;
+   int fd, on = 1;
+
+   fd = socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+   if(fd < 0) return -1;
+   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+   if(reuseport) setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+   if(port)
+   {
+      sa_set(&sa, 0, port);
+      if(bind(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0)
+      {
+         close(fd);
+         return -1;
+      }
+   }
+   return fd;
+}
+
+/*
+ * SO_REUSEPORT : each thread binds a listener of its own on the port and the
+ * kernel spreads the incoming connections over them.
+ */
+int os_tcp_listen(uint16_t port)
+{
+   int fd = os_open(SOCK_STREAM, port, 1);
+
+   if(fd < 0) return -1;
+   if(listen(fd, SOMAXCONN) < 0)
+   {
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+int os_tcp_accept(int lfd, uint8_t* ip, uint16_t* port)
+{
+   struct sockaddr_in sa;
+   socklen_t salen = sizeof(sa);
+   int fd;
+
+   fd = accept4(lfd, (struct sockaddr*)&sa, &salen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+   if(fd >= 0) sa_get(&sa, ip, port);
+   return fd;
+}
+
+int os_tcp_connect(uint16_t lport, uint8_t* ip, uint16_t port)
+{
+   struct sockaddr_in sa;
+   int fd = os_open(SOCK_STREAM, lport, 0);
+
+   if(fd < 0) return -1;
+   sa_set(&sa, ip, port);
+   if(connect(fd, (struct sockaddr*)&sa, sizeof(sa)) < 0 && errno != EINPROGRESS)
+   {
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+/* 1 : connected, 0 : in progress, -1 : failed */
+int os_tcp_connected(int fd)
+{
+   struct pollfd pfd = { fd, POLLOUT, 0 };
+   socklen_t len = sizeof(int);
+   int err = 0;
+
+   if(poll(&pfd, 1, 0) <= 0) return 0;
+   if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err) return -1;
+   return 1;
+}
+
+int os_udp_open(uint16_t port)
+{
+   int fd = os_open(SOCK_DGRAM, port, 0);
+   int on = 1;
+
+   if(fd >= 0) setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+   return fd;
+}
+
+void os_close(int fd)
+{
+   close(fd);
+}
+
+void os_shutdown(int fd)
+{
+   shutdown(fd, SHUT_WR);
+}
+
+static int32_t os_result(ssize_t ret)
+{
+   if(ret >= 0) return (int32_t)ret;
+   if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return OS_AGAIN;
+   return OS_ERROR;
+}
+
+int32_t os_send(int fd, uint8_t** bufs, uint16_t* lens, uint8_t cnt)
+{
+   struct iovec iov[cnt];
+   struct msghdr msg;
+   uint8_t i;
+
+   for(i = 0; i < cnt; i++)
+   {
+      iov[i].iov_base = bufs[i];
+      iov[i].iov_len  = lens[i];
+   }
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = iov;
+   msg.msg_iovlen = cnt;
+   return os_result(sendmsg(fd, &msg, MSG_NOSIGNAL));
+}
+
+int32_t os_recv(int fd, uint8_t* buf, uint16_t len)
+{
+   ssize_t ret = recv(fd, buf, len, 0);
+
+   if(ret == 0) return OS_EOF;
+   if(ret < 0) return os_result(ret);
+   return (int32_t)ret;
+}
+
+/* As os_recv() but the data stay queued. */
+// MSG_PEEK always starts at the head of the stream: the bytes before offset are copied too.
+int32_t os_peek(int fd, uint8_t* buf, uint16_t len, uint16_t offset)
+{
+   uint8_t* tmp = buf;
+   ssize_t ret;
+
+   if(offset && !(tmp = malloc((size_t)offset + len))) return OS_ERROR;
+   ret = recv(fd, tmp, (size_t)offset + len, MSG_PEEK);
+   if(ret > offset && tmp != buf) memcpy(buf, tmp + offset, ret - offset);
+   if(tmp != buf) free(tmp);
+   if(ret == 0) return OS_EOF;
+   if(ret < 0) return os_result(ret);
+   return (ret > offset) ? (int32_t)(ret - offset) : 0;
+}
+
+int32_t os_sendto(int fd, uint8_t* buf, uint16_t len, uint8_t* ip, uint16_t port)
+{
+   struct sockaddr_in sa;
+   ssize_t ret;
+
+   sa_set(&sa, ip, port);
+   ret = sendto(fd, buf, len, MSG_NOSIGNAL, (struct sockaddr*)&sa, sizeof(sa));
+   if(ret < 0) return os_result(ret);
+   return (int32_t)ret;
+}
+
+/* Gives the datagram size, OS_AGAIN when none is queued or it is empty. */
+int32_t os_recvfrom(int fd, uint8_t* buf, uint16_t len, uint8_t* ip, uint16_t* port)
+{
+   struct sockaddr_in sa;
+   socklen_t salen = sizeof(sa);
+   ssize_t ret;
+
+   ret = recvfrom(fd, buf, len, 0, (struct sockaddr*)&sa, &salen);
+   if(ret < 0) return os_result(ret);
+   sa_get(&sa, ip, port);
+   return (int32_t)ret;
+}
+
+/* Size of the next datagram, -1 when none is queued. */
+int32_t os_dgram_size(int fd)
+{
+   uint8_t dummy;
+   ssize_t ret = recv(fd, &dummy, 1, MSG_PEEK | MSG_TRUNC);
+
+   return (ret < 0) ? -1 : (int32_t)ret;
+}
+
+uint32_t os_rx_pending(int fd)
+{
+   int n = 0;
+
+   if(ioctl(fd, FIONREAD, &n) < 0 || n < 0) return 0;
+   return (uint32_t)n;
+}
+
+uint32_t os_tx_free(int fd)
+{
+   int size = 0, queued = 0;
+   socklen_t len = sizeof(size);
+
+   if(getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, &len) < 0) return 0;
+   if(ioctl(fd, SIOCOUTQ, &queued) < 0) queued = 0;
+   return (queued < size) ? (uint32_t)(size - queued) : 0;
+}
+
+/* Connected stream with nothing to read and the FIN of the peer received. */
+int os_peer_closed(int fd)
+{
+   struct pollfd pfd = { fd, POLLIN | POLLRDHUP, 0 };
+
+   if(poll(&pfd, 1, 0) <= 0) return 0;
+   if(pfd.revents & (POLLERR | POLLHUP)) return 1;
+   return (pfd.revents & POLLRDHUP) && os_rx_pending(fd) == 0;
+}
+
+int os_wait(int fd, int wr, int timeout_ms)
+{
+   struct pollfd pfd = { fd, (short)(wr ? POLLOUT : POLLIN), 0 };
+
+   return poll(&pfd, 1, timeout_ms);
+}
+
+void os_set_nodelay(int fd, int on)
+{
+   setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+void os_set_ttl(int fd, uint8_t ttl)
+{
+   int v = ttl;
+   setsockopt(fd, IPPROTO_IP, IP_TTL, &v, sizeof(v));
+}
+
+void os_set_tos(int fd, uint8_t tos)
+{
+   int v = tos;
+   setsockopt(fd, IPPROTO_IP, IP_TOS, &v, sizeof(v));
+}
+
+void os_set_mss(int fd, uint16_t mss)
+{
+   int v = mss;
+   if(mss) setsockopt(fd, IPPROTO_TCP, TCP_MAXSEG, &v, sizeof(v));
+}
+
+/* Sn_KPALVTR is in units of 5 seconds, 0 disables the keep-alive. */
+void os_set_keepalive(int fd, uint8_t unit5s)
+{
+   int on = unit5s ? 1 : 0, secs = unit5s * 5;
+
+   setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+   if(on)
+   {
+      setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &secs, sizeof(secs));
+      setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &secs, sizeof(secs));
+   }
+}
+
+int os_poller_open(void)
+{
+   return epoll_create1(EPOLL_CLOEXEC);
+}
+
+/* Edge-triggered : an event is reported once per change, until the descriptor is drained. */
+void os_poller_close(int ep)
+{
+   if(ep >= 0) close(ep);
+}
+
+int os_poller_add(int ep, int fd, uint32_t tag)
+{
+   struct epoll_event ev;
+
+   ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+   ev.data.u64 = tag;
+   return epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int os_poller_wait(int ep, uint32_t* tags, uint8_t* evs, int max, int timeout_ms)
+{
+   struct epoll_event ev[max];
+   int i, n;
+
+   n = epoll_wait(ep, ev, max, timeout_ms);
+   for(i = 0; i < n; i++)
+   {
+      tags[i] = (uint32_t)ev[i].data.u64;
+      evs[i]  = 0;
+      if(ev[i].events & EPOLLIN)                evs[i] |= OS_EV_IN;
+      if(ev[i].events & EPOLLOUT)               evs[i] |= OS_EV_OUT;
+      if(ev[i].events & (EPOLLRDHUP | EPOLLHUP)) evs[i] |= OS_EV_RDHUP | OS_EV_IN;
+      if(ev[i].events & EPOLLERR)               evs[i] |= OS_EV_ERR | OS_EV_IN;
+   }
+   return (n < 0) ? 0 : n;
+}
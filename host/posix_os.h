@@ -0,0 +1,57 @@
+#ifndef _POSIX_OS_H_
+#define _POSIX_OS_H_
+
+#include <stdint.h>
+
+/*
+    Thin layer over the BSD socket calls of the host for socket_posix.c.
+
+    It is a translation unit of its own because <netinet/in.h> and the
+    socket.h API can not be seen together: IPPROTO_xxx are redefined by
+    W5500/w5500.h and the socket.h function names are those of the C library.
+    Addresses are IPv4 as uint8_t[4] in network order, ports in host order.
+    All descriptors are non-blocking.
+ */
+
+#define OS_AGAIN        0       // would block
+#define OS_EOF          (-1)    // peer closed
+#define OS_ERROR        (-2)    // connection lost
+
+// Readiness reported by os_poller_wait()
+#define OS_EV_IN        0x01
+#define OS_EV_OUT       0x02
+#define OS_EV_RDHUP     0x04
+#define OS_EV_ERR       0x08
+
+int      os_tcp_listen(uint16_t port);
+int      os_tcp_accept(int lfd, uint8_t* ip, uint16_t* port);
+int      os_tcp_connect(uint16_t lport, uint8_t* ip, uint16_t port);
+int      os_tcp_connected(int fd);
+int      os_udp_open(uint16_t port);
+void     os_close(int fd);
+void     os_shutdown(int fd);
+
+int32_t  os_send(int fd, uint8_t** bufs, uint16_t* lens, uint8_t cnt);
+int32_t  os_recv(int fd, uint8_t* buf, uint16_t len);
+int32_t  os_peek(int fd, uint8_t* buf, uint16_t len, uint16_t offset);
+int32_t  os_sendto(int fd, uint8_t* buf, uint16_t len, uint8_t* ip, uint16_t port);
+int32_t  os_recvfrom(int fd, uint8_t* buf, uint16_t len, uint8_t* ip, uint16_t* port);
+int32_t  os_dgram_size(int fd);
+
+uint32_t os_rx_pending(int fd);
+uint32_t os_tx_free(int fd);
+int      os_peer_closed(int fd);
+int      os_wait(int fd, int wr, int timeout_ms);
+
+void     os_set_nodelay(int fd, int on);
+void     os_set_ttl(int fd, uint8_t ttl);
+void     os_set_tos(int fd, uint8_t tos);
+void     os_set_mss(int fd, uint16_t mss);
+void     os_set_keepalive(int fd, uint8_t unit5s);
+
+int      os_poller_open(void);
+void     os_poller_close(int ep);
+int      os_poller_add(int ep, int fd, uint32_t tag);
+int      os_poller_wait(int ep, uint32_t* tags, uint8_t* evs, int max, int timeout_ms);
+
+#endif
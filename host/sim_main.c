@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "wizchip_conf.h"
+#include "socket.h"
+#include "modbus.h"
+#include "httpServer.h"
+#if !_WIZCHIP_IO_POSIX_
+#include "w5500_sim.h"
+#endif
+
+/*
+    Host harness with a TCP echo on port 5000 and a UDP echo on port 3000,
+    the same services as loopback_tcps() / loopback_udps() on the board, the
+    Modbus TCP server of modbus.c on port 502 and the HTTP server of
+    Internet/httpServer on port 80, with a page of its own and the Modbus
+    registers through registers.cgi, /events and /ws.
+
+    w5500_sim runs the unmodified socket.c / w5500.c driver against the W5500
+    model (ports plus W5500_SIM_PORT_OFFSET) and prints the SPI cost of the
+    traffic. wiz_posix runs on the POSIX socket backend (_WIZCHIP_IO_POSIX_).
+
+    usage: w5500_sim [-b] [-i seconds]
+        -b  register the byte callbacks only, no burst callbacks
+        -i  interval of the statistics print, 0 to print on exit only (default 10)
+ */
+
+#define SOCK_TCPS       0
+#define SOCK_UDPS       1
+#define SOCK_MODBUS     2
+#define SOCK_HTTP       3       // first of the HTTP sockets
+#define HTTP_SOCK_NUM   4
+#define PORT_TCPS       5000
+#define PORT_UDPS       3000
+#define PORT_MODBUS     502
+
+#define DATA_BUF_SIZE   2048
+
+static uint8_t ethBuf0[DATA_BUF_SIZE];
+static uint8_t ethBuf1[DATA_BUF_SIZE];
+static uint8_t ethBuf2[DATA_BUF_SIZE];
+static uint8_t httpTx[DATA_BUF_SIZE];
+static uint8_t httpRx[DATA_BUF_SIZE];
+
+static const uint8_t sim_index[] =
+    "<!DOCTYPE html>\n<html><head><title>w5500 host harness</title></head><body>\n"
+    "<h1>w5500 host harness</h1>\n"
+    "<p><a href=\"registers.cgi\">registers.cgi</a> <a href=\"events\">events</a></p>\n"
+    "</body></html>\n";
+
+// The content_etag is any tag but 0; change it with the page.
+static const httpServer_webContent sim_content[] = {
+    { "index.html", sizeof(sim_index) - 1, sim_index, 0x5e1f0001UL },
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+// Returns the count of bytes echoed, 0 if none, or a negative SOCKERR_xxx.
+static int32_t echo_tcps(uint8_t sn, uint8_t* buf, uint16_t port) {
+    int32_t ret;
+    uint16_t size, sentsize;
+
+    switch(getSn_SR(sn)) {
+        case SOCK_ESTABLISHED :
+            if(getSn_IR(sn) & Sn_IR_CON) setSn_IR(sn, Sn_IR_CON);
+            if((size = getSn_RX_RSR(sn)) > 0) {
+                if(size > DATA_BUF_SIZE) size = DATA_BUF_SIZE;
+                setSn_IR(sn, Sn_IR_RECV);
+                ret = recv(sn, buf, size);
+                if(ret <= 0) return ret;
+                size = (uint16_t)ret;
+                sentsize = 0;
+                while(size != sentsize) {
+                    ret = send(sn, buf + sentsize, size - sentsize);
+                    if(ret < 0) {
+                        close(sn);
+                        return ret;
+                    }
+                    sentsize += (uint16_t)ret;
+                }
+                return size;
+            }
+            break;
+        case SOCK_CLOSE_WAIT :
+            if((ret = disconnect(sn)) != SOCK_OK) return ret;
+            break;
+        case SOCK_INIT :
+            if((ret = listen(sn)) != SOCK_OK) return ret;
+            break;
+        case SOCK_CLOSED :
+            if((ret = socket(sn, Sn_MR_TCP, port, 0x00)) != sn) return ret;
+            break;
+        default :
+            break;
+    }
+    return 0;
+}
+
+static int32_t echo_udps(uint8_t sn, uint8_t* buf, uint16_t port) {
+    int32_t ret;
+    uint16_t size, sentsize;
+    uint8_t destip[4];
+    uint16_t destport;
+
+    switch(getSn_SR(sn)) {
+        case SOCK_UDP :
+            if((size = getSn_RX_RSR(sn)) > 0) {
+                if(size > DATA_BUF_SIZE) size = DATA_BUF_SIZE;
+                setSn_IR(sn, Sn_IR_RECV);
+                ret = recvfrom(sn, buf, size, destip, &destport);
+                if(ret <= 0) return ret;
+                size = (uint16_t)ret;
+                sentsize = 0;
+                while(sentsize != size) {
+                    ret = sendto(sn, buf + sentsize, size - sentsize, destip, destport);
+                    if(ret < 0) return ret;
+                    sentsize += (uint16_t)ret;
+                }
+                return size;
+            }
+            break;
+        case SOCK_CLOSED :
+            if((ret = socket(sn, Sn_MR_UDP, port, 0x00)) != sn) return ret;
+            break;
+        default :
+            break;
+    }
+    return 0;
+}
+
+// Runs the service of socket sn once. Returns the count of bytes done, 0 if none, or a negative SOCKERR_xxx.
+static int32_t service(uint8_t sn) {
+    int32_t ret;
+    uint8_t ir;
+
+    if(sn >= SOCK_HTTP) {
+#if _WIZCHIP_IO_POSIX_
+        // httpServer_run() clears Sn_IR_CON only; what it sends raises Sn_IR_SENDOK again.
+        // On the chip send() takes Sn_IR_SENDOK itself, and it is left to it there.
+        if((ir = getSn_IR(sn) & (Sn_IR_RECV | Sn_IR_SENDOK)) != 0) setSn_IR(sn, ir);
+#else
+        (void)ir;
+#endif
+        httpServer_run(sn - SOCK_HTTP);
+        return 0;
+    }
+    switch(sn) {
+        case SOCK_TCPS :
+            if((ret = echo_tcps(sn, ethBuf0, PORT_TCPS)) < 0) fprintf(stderr, "%d: tcp echo error %d\n", sn, ret);
+            break;
+        case SOCK_UDPS :
+            if((ret = echo_udps(sn, ethBuf1, PORT_UDPS)) < 0) fprintf(stderr, "%d: udp echo error %d\n", sn, ret);
+            break;
+        default :
+            if((ret = loopback_modbus(sn, ethBuf2, PORT_MODBUS, 0)) < 0) fprintf(stderr, "%d: modbus error %d\n", sn, ret);
+            break;
+    }
+    return ret;
+}
+
+#if _WIZCHIP_IO_POSIX_
+// Runs the service of sn until its socket waits on the network, as host/modbus_server.c does.
+static void serve(uint8_t sn) {
+    uint8_t n, sr;
+
+    for(n = 0; n < 4; n++) {
+        if(service(sn) < 0) break;
+        sr = getSn_SR(sn);
+        if(sr == SOCK_LISTEN || sr == SOCK_UDP || (sr == SOCK_ESTABLISHED && !(getSn_IR(sn) & Sn_IR_RECV))) break;
+    }
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    uint8_t bufSize[] = {2, 2, 2, 2, 2, 2, 2, 2};
+    uint8_t imr = SIK_CONNECTED | SIK_DISCONNECTED | SIK_RECEIVED;
+    uint8_t httpImr = SIK_CONNECTED | SIK_DISCONNECTED | SIK_RECEIVED | SIK_SENT;
+    uint8_t httpSocks[HTTP_SOCK_NUM];
+#if _WIZCHIP_IO_POSIX_
+    uint8_t ready[SOCK_HTTP + HTTP_SOCK_NUM];
+    int16_t n;
+#else
+    int32_t busy;
+#endif
+    wiz_NetInfo netInfo = {
+        .mac  = {0x00, 0x08, 0xdc, 0xab, 0xcd, 0xef},
+        .ip   = {127, 0, 0, 1},
+        .sn   = {255, 0, 0, 0},
+        .gw   = {127, 0, 0, 1},
+        .dns  = {127, 0, 0, 1},
+        .dhcp = NETINFO_STATIC
+    };
+    struct timespec idle = {0, 1000000};
+    time_t last, tick;
+    int interval = 10;
+    int burst = 1;
+    int i;
+
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-b")) burst = 0;
+        else if(!strcmp(argv[i], "-i") && i + 1 < argc) interval = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-b] [-i seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+#if !_WIZCHIP_IO_POSIX_
+    w5500_sim_init();
+    reg_wizchip_cs_cbfunc(w5500_sim_cs_select, w5500_sim_cs_deselect);
+    reg_wizchip_spi_cbfunc(w5500_sim_spi_readbyte, w5500_sim_spi_writebyte);
+    if(burst) reg_wizchip_spiburst_cbfunc(w5500_sim_spi_readburst, w5500_sim_spi_writeburst);
+#else
+    (void)burst;
+#endif
+
+    if(wizchip_init(bufSize, bufSize) != 0) {
+        fprintf(stderr, "wizchip_init failed\n");
+        return 1;
+    }
+    wizchip_setnetinfo(&netInfo);
+    for(i = 0; i < SOCK_HTTP; i++) ctlsocket(i, CS_SET_INTMASK, &imr);
+    for(i = 0; i < HTTP_SOCK_NUM; i++) {
+        // A response goes on as the TX buffer frees up.
+        ctlsocket(SOCK_HTTP + i, CS_SET_INTMASK, &httpImr);
+        httpSocks[i] = SOCK_HTTP + i;
+    }
+    httpServer_init(httpTx, httpRx, HTTP_SOCK_NUM, httpSocks);
+    reg_httpServer_webContent(sim_content, sizeof(sim_content) / sizeof(sim_content[0]));
+#if !_WIZCHIP_IO_POSIX_
+    w5500_sim_clear_stats();
+#endif
+
+    last = tick = time(NULL);
+#if _WIZCHIP_IO_POSIX_
+    // A socket is served when it has an interrupt in its Sn_IMR, once opened.
+    for(i = 0; i < SOCK_HTTP + HTTP_SOCK_NUM; i++) serve(i);
+#endif
+    while(!stop) {
+#if _WIZCHIP_IO_POSIX_
+        // Sleep until a socket has an interrupt in its Sn_IMR and serve only those.
+        n = wizchip_posix_wait(ready, sizeof(ready), 1000);
+        for(i = 0; i < n; i++) serve(ready[i]);
+#else
+        busy = 0;
+        for(i = 0; i < SOCK_HTTP + HTTP_SOCK_NUM; i++) {
+            if(service(i) > 0) busy = 1;
+        }
+#endif
+        if(time(NULL) != tick) {
+            tick = time(NULL);
+            httpServer_time_handler();
+#if _WIZCHIP_IO_POSIX_
+            // The idle timeouts of the HTTP connections raise no interrupt.
+            for(i = 0; i < HTTP_SOCK_NUM; i++) serve(SOCK_HTTP + i);
+#endif
+        }
+#if !_WIZCHIP_IO_POSIX_
+        if(!busy) nanosleep(&idle, NULL);
+        if(interval > 0 && time(NULL) - last >= interval) {
+            last = time(NULL);
+            w5500_sim_print_stats(stdout);
+            fflush(stdout);
+        }
+#endif
+    }
+#if !_WIZCHIP_IO_POSIX_
+    w5500_sim_print_stats(stdout);
+#else
+    (void)last;
+    (void)interval;
+    (void)idle;
+#endif
+    return 0;
+}
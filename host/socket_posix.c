@@ -0,0 +1,1032 @@
+//*****************************************************************************
+//
+//! \file socket_posix.c
+//! \brief SOCKET APIs on the POSIX sockets of the host.
+//! \details Built with _WIZCHIP_IO_POSIX_ in place of socket.c and W5500/w5500.c.
+//!          The APIs of socket.h keep their return values and socket states, and
+//!          the Sn_ register macros (getSn_SR(), getSn_IR(), getSn_RX_RSR(), ...)
+//!          read the state kept here, so the application code runs unmodified.
+//!          The common registers are kept in memory.
+//!
+//!          The host sockets are watched by an edge-triggered epoll. The events
+//!          feed Sn_SR / Sn_IR, so polling a socket costs no system call while
+//!          nothing happens on it, and wizchip_posix_wait() sleeps until some
+//!          socket has an interrupt in its Sn_IMR.
+//!
+//!          The poller, the ready list and the listeners form the event loop of
+//!          a thread. A thread calling wizchip_posix_attach() gets a loop of its
+//!          own, with its own SO_REUSEPORT listener on each port it listens, so
+//!          the threads sharing the socket table each serve their own
+//!          connections. A socket handle is used by one thread at a time.
+//!
+//!          Not supported : Sn_MR_MACRAW, Sn_MR_IPRAW, multicast, and the Sn_CR
+//!          commands written through the register macros. The sockets are bound
+//!          to INADDR_ANY whatever SIPR is.
+//
+//*****************************************************************************
+#include <stdlib.h>
+#include <string.h>
+
+#include "socket.h"
+#include "posix_os.h"
+
+#define SOCK_ANY_PORT_NUM  0xC000
+#define SOCK_DGRAM_MAX     65535
+#define SOCK_HEADER_UDP    8        // Sn_RX_RSR counts the 8-byte header of W5500 in front of each datagram
+#define SOCK_CACHE_LINE    64
+
+typedef struct
+{
+   int      fd;          // connection or UDP socket, -1 if none
+   int      lsn;         // listener index while SOCK_LISTEN
+   uint8_t  mr;          // Sn_MR
+   uint8_t  sr;          // Sn_SR
+   uint8_t  ir;          // Sn_IR
+   uint8_t  imr;         // Sn_IMR
+   uint8_t  iomode;      // SOCK_IO_BLOCK or SOCK_IO_NONBLOCK
+   uint8_t  tos;         // Sn_TOS
+   uint8_t  ttl;         // Sn_TTL
+   uint8_t  kpalvtr;     // Sn_KPALVTR
+   uint8_t  txbuf;       // Sn_TXBUF_SIZE in KB
+   uint8_t  rxbuf;       // Sn_RXBUF_SIZE in KB
+   uint16_t mss;         // Sn_MSSR
+   uint16_t port;        // Sn_PORT
+   uint8_t  dip[4];      // Sn_DIPR
+   uint16_t dport;       // Sn_DPORT
+   uint8_t  packinfo;    // PACK_xxx of recvfrom()
+   uint16_t remained;    // remained size of the datagram in dgram
+   uint16_t offset;      // read offset in dgram
+   uint8_t* dgram;       // datagram read partially by recvfrom()
+   uint8_t  ev;          // OS_EV_xxx reported by the poller and not drained yet
+   uint8_t  queued;      // in the ready list
+}__attribute__((aligned(SOCK_CACHE_LINE))) posix_sock;   // the handles of two threads don't share a line
+
+typedef struct
+{
+   uint16_t port;
+   int      fd;
+   int      refs;
+   uint8_t  ev;
+   uint8_t  lsock[(_WIZCHIP_SOCK_HANDLE_NUM_ + 7) / 8];   // the handles listening on it
+}posix_listener;
+
+typedef struct
+{
+   int            ep;                                   // the poller
+   uint8_t        ready[_WIZCHIP_SOCK_HANDLE_NUM_];     // ring of the handles to check
+   uint16_t       ready_head;
+   uint16_t       ready_cnt;
+   uint8_t        ev_waited;                            // the events are taken by wizchip_posix_wait() only
+   posix_listener listener[_WIZCHIP_SOCK_HANDLE_NUM_];
+}__attribute__((aligned(SOCK_CACHE_LINE))) posix_loop;
+
+
+static posix_sock      sock_tbl[_WIZCHIP_SOCK_HANDLE_NUM_];
+static uint8_t         sock_tbl_ready = 0;
+static uint32_t        sock_any_port = 0;
+static uint8_t         creg[0x40];
+
+#define SOCK_TAG_LISTENER  0x100       // poller tag of a listener, or'ed with its index
+#define SOCK_EV_BATCH      64
+
+static posix_loop            sock_loop_main;                    // the loop of the threads not attached
+static __thread posix_loop*  sock_loop = &sock_loop_main;
+
+#define CHECK_SOCKNUM()   \
+   do{                    \
+      if(sn >= _WIZCHIP_SOCK_HANDLE_NUM_) return SOCKERR_SOCKNUM;   \
+      if(!sock_tbl_ready) sock_tbl_init();                          \
+      s = &sock_tbl[sn];                                            \
+   }while(0);             \
+
+#define CHECK_SOCKMODE(mode)  \
+   do{                     \
+      if((s->mr & 0x0F) != mode) return SOCKERR_SOCKMODE;  \
+   }while(0);              \
+
+#define CHECK_SOCKDATA()   \
+   do{                     \
+      if(len == 0) return SOCKERR_DATALEN;   \
+   }while(0);              \
+
+#define SOCK_TXMAX(s)      ((uint16_t)((s)->txbuf << 10))
+#define SOCK_RXMAX(s)      ((uint16_t)((s)->rxbuf << 10))
+#define SOCK_BLOCKING(s)   ((s)->iomode == SOCK_IO_BLOCK)
+
+static void sock_reset(posix_sock* s)
+{
+   memset(s, 0, sizeof(*s));
+   s->fd = -1;
+   s->lsn = -1;
+   s->imr = 0xFF;
+   s->ttl = 0x80;
+   s->txbuf = 16;
+   s->rxbuf = 16;
+}
+
+static void creg_reset(void)
+{
+   memset(creg, 0, sizeof(creg));
+   creg[0x19] = 0x07;            // RTR
+   creg[0x1A] = 0xD0;
+   creg[0x1B] = 0x08;            // RCR
+   creg[0x2E] = 0x80 | PHYCFGR_OPMDC_ALLA | PHYCFGR_DPX_FULL | PHYCFGR_SPD_100 | PHYCFGR_LNK_ON;
+   creg[0x39] = 0x04;            // VERSIONR
+}
+
+static int loop_init(posix_loop* L)
+{
+   uint16_t i;
+
+   memset(L, 0, sizeof(*L));
+   for(i = 0; i < _WIZCHIP_SOCK_HANDLE_NUM_; i++) L->listener[i].fd = -1;
+   L->ep = os_poller_open();
+   return L->ep;
+}
+
+static void sock_tbl_init(void)
+{
+   uint16_t i;
+
+   for(i = 0; i < _WIZCHIP_SOCK_HANDLE_NUM_; i++) sock_reset(&sock_tbl[i]);
+   creg_reset();
+   loop_init(&sock_loop_main);
+   sock_tbl_ready = 1;
+}
+
+static void sock_ready_push(uint8_t sn)
+{
+   posix_loop* L = sock_loop;
+
+   if(sock_tbl[sn].queued) return;
+   sock_tbl[sn].queued = 1;
+   L->ready[(L->ready_head + L->ready_cnt) % _WIZCHIP_SOCK_HANDLE_NUM_] = sn;
+   L->ready_cnt++;
+}
+
+static uint8_t sock_ready_pop(void)
+{
+   posix_loop* L = sock_loop;
+   uint8_t sn = L->ready[L->ready_head];
+
+   L->ready_head = (L->ready_head + 1) % _WIZCHIP_SOCK_HANDLE_NUM_;
+   L->ready_cnt--;
+   sock_tbl[sn].queued = 0;
+   return sn;
+}
+
+static void sock_watch(posix_sock* s)
+{
+   s->ev = 0;
+   os_poller_add(sock_loop->ep, s->fd, (uint32_t)(s - sock_tbl));
+}
+
+/* Takes the events of the poller and queues the sockets concerned. */
+static void sock_events(int timeout_ms)
+{
+   uint32_t tags[SOCK_EV_BATCH];
+   uint8_t  evs[SOCK_EV_BATCH];
+   posix_listener* l;
+   posix_sock* s;
+   int i, n;
+   uint16_t j;
+
+   do
+   {
+      n = os_poller_wait(sock_loop->ep, tags, evs, SOCK_EV_BATCH, timeout_ms);
+      timeout_ms = 0;
+      for(i = 0; i < n; i++)
+      {
+         if(tags[i] & SOCK_TAG_LISTENER)
+         {
+            // All the sockets listening on it compete for the connections.
+            l = &sock_loop->listener[tags[i] & 0xFF];
+            l->ev |= evs[i];
+            for(j = 0; j < _WIZCHIP_SOCK_HANDLE_NUM_; j++)
+            {
+               if(l->lsock[j >> 3] & (1 << (j & 7))) sock_ready_push((uint8_t)j);
+            }
+            continue;
+         }
+         s = &sock_tbl[tags[i]];
+         s->ev |= evs[i];
+         if((evs[i] & OS_EV_OUT) && (s->sr == SOCK_ESTABLISHED || s->sr == SOCK_CLOSE_WAIT)) s->ir |= Sn_IR_SENDOK;
+         sock_ready_push((uint8_t)tags[i]);
+      }
+   }while(n == SOCK_EV_BATCH);
+}
+
+/*
+ * The sockets listening on the same port in a loop share one listener. It
+ * stays bound while no socket listens, so the clients connecting meanwhile
+ * wait in its backlog instead of being refused.
+ */
+static int listener_get(uint8_t sn, uint16_t port)
+{
+   posix_listener* l = sock_loop->listener;
+   int i, idx = -1;
+
+   for(i = 0; i < _WIZCHIP_SOCK_HANDLE_NUM_; i++)
+   {
+      if(l[i].fd >= 0 && l[i].port == port)
+      {
+         idx = i;
+         break;
+      }
+   }
+   if(idx < 0)
+   {
+      for(i = 0; i < _WIZCHIP_SOCK_HANDLE_NUM_; i++)
+      {
+         if(l[i].fd < 0) { idx = i; break; }
+         if(l[i].refs == 0 && idx < 0) idx = i;
+      }
+      if(idx < 0) return -1;
+      if(l[idx].fd >= 0) os_close(l[idx].fd);
+      memset(&l[idx], 0, sizeof(l[idx]));
+      l[idx].fd = os_tcp_listen(port);
+      if(l[idx].fd < 0) return -1;
+      l[idx].port = port;
+      os_poller_add(sock_loop->ep, l[idx].fd, SOCK_TAG_LISTENER | (uint32_t)idx);
+   }
+   l[idx].refs++;
+   l[idx].lsock[sn >> 3] |= (1 << (sn & 7));
+   return idx;
+}
+
+static void listener_put(uint8_t sn, int idx)
+{
+   posix_listener* l;
+
+   if(idx < 0) return;
+   l = &sock_loop->listener[idx];
+   if(l->refs) l->refs--;
+   l->lsock[sn >> 3] &= ~(1 << (sn & 7));
+}
+
+static void sock_release(posix_sock* s)
+{
+   if(s->sr == SOCK_LISTEN) listener_put((uint8_t)(s - sock_tbl), s->lsn);
+   s->lsn = -1;
+   if(s->fd >= 0) os_close(s->fd);
+   s->fd = -1;
+   free(s->dgram);
+   s->dgram = 0;
+   s->remained = 0;
+   s->packinfo = 0;
+   s->ev = 0;
+}
+
+static void sock_lost(posix_sock* s, uint8_t ir)
+{
+   sock_release(s);
+   s->sr = SOCK_CLOSED;
+   s->ir |= ir;
+}
+
+static void sock_apply_opts(posix_sock* s)
+{
+   os_set_ttl(s->fd, s->ttl);
+   os_set_tos(s->fd, s->tos);
+   if((s->mr & 0x0F) == Sn_MR_TCP)
+   {
+      os_set_nodelay(s->fd, (s->mr & Sn_MR_ND) != 0);
+      os_set_keepalive(s->fd, s->kpalvtr);
+   }
+}
+
+/*
+ * Brings Sn_SR and Sn_IR up to the state of the host socket. Only the sockets
+ * with an event not drained yet make a system call.
+ */
+static void sock_update(posix_sock* s)
+{
+   posix_listener* l;
+   int ret;
+
+   if(!sock_loop->ev_waited) sock_events(0);
+   switch(s->sr)
+   {
+      case SOCK_LISTEN:
+         if(s->lsn < 0) break;
+         l = &sock_loop->listener[s->lsn];
+         if(!(l->ev & OS_EV_IN)) break;
+         ret = os_tcp_accept(l->fd, s->dip, &s->dport);
+         if(ret < 0)
+         {
+            l->ev &= ~OS_EV_IN;
+            break;
+         }
+         listener_put((uint8_t)(s - sock_tbl), s->lsn);
+         s->lsn = -1;
+         s->fd = ret;
+         sock_apply_opts(s);
+         sock_watch(s);
+         s->sr = SOCK_ESTABLISHED;
+         s->ir |= Sn_IR_CON;
+         break;
+      case SOCK_SYNSENT:
+         if(!(s->ev & (OS_EV_OUT | OS_EV_ERR))) break;
+         ret = os_tcp_connected(s->fd);
+         if(ret < 0) sock_lost(s, Sn_IR_TIMEOUT);
+         else if(ret > 0)
+         {
+            s->sr = SOCK_ESTABLISHED;
+            s->ir |= Sn_IR_CON;
+         }
+         break;
+      case SOCK_ESTABLISHED:
+         if(!(s->ev & OS_EV_IN)) break;
+         if(os_rx_pending(s->fd)) s->ir |= Sn_IR_RECV;
+         else if(s->ev & OS_EV_RDHUP)
+         {
+            s->sr = SOCK_CLOSE_WAIT;
+            s->ir |= Sn_IR_DISCON;
+         }
+         else s->ev &= ~OS_EV_IN;
+         break;
+      case SOCK_UDP:
+         if(s->remained) s->ir |= Sn_IR_RECV;
+         else if(!(s->ev & OS_EV_IN)) break;
+         else if(os_dgram_size(s->fd) >= 0) s->ir |= Sn_IR_RECV;
+         else s->ev &= ~OS_EV_IN;
+         break;
+      default:
+         break;
+   }
+}
+
+static uint16_t sock_rx_rsr(posix_sock* s)
+{
+   uint32_t size = 0;
+   int32_t  dsize;
+
+   sock_update(s);
+   if(s->fd < 0) return 0;
+   if(s->sr == SOCK_UDP && s->remained) size = s->remained;
+   else if(!(s->ev & OS_EV_IN)) return 0;
+   else if(s->sr == SOCK_UDP)
+   {
+      if((dsize = os_dgram_size(s->fd)) >= 0) size = (uint32_t)dsize + SOCK_HEADER_UDP;
+   }
+   else size = os_rx_pending(s->fd);
+   if(size > SOCK_RXMAX(s)) size = SOCK_RXMAX(s);
+   return (uint16_t)size;
+}
+
+static uint16_t sock_tx_fsr(posix_sock* s)
+{
+   uint32_t size;
+
+   sock_update(s);
+   if(s->fd < 0 || s->sr == SOCK_UDP) return SOCK_TXMAX(s);
+   size = os_tx_free(s->fd);
+   if(size > SOCK_TXMAX(s)) size = SOCK_TXMAX(s);
+   return (uint16_t)size;
+}
+
+int8_t socket(uint8_t sn, uint8_t protocol, uint16_t port, uint8_t flag)
+{
+   posix_sock* s;
+   uint32_t taddr;
+
+   CHECK_SOCKNUM();
+   switch(protocol)
+   {
+      case Sn_MR_TCP :
+         getSIPR((uint8_t*)&taddr);
+         if(taddr == 0) return SOCKERR_SOCKINIT;
+         if(flag & ~(SF_TCP_NODELAY | SF_IO_NONBLOCK)) return SOCKERR_SOCKFLAG;
+         break;
+      case Sn_MR_UDP :
+         if(flag & (SF_MULTI_ENABLE | SF_IGMP_VER2 | SF_UNI_BLOCK)) return SOCKERR_SOCKFLAG;
+         break;
+      default :
+         return SOCKERR_SOCKMODE;   // Sn_MR_MACRAW and Sn_MR_IPRAW need raw sockets
+   }
+   close(sn);
+   if(port == 0)
+      port = SOCK_ANY_PORT_NUM + __atomic_fetch_add(&sock_any_port, 1, __ATOMIC_RELAXED) % (0xFFF0 - SOCK_ANY_PORT_NUM);
+   s->mr = protocol | (flag & 0xF0);
+   s->port = port;
+   s->iomode = (flag & SF_IO_NONBLOCK) ? SOCK_IO_NONBLOCK : SOCK_IO_BLOCK;
+   if(protocol == Sn_MR_UDP)
+   {
+      s->fd = os_udp_open(port);
+      if(s->fd < 0) return SOCKERR_SOCKINIT;
+      sock_apply_opts(s);
+      sock_watch(s);
+      s->sr = SOCK_UDP;
+   }
+   else s->sr = SOCK_INIT;
+   return (int8_t)sn;
+}
+
+int8_t close(uint8_t sn)
+{
+   posix_sock* s;
+
+   CHECK_SOCKNUM();
+   sock_release(s);
+   s->sr = SOCK_CLOSED;
+   s->ir = 0;
+   s->iomode = SOCK_IO_BLOCK;
+   return SOCK_OK;
+}
+
+int8_t listen(uint8_t sn)
+{
+   posix_sock* s;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   if(s->sr != SOCK_INIT) return SOCKERR_SOCKINIT;
+   s->lsn = listener_get(sn, s->port);
+   if(s->lsn < 0)
+   {
+      close(sn);
+      return SOCKERR_SOCKCLOSED;
+   }
+   s->sr = SOCK_LISTEN;
+   sock_ready_push(sn);     // the listener may hold connections already
+   return SOCK_OK;
+}
+
+int8_t connect(uint8_t sn, uint8_t * addr, uint16_t port)
+{
+   posix_sock* s;
+   uint32_t taddr;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   if(s->sr != SOCK_INIT) return SOCKERR_SOCKINIT;
+   memcpy(&taddr, addr, 4);
+   if(taddr == 0xFFFFFFFF || taddr == 0) return SOCKERR_IPINVALID;
+   if(port == 0) return SOCKERR_PORTZERO;
+   memcpy(s->dip, addr, 4);
+   s->dport = port;
+   s->fd = os_tcp_connect(s->port, addr, port);
+   if(s->fd < 0) return SOCKERR_TIMEOUT;
+   sock_apply_opts(s);
+   sock_watch(s);
+   s->sr = SOCK_SYNSENT;
+   if(!SOCK_BLOCKING(s)) return SOCK_BUSY;
+   while(s->sr != SOCK_ESTABLISHED)
+   {
+      os_wait(s->fd, 1, -1);
+      s->ev |= OS_EV_OUT;
+      sock_update(s);
+      if(s->sr == SOCK_CLOSED) return SOCKERR_TIMEOUT;
+   }
+   return SOCK_OK;
+}
+
+int8_t disconnect(uint8_t sn)
+{
+   posix_sock* s;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   if(s->fd >= 0) os_shutdown(s->fd);
+   sock_release(s);
+   s->sr = SOCK_CLOSED;
+   return SOCK_OK;
+}
+
+/* send() and sendv() : the whole length is queued at once, as in the TX buffer of WIZCHIP. */
+static int32_t sock_send(uint8_t sn, posix_sock* s, uint8_t** bufs, uint16_t* lens, uint8_t cnt, uint32_t total)
+{
+   uint16_t len;
+   uint32_t sent = 0;
+   int32_t  ret;
+   uint8_t  i;
+
+   if(s->sr != SOCK_ESTABLISHED && s->sr != SOCK_CLOSE_WAIT) return SOCKERR_SOCKSTATUS;
+   len = (total > SOCK_TXMAX(s)) ? SOCK_TXMAX(s) : (uint16_t)total;
+   // The trailing fragments are truncated to fit.
+   for(i = 0, total = 0; i < cnt; i++)
+   {
+      if(total + lens[i] > len) lens[i] = (uint16_t)(len - total);
+      total += lens[i];
+   }
+   if(!SOCK_BLOCKING(s) && len > sock_tx_fsr(s)) return SOCK_BUSY;
+   while(sent < len)
+   {
+      ret = os_send(s->fd, bufs, lens, cnt);
+      if(ret == OS_ERROR)
+      {
+         close(sn);
+         return SOCKERR_SOCKSTATUS;
+      }
+      sent += (uint32_t)ret;
+      // Skip what is sent and wait for room for the rest.
+      while(cnt && (uint32_t)ret >= lens[0])
+      {
+         ret -= lens[0];
+         bufs++;
+         lens++;
+         cnt--;
+      }
+      if(cnt)
+      {
+         bufs[0] += ret;
+         lens[0] -= (uint16_t)ret;
+         os_wait(s->fd, 1, -1);
+      }
+   }
+   return (int32_t)len;
+}
+
+int32_t send(uint8_t sn, uint8_t * buf, uint16_t len)
+{
+   posix_sock* s;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   CHECK_SOCKDATA();
+   return sock_send(sn, s, &buf, &len, 1, len);
+}
+
+int32_t sendv(uint8_t sn, wiz_IOVec * iov, uint8_t iovcnt)
+{
+   posix_sock* s;
+   uint8_t*  bufs[iovcnt ? iovcnt : 1];
+   uint16_t  lens[iovcnt ? iovcnt : 1];
+   uint32_t  total = 0;
+   uint8_t   i;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   for(i = 0; i < iovcnt; i++)
+   {
+      bufs[i] = iov[i].buf;
+      lens[i] = iov[i].len;
+      total += iov[i].len;
+   }
+   if(total == 0) return SOCKERR_DATALEN;
+   return sock_send(sn, s, bufs, lens, iovcnt, total);
+}
+
+int32_t recv(uint8_t sn, uint8_t * buf, uint16_t len)
+{
+   posix_sock* s;
+   int32_t ret;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   CHECK_SOCKDATA();
+   if(len > SOCK_RXMAX(s)) len = SOCK_RXMAX(s);
+   while(1)
+   {
+      if(s->sr != SOCK_ESTABLISHED && s->sr != SOCK_CLOSE_WAIT)
+      {
+         close(sn);
+         return SOCKERR_SOCKSTATUS;
+      }
+      ret = os_recv(s->fd, buf, len);
+      if(ret > 0) return ret;
+      if(ret != OS_AGAIN)
+      {
+         // The peer closed and everything is read.
+         close(sn);
+         return SOCKERR_SOCKSTATUS;
+      }
+      s->ev &= ~OS_EV_IN;
+      if(!SOCK_BLOCKING(s)) return SOCK_BUSY;
+      os_wait(s->fd, 0, -1);
+   }
+}
+
+/* recvpeek() and recvskip() never wait, as on WIZCHIP. */
+int32_t recvpeek(uint8_t sn, uint8_t * buf, uint16_t len, uint16_t offset)
+{
+   posix_sock* s;
+   int32_t ret;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   CHECK_SOCKDATA();
+   if(s->sr != SOCK_ESTABLISHED && s->sr != SOCK_CLOSE_WAIT) return SOCKERR_SOCKSTATUS;
+   if(offset >= SOCK_RXMAX(s)) return 0;
+   if(len > SOCK_RXMAX(s) - offset) len = SOCK_RXMAX(s) - offset;
+   ret = os_peek(s->fd, buf, len, offset);
+   return (ret > 0) ? ret : 0;
+}
+
+int32_t recvskip(uint8_t sn, uint16_t len)
+{
+   posix_sock* s;
+   uint8_t  scratch[256];
+   uint16_t done = 0;
+   int32_t  ret;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   CHECK_SOCKDATA();
+   if(s->sr != SOCK_ESTABLISHED && s->sr != SOCK_CLOSE_WAIT) return SOCKERR_SOCKSTATUS;
+   while(done < len)
+   {
+      ret = os_recv(s->fd, scratch, (len - done > sizeof(scratch)) ? sizeof(scratch) : len - done);
+      if(ret <= 0) break;
+      done += ret;
+   }
+   return done;
+}
+
+int32_t sendto(uint8_t sn, uint8_t * buf, uint16_t len, uint8_t * addr, uint16_t port)
+{
+   posix_sock* s;
+   uint32_t taddr;
+   int32_t  ret;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_UDP);
+   CHECK_SOCKDATA();
+   memcpy(&taddr, addr, 4);
+   if(taddr == 0) return SOCKERR_IPINVALID;
+   if(port == 0) return SOCKERR_PORTZERO;
+   if(s->sr != SOCK_UDP) return SOCKERR_SOCKSTATUS;
+   memcpy(s->dip, addr, 4);
+   s->dport = port;
+   if(len > SOCK_TXMAX(s)) len = SOCK_TXMAX(s);
+   while((ret = os_sendto(s->fd, buf, len, addr, port)) == OS_AGAIN)
+   {
+      if(!SOCK_BLOCKING(s)) return SOCK_BUSY;
+      os_wait(s->fd, 1, -1);
+   }
+   if(ret < 0)
+   {
+      s->ir |= Sn_IR_TIMEOUT;
+      return SOCKERR_TIMEOUT;
+   }
+   s->ir |= Sn_IR_SENDOK;
+   return (int32_t)len;
+}
+
+int32_t recvfrom(uint8_t sn, uint8_t * buf, uint16_t len, uint8_t * addr, uint16_t *port)
+{
+   posix_sock* s;
+   int32_t size;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_UDP);
+   CHECK_SOCKDATA();
+   if(s->remained == 0)
+   {
+      while((size = os_dgram_size(s->fd)) < 0)
+      {
+         s->ev &= ~OS_EV_IN;
+         if(s->sr != SOCK_UDP) return SOCKERR_SOCKCLOSED;
+         if(!SOCK_BLOCKING(s)) return SOCK_BUSY;
+         os_wait(s->fd, 0, -1);
+      }
+      s->packinfo = PACK_FIRST;
+      if(size <= len)
+      {
+         // The whole datagram fits, it is read straight into buf.
+         size = os_recvfrom(s->fd, buf, len, s->dip, &s->dport);
+         if(size < 0) size = 0;
+         memcpy(addr, s->dip, 4);
+         *port = s->dport;
+         s->packinfo = PACK_COMPLETED;
+         return size;
+      }
+      // Otherwise it is handed out piece by piece as WIZCHIP does.
+      if(!s->dgram && !(s->dgram = malloc(SOCK_DGRAM_MAX))) return SOCKERR_BUFFER;
+      size = os_recvfrom(s->fd, s->dgram, SOCK_DGRAM_MAX, s->dip, &s->dport);
+      if(size <= 0) return SOCK_BUSY;
+      s->remained = (uint16_t)size;
+      s->offset = 0;
+   }
+   memcpy(addr, s->dip, 4);
+   *port = s->dport;
+   if(len > s->remained) len = s->remained;
+   memcpy(buf, s->dgram + s->offset, len);
+   s->offset += len;
+   s->remained -= len;
+   if(s->remained != 0) s->packinfo |= PACK_REMAINED;
+   else s->packinfo = PACK_COMPLETED;
+   return (int32_t)len;
+}
+
+int8_t ctlsocket(uint8_t sn, ctlsock_type cstype, void* arg)
+{
+   posix_sock* s;
+
+   CHECK_SOCKNUM();
+   switch(cstype)
+   {
+      case CS_SET_IOMODE:
+         if(*(uint8_t*)arg != SOCK_IO_BLOCK && *(uint8_t*)arg != SOCK_IO_NONBLOCK) return SOCKERR_ARG;
+         s->iomode = *(uint8_t*)arg;
+         break;
+      case CS_GET_IOMODE:
+         *(uint8_t*)arg = s->iomode;
+         break;
+      case CS_GET_MAXTXBUF:
+         *(uint16_t*)arg = SOCK_TXMAX(s);
+         break;
+      case CS_GET_MAXRXBUF:
+         *(uint16_t*)arg = SOCK_RXMAX(s);
+         break;
+      case CS_CLR_INTERRUPT:
+         if(*(uint8_t*)arg > SIK_ALL) return SOCKERR_ARG;
+         s->ir &= ~(*(uint8_t*)arg);
+         break;
+      case CS_GET_INTERRUPT:
+         sock_update(s);
+         *(uint8_t*)arg = s->ir;
+         break;
+      case CS_SET_INTMASK:
+         if(*(uint8_t*)arg > SIK_ALL) return SOCKERR_ARG;
+         s->imr = *(uint8_t*)arg;
+         break;
+      case CS_GET_INTMASK:
+         *(uint8_t*)arg = s->imr;
+         break;
+      default:
+         return SOCKERR_ARG;
+   }
+   return SOCK_OK;
+}
+
+int8_t setsockopt(uint8_t sn, sockopt_type sotype, void* arg)
+{
+   posix_sock* s;
+
+   CHECK_SOCKNUM();
+   switch(sotype)
+   {
+      case SO_TTL:
+         s->ttl = *(uint8_t*)arg;
+         if(s->fd >= 0) os_set_ttl(s->fd, s->ttl);
+         break;
+      case SO_TOS:
+         s->tos = *(uint8_t*)arg;
+         if(s->fd >= 0) os_set_tos(s->fd, s->tos);
+         break;
+      case SO_MSS:
+         s->mss = *(uint16_t*)arg;
+         if(s->fd >= 0) os_set_mss(s->fd, s->mss);
+         break;
+      case SO_DESTIP:
+         memcpy(s->dip, arg, 4);
+         break;
+      case SO_DESTPORT:
+         s->dport = *(uint16_t*)arg;
+         break;
+      case SO_KEEPALIVESEND:
+         CHECK_SOCKMODE(Sn_MR_TCP);
+         if(s->kpalvtr != 0) return SOCKERR_SOCKOPT;
+         break;   // the kernel sends the keep-alive by itself
+      case SO_KEEPALIVEAUTO:
+         CHECK_SOCKMODE(Sn_MR_TCP);
+         s->kpalvtr = *(uint8_t*)arg;
+         if(s->fd >= 0) os_set_keepalive(s->fd, s->kpalvtr);
+         break;
+      default:
+         return SOCKERR_ARG;
+   }
+   return SOCK_OK;
+}
+
+int8_t getsockopt(uint8_t sn, sockopt_type sotype, void* arg)
+{
+   posix_sock* s;
+
+   CHECK_SOCKNUM();
+   switch(sotype)
+   {
+      case SO_FLAG:
+         *(uint8_t*)arg = s->mr & 0xF0;
+         break;
+      case SO_TTL:
+         *(uint8_t*)arg = s->ttl;
+         break;
+      case SO_TOS:
+         *(uint8_t*)arg = s->tos;
+         break;
+      case SO_MSS:
+         *(uint16_t*)arg = s->mss;
+         break;
+      case SO_DESTIP:
+         memcpy(arg, s->dip, 4);
+         break;
+      case SO_DESTPORT:
+         *(uint16_t*)arg = s->dport;
+         break;
+      case SO_KEEPALIVEAUTO:
+         CHECK_SOCKMODE(Sn_MR_TCP);
+         *(uint16_t*)arg = s->kpalvtr;
+         break;
+      case SO_SENDBUF:
+         *(uint16_t*)arg = sock_tx_fsr(s);
+         break;
+      case SO_RECVBUF:
+         *(uint16_t*)arg = sock_rx_rsr(s);
+         break;
+      case SO_STATUS:
+         sock_update(s);
+         *(uint8_t*)arg = s->sr;
+         break;
+      case SO_REMAINSIZE:
+         if(s->mr & Sn_MR_TCP) *(uint16_t*)arg = sock_rx_rsr(s);
+         else *(uint16_t*)arg = s->remained;
+         break;
+      case SO_PACKINFO:
+         if((s->mr & 0x0F) == Sn_MR_TCP) return SOCKERR_SOCKMODE;
+         *(uint8_t*)arg = s->packinfo;
+         break;
+      default:
+         return SOCKERR_SOCKOPT;
+   }
+   return SOCK_OK;
+}
+
+int16_t wizchip_posix_wait(uint8_t* sn, uint16_t max, int32_t timeout)
+{
+   uint16_t cnt;
+   uint8_t  h;
+   int16_t  n = 0;
+
+   if(!sock_tbl_ready) sock_tbl_init();
+   sock_loop->ev_waited = 1;
+   sock_events(sock_loop->ready_cnt ? 0 : (int)timeout);
+   // A socket reported stays queued while its interrupt is not cleared.
+   for(cnt = sock_loop->ready_cnt; cnt && (uint16_t)n < max; cnt--)
+   {
+      h = sock_ready_pop();
+      sock_update(&sock_tbl[h]);
+      if(sock_tbl[h].sr != SOCK_CLOSED && (sock_tbl[h].ir & sock_tbl[h].imr))
+      {
+         sn[n++] = h;
+         sock_ready_push(h);
+      }
+   }
+   return n;
+}
+
+int8_t wizchip_posix_attach(void)
+{
+   posix_loop* L;
+
+   if(!sock_tbl_ready) sock_tbl_init();
+   if(sock_loop != &sock_loop_main) return SOCK_OK;
+   L = aligned_alloc(SOCK_CACHE_LINE, sizeof(posix_loop));
+   if(!L) return SOCKERR_SOCKINIT;
+   if(loop_init(L) < 0)
+   {
+      free(L);
+      return SOCKERR_SOCKINIT;
+   }
+   sock_loop = L;
+   return SOCK_OK;
+}
+
+void wizchip_posix_detach(void)
+{
+   posix_loop* L = sock_loop;
+   uint16_t i;
+
+   if(L == &sock_loop_main) return;
+   for(i = 0; i < _WIZCHIP_SOCK_HANDLE_NUM_; i++)
+   {
+      if(L->listener[i].fd >= 0) os_close(L->listener[i].fd);
+   }
+   os_poller_close(L->ep);
+   free(L);
+   sock_loop = &sock_loop_main;
+}
+
+/*
+ * The register access of W5500/w5500.c. The Sn_ registers are those of the
+ * socket handle carried in the address, WIZCHIP_ADDR_HANDLE(). The TX/RX
+ * buffer blocks are not backed : the data goes through the socket APIs.
+ */
+static uint8_t sreg_read(posix_sock* s, uint16_t addr)
+{
+   uint16_t v = 0;
+
+   switch(addr)
+   {
+      case 0x00: return s->mr;
+      case 0x02: sock_update(s); return s->ir;
+      case 0x03: sock_update(s); return s->sr;
+      case 0x04: case 0x05: v = s->port; break;
+      case 0x06: case 0x07: case 0x08: case 0x09: case 0x0A: case 0x0B: return 0xFF;
+      case 0x0C: case 0x0D: case 0x0E: case 0x0F: return s->dip[addr - 0x0C];
+      case 0x10: case 0x11: v = s->dport; break;
+      case 0x12: case 0x13: v = s->mss; break;
+      case 0x15: return s->tos;
+      case 0x16: return s->ttl;
+      case 0x1E: return s->rxbuf;
+      case 0x1F: return s->txbuf;
+      case 0x20: case 0x21: v = sock_tx_fsr(s); break;
+      case 0x26: case 0x27: v = sock_rx_rsr(s); break;
+      case 0x2C: return s->imr;
+      case 0x2D: case 0x2E: v = 0x4000; break;
+      case 0x2F: return s->kpalvtr;
+      default:   return 0;
+   }
+   return (addr & 1) ? (uint8_t)v : (uint8_t)(v >> 8);
+}
+
+static void sreg_write16(uint16_t* reg, uint16_t addr, uint8_t wb)
+{
+   if(addr & 1) *reg = (*reg & 0xFF00) | wb;
+   else         *reg = (*reg & 0x00FF) | ((uint16_t)wb << 8);
+}
+
+static void sreg_write(posix_sock* s, uint16_t addr, uint8_t wb)
+{
+   switch(addr)
+   {
+      case 0x00: s->mr = wb; break;
+      case 0x02: s->ir &= ~wb; break;
+      case 0x04: case 0x05: sreg_write16(&s->port, addr, wb); break;
+      case 0x0C: case 0x0D: case 0x0E: case 0x0F: s->dip[addr - 0x0C] = wb; break;
+      case 0x10: case 0x11: sreg_write16(&s->dport, addr, wb); break;
+      case 0x12: case 0x13: sreg_write16(&s->mss, addr, wb); break;
+      case 0x15: s->tos = wb; break;
+      case 0x16: s->ttl = wb; break;
+      case 0x1E: if(wb && wb < 64) s->rxbuf = wb; break;
+      case 0x1F: if(wb && wb < 64) s->txbuf = wb; break;
+      case 0x2C: s->imr = wb; break;
+      case 0x2F: s->kpalvtr = wb; break;
+      default:   break;    // Sn_CR and the read only registers
+   }
+}
+
+uint8_t WIZCHIP_READ(uint32_t AddrSel)
+{
+   uint16_t addr = (uint16_t)(AddrSel >> 8);
+   uint8_t  bsb  = (uint8_t)((AddrSel >> 3) & 0x1F);
+   uint8_t  sir  = 0;
+   uint8_t  i;
+
+   if(!sock_tbl_ready) sock_tbl_init();
+   if(bsb == WIZCHIP_CREG_BLOCK)
+   {
+      if(addr >= sizeof(creg)) return 0;
+      if(addr == 0x17)   // SIR of the first 8 handles
+      {
+         for(i = 0; i < 8; i++)
+         {
+            sock_update(&sock_tbl[i]);
+            if(sock_tbl[i].ir & sock_tbl[i].imr) sir |= (1 << i);
+         }
+         return sir;
+      }
+      return creg[addr];
+   }
+   if(bsb == 1) return sreg_read(&sock_tbl[WIZCHIP_ADDR_HANDLE(AddrSel)], addr);
+   return 0;
+}
+
+void WIZCHIP_WRITE(uint32_t AddrSel, uint8_t wb)
+{
+   uint16_t addr = (uint16_t)(AddrSel >> 8);
+   uint8_t  bsb  = (uint8_t)((AddrSel >> 3) & 0x1F);
+
+   if(!sock_tbl_ready) sock_tbl_init();
+   if(bsb == WIZCHIP_CREG_BLOCK)
+   {
+      if(addr >= sizeof(creg)) return;
+      switch(addr)
+      {
+         case 0x00: if(wb & MR_RST) creg_reset(); else creg[0] = wb; break;
+         case 0x15: creg[addr] &= ~wb; break;                           // IR
+         case 0x17: case 0x39: break;                                   // SIR, VERSIONR
+         case 0x2E: creg[addr] = 0x80 | (wb & 0x78) | (creg[addr] & 0x07); break;   // PHYCFGR, the link stays up
+         default:   creg[addr] = wb; break;
+      }
+      return;
+   }
+   if(bsb == 1) sreg_write(&sock_tbl[WIZCHIP_ADDR_HANDLE(AddrSel)], addr, wb);
+}
+
+void WIZCHIP_READ_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
+{
+   uint16_t i;
+
+   for(i = 0; i < len; i++) pBuf[i] = WIZCHIP_READ(WIZCHIP_OFFSET_INC(AddrSel, i));
+}
+
+void WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
+{
+   uint16_t i;
+
+   for(i = 0; i < len; i++) WIZCHIP_WRITE(WIZCHIP_OFFSET_INC(AddrSel, i), pBuf[i]);
+}
+
+uint16_t getSn_TX_FSR(uint8_t sn)
+{
+   if(!sock_tbl_ready) sock_tbl_init();
+   return sock_tx_fsr(&sock_tbl[sn]);
+}
+
+uint16_t getSn_RX_RSR(uint8_t sn)
+{
+   if(!sock_tbl_ready) sock_tbl_init();
+   return sock_rx_rsr(&sock_tbl[sn]);
+}
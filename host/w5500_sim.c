@@ -0,0 +1,792 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "w5500_sim.h"
+
+/*
+    The register values are those of W5500/w5500.h, kept here because that
+    header clashes with <netinet/in.h> (IPPROTO_xxx).
+ */
+
+#define SIM_COMMON_SIZE     0x40
+#define SIM_SREG_SIZE       0x30
+#define SIM_BUF_MAX         (16 * 1024)
+
+// Common register offsets
+#define SIM_MR              0x00
+#define SIM_IR              0x15
+#define SIM_SIR             0x17
+#define SIM_RTR             0x19
+#define SIM_RCR             0x1B
+#define SIM_PHYCFGR         0x2E
+#define SIM_VERSIONR        0x39
+
+// Socket register offsets
+#define SIM_Sn_MR           0x00
+#define SIM_Sn_CR           0x01
+#define SIM_Sn_IR           0x02
+#define SIM_Sn_SR           0x03
+#define SIM_Sn_PORT         0x04
+#define SIM_Sn_DHAR         0x06
+#define SIM_Sn_DIPR         0x0C
+#define SIM_Sn_DPORT        0x10
+#define SIM_Sn_MSSR         0x12
+#define SIM_Sn_TTL          0x16
+#define SIM_Sn_RXBUF_SIZE   0x1E
+#define SIM_Sn_TXBUF_SIZE   0x1F
+#define SIM_Sn_TX_FSR       0x20
+#define SIM_Sn_TX_RD        0x22
+#define SIM_Sn_TX_WR        0x24
+#define SIM_Sn_RX_RSR       0x26
+#define SIM_Sn_RX_RD        0x28
+#define SIM_Sn_RX_WR        0x2A
+#define SIM_Sn_IMR          0x2C
+#define SIM_Sn_FRAG         0x2D
+
+// MR, Sn_MR, Sn_CR
+#define MR_RST              0x80
+#define Sn_MR_TCP           0x01
+#define Sn_MR_UDP           0x02
+#define Sn_MR_MACRAW        0x04
+#define Sn_MR_IPRAW         0x03
+
+#define Sn_CR_OPEN          0x01
+#define Sn_CR_LISTEN        0x02
+#define Sn_CR_CONNECT       0x04
+#define Sn_CR_DISCON        0x08
+#define Sn_CR_CLOSE         0x10
+#define Sn_CR_SEND          0x20
+#define Sn_CR_SEND_MAC      0x21
+#define Sn_CR_SEND_KEEP     0x22
+#define Sn_CR_RECV          0x40
+
+// Sn_IR
+#define Sn_IR_SENDOK        0x10
+#define Sn_IR_TIMEOUT       0x08
+#define Sn_IR_RECV          0x04
+#define Sn_IR_DISCON        0x02
+#define Sn_IR_CON           0x01
+
+// Sn_SR
+#define SOCK_CLOSED         0x00
+#define SOCK_INIT           0x13
+#define SOCK_LISTEN         0x14
+#define SOCK_SYNSENT        0x15
+#define SOCK_ESTABLISHED    0x17
+#define SOCK_CLOSE_WAIT     0x1C
+#define SOCK_UDP            0x22
+#define SOCK_IPRAW          0x32
+#define SOCK_MACRAW         0x42
+
+typedef struct {
+    uint8_t  reg[SIM_SREG_SIZE];    // plain registers
+    uint8_t  sr;                    // Sn_SR
+    uint8_t  ir;                    // Sn_IR
+    uint16_t tx_rd;                 // Sn_TX_RD, advanced as the data goes out
+    uint16_t tx_wr;                 // Sn_TX_WR written by host
+    uint16_t tx_wr_cmt;             // Sn_TX_WR committed by SEND
+    uint16_t rx_rd;                 // Sn_RX_RD written by host
+    uint16_t rx_rd_cmt;             // Sn_RX_RD committed by RECV
+    uint16_t rx_wr;                 // Sn_RX_WR
+    uint8_t  sending;               // SENDOK pending
+    uint8_t  settle;                // LISTEN just issued, report SOCK_LISTEN once
+    int      fd;                    // connection or UDP socket
+    int      lsn;                   // listener index while in SOCK_LISTEN
+    uint8_t  tx[SIM_BUF_MAX];
+    uint8_t  rx[SIM_BUF_MAX];
+} sim_sock;
+
+typedef struct {
+    uint16_t port;
+    int      fd;
+    int      refs;
+} sim_listener;
+
+static uint8_t          sim_common[SIM_COMMON_SIZE];
+static sim_sock         sim_socks[W5500_SIM_SOCK_NUM];
+static sim_listener     sim_listeners[W5500_SIM_SOCK_NUM];
+static w5500_sim_stats  sim_stats;
+static uint16_t         sim_port_offset;
+
+// SPI frame being decoded
+static uint8_t  frame_phase;        // 0 ~ 2 : address/control phase, 3 : data phase
+static uint16_t frame_addr;
+static uint8_t  frame_bsb;
+static uint8_t  frame_write;
+static uint8_t  frame_op;
+
+static uint8_t  sim_buf[SIM_BUF_MAX];
+
+/* ---------------------------------------------------------------- helpers */
+
+static uint16_t get16(const uint8_t *p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static uint16_t sock_txsize(sim_sock *s) {
+    uint8_t kb = s->reg[SIM_Sn_TXBUF_SIZE];
+    return (kb > 16) ? SIM_BUF_MAX : (uint16_t)kb * 1024;
+}
+
+static uint16_t sock_rxsize(sim_sock *s) {
+    uint8_t kb = s->reg[SIM_Sn_RXBUF_SIZE];
+    return (kb > 16) ? SIM_BUF_MAX : (uint16_t)kb * 1024;
+}
+
+static uint16_t sock_fsr(sim_sock *s) {
+    return sock_txsize(s) - (uint16_t)(s->tx_wr_cmt - s->tx_rd);
+}
+
+static uint16_t sock_rsr(sim_sock *s) {
+    return (uint16_t)(s->rx_wr - s->rx_rd_cmt);
+}
+
+static int set_nonblock(int fd) {
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static void sock_addr(sim_sock *s, struct sockaddr_in *sa) {
+    memset(sa, 0, sizeof(*sa));
+    sa->sin_family = AF_INET;
+    memcpy(&sa->sin_addr.s_addr, &s->reg[SIM_Sn_DIPR], 4);
+    sa->sin_port = htons(get16(&s->reg[SIM_Sn_DPORT]));
+}
+
+static void sock_set_peer(sim_sock *s, struct sockaddr_in *sa) {
+    memcpy(&s->reg[SIM_Sn_DIPR], &sa->sin_addr.s_addr, 4);
+    put16(&s->reg[SIM_Sn_DPORT], ntohs(sa->sin_port));
+}
+
+static int bind_port(int fd, uint16_t port) {
+    struct sockaddr_in sa;
+    int on = 1;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    sa.sin_port = htons((uint16_t)(port + sim_port_offset));
+    return bind(fd, (struct sockaddr *)&sa, sizeof(sa));
+}
+
+/* -------------------------------------------------------------- listeners */
+
+/*
+    Hardware sockets listening on the same port share one Linux listener. It
+    stays bound when no socket listens, so the clients connecting meanwhile
+    wait in its backlog instead of being refused.
+ */
+static int listener_get(uint16_t port) {
+    int i, free_idx = -1, fd;
+
+    for (i = 0; i < W5500_SIM_SOCK_NUM; i++) {
+        if (sim_listeners[i].fd >= 0 && sim_listeners[i].port == port) {
+            sim_listeners[i].refs++;
+            return i;
+        }
+    }
+    for (i = 0; i < W5500_SIM_SOCK_NUM; i++) {
+        if (sim_listeners[i].fd < 0) {
+            free_idx = i;
+            break;
+        }
+        if (!sim_listeners[i].refs && free_idx < 0) free_idx = i;
+    }
+    if (free_idx < 0) return -1;
+    if (sim_listeners[free_idx].fd >= 0) close(sim_listeners[free_idx].fd);
+    sim_listeners[free_idx].fd = -1;
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (bind_port(fd, port) < 0 || listen(fd, 16) < 0) {
+        fprintf(stderr, "w5500_sim: listen on %u: %s\n", port + sim_port_offset, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    set_nonblock(fd);
+    sim_listeners[free_idx].port = port;
+    sim_listeners[free_idx].fd = fd;
+    sim_listeners[free_idx].refs = 1;
+    return free_idx;
+}
+
+static void listener_put(int idx) {
+    if (idx >= 0 && sim_listeners[idx].refs) sim_listeners[idx].refs--;
+}
+
+/* ---------------------------------------------------------------- sockets */
+
+static void sock_release(sim_sock *s) {
+    if (s->sr == SOCK_LISTEN) listener_put(s->lsn);
+    s->lsn = -1;
+    if (s->fd >= 0) close(s->fd);
+    s->fd = -1;
+    s->sending = 0;
+}
+
+static void sock_reset(sim_sock *s) {
+    sock_release(s);
+    memset(s->reg, 0, sizeof(s->reg));
+    memset(&s->reg[SIM_Sn_DHAR], 0xFF, 6);
+    put16(&s->reg[SIM_Sn_MSSR], 0x0000);
+    s->reg[SIM_Sn_TTL] = 0x80;
+    s->reg[SIM_Sn_RXBUF_SIZE] = 2;
+    s->reg[SIM_Sn_TXBUF_SIZE] = 2;
+    s->reg[SIM_Sn_IMR] = 0xFF;
+    put16(&s->reg[SIM_Sn_FRAG], 0x4000);
+    s->sr = SOCK_CLOSED;
+    s->ir = 0;
+    s->tx_rd = s->tx_wr = s->tx_wr_cmt = 0;
+    s->rx_rd = s->rx_rd_cmt = s->rx_wr = 0;
+}
+
+static void sock_lost(sim_sock *s, uint8_t ir) {
+    sock_release(s);
+    s->sr = SOCK_CLOSED;
+    s->ir |= ir;
+}
+
+// Copy the received bytes into the RX ring at Sn_RX_WR.
+static void rx_put(sim_sock *s, const uint8_t *data, uint16_t len) {
+    uint16_t mask = sock_rxsize(s) - 1;
+    uint16_t i;
+
+    for (i = 0; i < len; i++) {
+        s->rx[(uint16_t)(s->rx_wr + i) & mask] = data[i];
+    }
+    s->rx_wr += len;
+}
+
+static void tcp_flush(sim_sock *s) {
+    uint16_t mask = sock_txsize(s) - 1;
+    uint16_t pending, off, chunk;
+    ssize_t ret;
+
+    while ((pending = (uint16_t)(s->tx_wr_cmt - s->tx_rd)) != 0) {
+        off = s->tx_rd & mask;
+        chunk = (uint16_t)(mask + 1 - off);
+        if (chunk > pending) chunk = pending;
+        ret = send(s->fd, &s->tx[off], chunk, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            sock_lost(s, Sn_IR_DISCON);
+            return;
+        }
+        s->tx_rd += (uint16_t)ret;
+        sim_stats.tx_payload += (uint32_t)ret;
+    }
+    if (s->sending) {
+        s->sending = 0;
+        s->ir |= Sn_IR_SENDOK;
+    }
+}
+
+static void tcp_receive(sim_sock *s) {
+    uint16_t space = sock_rxsize(s) - sock_rsr(s);
+    ssize_t ret;
+
+    if (space == 0) return;
+    ret = recv(s->fd, sim_buf, space, 0);
+    if (ret > 0) {
+        rx_put(s, sim_buf, (uint16_t)ret);
+        s->ir |= Sn_IR_RECV;
+        sim_stats.rx_payload += (uint32_t)ret;
+    } else if (ret == 0) {
+        s->sr = SOCK_CLOSE_WAIT;
+        s->ir |= Sn_IR_DISCON;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        sock_lost(s, Sn_IR_DISCON);
+    }
+}
+
+static void udp_receive(sim_sock *s) {
+    struct sockaddr_in sa;
+    socklen_t salen;
+    uint8_t head[8];
+    ssize_t len;
+
+    for (;;) {
+        // The datagram goes in only as a whole, with its 8-byte header.
+        len = recv(s->fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+        if (len < 0) return;
+        if ((uint32_t)len + 8 > (uint32_t)(sock_rxsize(s) - sock_rsr(s))) return;
+        salen = sizeof(sa);
+        len = recvfrom(s->fd, sim_buf, sizeof(sim_buf), 0, (struct sockaddr *)&sa, &salen);
+        if (len < 0) return;
+        memcpy(head, &sa.sin_addr.s_addr, 4);
+        put16(&head[4], ntohs(sa.sin_port));
+        put16(&head[6], (uint16_t)len);
+        rx_put(s, head, 8);
+        rx_put(s, sim_buf, (uint16_t)len);
+        s->ir |= Sn_IR_RECV;
+        sim_stats.rx_payload += (uint32_t)len;
+    }
+}
+
+// Make the network progress of a socket.
+static void sock_poll(sim_sock *s) {
+    struct sockaddr_in sa;
+    socklen_t salen = sizeof(sa);
+    struct pollfd pfd;
+    int fd, err;
+
+    switch (s->sr) {
+        case SOCK_LISTEN:
+            // listen() checks SOCK_LISTEN after the command, a backlogged
+            // client would make it ESTABLISHED before the check.
+            if (s->settle) {
+                s->settle = 0;
+                break;
+            }
+            if (s->lsn < 0) break;
+            fd = accept4(sim_listeners[s->lsn].fd, (struct sockaddr *)&sa, &salen, SOCK_NONBLOCK);
+            if (fd < 0) break;
+            listener_put(s->lsn);
+            s->lsn = -1;
+            s->fd = fd;
+            sock_set_peer(s, &sa);
+            s->sr = SOCK_ESTABLISHED;
+            s->ir |= Sn_IR_CON;
+            break;
+        case SOCK_SYNSENT:
+            pfd.fd = s->fd;
+            pfd.events = POLLOUT;
+            if (poll(&pfd, 1, 0) <= 0) break;
+            salen = sizeof(err);
+            if (getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &err, &salen) < 0 || err) {
+                sock_lost(s, Sn_IR_TIMEOUT);
+                break;
+            }
+            s->sr = SOCK_ESTABLISHED;
+            s->ir |= Sn_IR_CON;
+            break;
+        case SOCK_ESTABLISHED:
+            tcp_flush(s);
+            if (s->sr == SOCK_ESTABLISHED) tcp_receive(s);
+            break;
+        case SOCK_CLOSE_WAIT:
+            tcp_flush(s);
+            break;
+        case SOCK_UDP:
+            udp_receive(s);
+            break;
+        default:
+            break;
+    }
+}
+
+static void cmd_open(sim_sock *s) {
+    uint8_t mode = s->reg[SIM_Sn_MR] & 0x0F;
+    int on = 1;
+
+    sock_release(s);
+    s->tx_rd = s->tx_wr = s->tx_wr_cmt = 0;
+    s->rx_rd = s->rx_rd_cmt = s->rx_wr = 0;
+    switch (mode) {
+        case Sn_MR_TCP:
+            s->sr = SOCK_INIT;
+            break;
+        case Sn_MR_UDP:
+            s->fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (s->fd < 0 || bind_port(s->fd, get16(&s->reg[SIM_Sn_PORT])) < 0) {
+                fprintf(stderr, "w5500_sim: udp port %u: %s\n",
+                        get16(&s->reg[SIM_Sn_PORT]) + sim_port_offset, strerror(errno));
+            }
+            if (s->fd >= 0) {
+                setsockopt(s->fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+                set_nonblock(s->fd);
+            }
+            s->sr = SOCK_UDP;
+            break;
+        case Sn_MR_MACRAW:
+            s->sr = SOCK_MACRAW;    // no frame I/O in the model
+            break;
+        case Sn_MR_IPRAW:
+            s->sr = SOCK_IPRAW;     // no packet I/O in the model
+            break;
+        default:
+            s->sr = SOCK_CLOSED;
+            break;
+    }
+}
+
+static void cmd_connect(sim_sock *s) {
+    struct sockaddr_in sa;
+
+    if (s->sr != SOCK_INIT) return;
+    s->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s->fd < 0) {
+        sock_lost(s, Sn_IR_TIMEOUT);
+        return;
+    }
+    bind_port(s->fd, get16(&s->reg[SIM_Sn_PORT]));
+    set_nonblock(s->fd);
+    sock_addr(s, &sa);
+    if (connect(s->fd, (struct sockaddr *)&sa, sizeof(sa)) == 0) {
+        s->sr = SOCK_ESTABLISHED;
+        s->ir |= Sn_IR_CON;
+    } else if (errno == EINPROGRESS) {
+        s->sr = SOCK_SYNSENT;
+    } else {
+        sock_lost(s, Sn_IR_TIMEOUT);
+    }
+}
+
+static void cmd_send(sim_sock *s) {
+    struct sockaddr_in sa;
+    uint16_t mask = sock_txsize(s) - 1;
+    uint16_t len, i;
+
+    s->tx_wr_cmt = s->tx_wr;
+    if (s->sr == SOCK_ESTABLISHED || s->sr == SOCK_CLOSE_WAIT) {
+        s->sending = 1;
+        tcp_flush(s);
+    } else if (s->sr == SOCK_UDP) {
+        len = (uint16_t)(s->tx_wr_cmt - s->tx_rd);
+        for (i = 0; i < len; i++) {
+            sim_buf[i] = s->tx[(uint16_t)(s->tx_rd + i) & mask];
+        }
+        s->tx_rd = s->tx_wr_cmt;
+        sock_addr(s, &sa);
+        if (s->fd < 0 || sa.sin_addr.s_addr == 0 || sa.sin_port == 0 ||
+            sendto(s->fd, sim_buf, len, 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+            s->ir |= Sn_IR_TIMEOUT;
+        } else {
+            s->ir |= Sn_IR_SENDOK;
+            sim_stats.tx_payload += len;
+        }
+    } else {
+        s->tx_rd = s->tx_wr_cmt;    // dropped, no network I/O in this mode
+        s->ir |= Sn_IR_SENDOK;
+    }
+}
+
+static void sock_command(sim_sock *s, uint8_t cmd) {
+    switch (cmd) {
+        case Sn_CR_OPEN:
+            sim_stats.cmds[0]++;
+            cmd_open(s);
+            break;
+        case Sn_CR_LISTEN:
+            sim_stats.cmds[1]++;
+            if (s->sr != SOCK_INIT) break;
+            s->lsn = listener_get(get16(&s->reg[SIM_Sn_PORT]));
+            s->sr = (s->lsn < 0) ? SOCK_CLOSED : SOCK_LISTEN;
+            s->settle = 1;
+            break;
+        case Sn_CR_CONNECT:
+            sim_stats.cmds[2]++;
+            cmd_connect(s);
+            break;
+        case Sn_CR_DISCON:
+            sim_stats.cmds[3]++;
+            if (s->fd >= 0) tcp_flush(s);
+            sock_lost(s, Sn_IR_DISCON);
+            break;
+        case Sn_CR_CLOSE:
+            sim_stats.cmds[4]++;
+            sock_release(s);
+            s->sr = SOCK_CLOSED;
+            break;
+        case Sn_CR_SEND:
+        case Sn_CR_SEND_MAC:
+            sim_stats.cmds[5]++;
+            cmd_send(s);
+            break;
+        case Sn_CR_SEND_KEEP:
+            break;
+        case Sn_CR_RECV:
+            sim_stats.cmds[6]++;
+            s->rx_rd_cmt = s->rx_rd;
+            break;
+        default:
+            break;
+    }
+}
+
+/* -------------------------------------------------------------- registers */
+
+static void common_reset(void) {
+    int i;
+
+    memset(sim_common, 0, sizeof(sim_common));
+    put16(&sim_common[SIM_RTR], 0x07D0);
+    sim_common[SIM_RCR] = 0x08;
+    sim_common[SIM_PHYCFGR] = 0xBF;     // auto-negotiation, 100M full duplex, link up
+    sim_common[SIM_VERSIONR] = 0x04;
+    for (i = 0; i < W5500_SIM_SOCK_NUM; i++) {
+        sock_reset(&sim_socks[i]);
+    }
+}
+
+static uint8_t common_read(uint16_t addr) {
+    uint8_t sir = 0;
+    int i;
+
+    if (addr >= SIM_COMMON_SIZE) return 0;
+    if (addr == SIM_SIR) {
+        for (i = 0; i < W5500_SIM_SOCK_NUM; i++) {
+            sock_poll(&sim_socks[i]);
+            if (sim_socks[i].ir & sim_socks[i].reg[SIM_Sn_IMR]) sir |= (uint8_t)(1 << i);
+        }
+        return sir;
+    }
+    return sim_common[addr];
+}
+
+static void common_write(uint16_t addr, uint8_t val) {
+    if (addr >= SIM_COMMON_SIZE) return;
+    switch (addr) {
+        case SIM_MR:
+            if (val & MR_RST) common_reset();
+            else sim_common[SIM_MR] = val;
+            break;
+        case SIM_IR:
+            sim_common[SIM_IR] &= (uint8_t)~val;
+            break;
+        case SIM_SIR:
+        case SIM_VERSIONR:
+            break;
+        case SIM_PHYCFGR:
+            sim_common[SIM_PHYCFGR] = (uint8_t)((val & 0xF8) | 0x80 | (sim_common[SIM_PHYCFGR] & 0x07));
+            break;
+        default:
+            sim_common[addr] = val;
+            break;
+    }
+}
+
+static uint8_t sreg_read(sim_sock *s, uint16_t addr) {
+    uint8_t v[2];
+
+    if (addr >= SIM_SREG_SIZE) return 0;
+    switch (addr) {
+        case SIM_Sn_CR:
+            return 0;       // the commands complete at once
+        case SIM_Sn_IR:
+            sock_poll(s);
+            return s->ir;
+        case SIM_Sn_SR:
+            sock_poll(s);
+            return s->sr;
+        case SIM_Sn_TX_FSR:
+            sock_poll(s);
+            /* fall through */
+        case SIM_Sn_TX_FSR + 1:
+            put16(v, sock_fsr(s));
+            break;
+        case SIM_Sn_TX_RD:
+        case SIM_Sn_TX_RD + 1:
+            put16(v, s->tx_rd);
+            break;
+        case SIM_Sn_TX_WR:
+        case SIM_Sn_TX_WR + 1:
+            put16(v, s->tx_wr);
+            break;
+        case SIM_Sn_RX_RSR:
+            sock_poll(s);
+            /* fall through */
+        case SIM_Sn_RX_RSR + 1:
+            put16(v, sock_rsr(s));
+            break;
+        case SIM_Sn_RX_RD:
+        case SIM_Sn_RX_RD + 1:
+            put16(v, s->rx_rd);
+            break;
+        case SIM_Sn_RX_WR:
+        case SIM_Sn_RX_WR + 1:
+            put16(v, s->rx_wr);
+            break;
+        default:
+            return s->reg[addr];
+    }
+    return v[addr & 1];
+}
+
+static void set16_byte(uint16_t *reg, uint16_t addr, uint8_t val) {
+    if (addr & 1) *reg = (uint16_t)((*reg & 0xFF00) | val);
+    else          *reg = (uint16_t)((*reg & 0x00FF) | ((uint16_t)val << 8));
+}
+
+static void sreg_write(sim_sock *s, uint16_t addr, uint8_t val) {
+    if (addr >= SIM_SREG_SIZE) return;
+    switch (addr) {
+        case SIM_Sn_CR:
+            sock_command(s, val);
+            break;
+        case SIM_Sn_IR:
+            s->ir &= (uint8_t)~val;
+            break;
+        case SIM_Sn_TX_WR:
+        case SIM_Sn_TX_WR + 1:
+            set16_byte(&s->tx_wr, addr, val);
+            break;
+        case SIM_Sn_RX_RD:
+        case SIM_Sn_RX_RD + 1:
+            set16_byte(&s->rx_rd, addr, val);
+            break;
+        case SIM_Sn_SR:
+        case SIM_Sn_TX_FSR:
+        case SIM_Sn_TX_FSR + 1:
+        case SIM_Sn_TX_RD:
+        case SIM_Sn_TX_RD + 1:
+        case SIM_Sn_RX_RSR:
+        case SIM_Sn_RX_RSR + 1:
+        case SIM_Sn_RX_WR:
+        case SIM_Sn_RX_WR + 1:
+            break;  // read only
+        default:
+            s->reg[addr] = val;
+            break;
+    }
+}
+
+static uint8_t block_read(uint8_t bsb, uint16_t addr) {
+    sim_sock *s;
+
+    if (bsb == 0) return common_read(addr);
+    if ((bsb >> 2) >= W5500_SIM_SOCK_NUM) return 0;
+    s = &sim_socks[bsb >> 2];
+    switch (bsb & 0x03) {
+        case 1: return sreg_read(s, addr);
+        case 2: return sock_txsize(s) ? s->tx[addr & (sock_txsize(s) - 1)] : 0;
+        case 3: return sock_rxsize(s) ? s->rx[addr & (sock_rxsize(s) - 1)] : 0;
+        default: return 0;
+    }
+}
+
+static void block_write(uint8_t bsb, uint16_t addr, uint8_t val) {
+    sim_sock *s;
+
+    if (bsb == 0) {
+        common_write(addr, val);
+        return;
+    }
+    if ((bsb >> 2) >= W5500_SIM_SOCK_NUM) return;
+    s = &sim_socks[bsb >> 2];
+    switch (bsb & 0x03) {
+        case 1: sreg_write(s, addr, val); break;
+        case 2: if (sock_txsize(s)) s->tx[addr & (sock_txsize(s) - 1)] = val; break;
+        case 3: if (sock_rxsize(s)) s->rx[addr & (sock_rxsize(s) - 1)] = val; break;
+        default: break;
+    }
+}
+
+/* -------------------------------------------------------------- SPI frame */
+
+void w5500_sim_init(void) {
+    const char *env = getenv("W5500_SIM_PORT_OFFSET");
+    int i;
+
+    sim_port_offset = env ? (uint16_t)atoi(env) : 0;
+    for (i = 0; i < W5500_SIM_SOCK_NUM; i++) {
+        sim_socks[i].fd = -1;
+        sim_socks[i].lsn = -1;
+        sim_listeners[i].fd = -1;
+    }
+    common_reset();
+    w5500_sim_clear_stats();
+}
+
+void w5500_sim_cs_select(void) {
+    frame_phase = 0;
+}
+
+void w5500_sim_cs_deselect(void) {
+    frame_phase = 0;
+}
+
+// Counts the byte of the frame. Returns 1 if it is a data byte.
+static int frame_byte(uint8_t wb) {
+    if (frame_phase < 3) {
+        if (frame_phase == 0) frame_addr = (uint16_t)wb << 8;
+        else if (frame_phase == 1) frame_addr |= wb;
+        else {
+            frame_bsb = wb >> 3;
+            frame_write = (wb >> 2) & 0x01;
+            // common, socket register, TX buffer, RX buffer
+            frame_op = (uint8_t)(((frame_bsb == 0) ? 0 : (frame_bsb & 0x03)) * 2 + frame_write);
+            sim_stats.frames[frame_op]++;
+            sim_stats.bytes[frame_op] += 3;
+        }
+        frame_phase++;
+        return 0;
+    }
+    sim_stats.bytes[frame_op]++;
+    return 1;
+}
+
+uint8_t w5500_sim_spi_readbyte(void) {
+    if (!frame_byte(0x00) || frame_write) return 0;
+    return block_read(frame_bsb, frame_addr++);
+}
+
+void w5500_sim_spi_writebyte(uint8_t wb) {
+    if (frame_byte(wb) && frame_write) block_write(frame_bsb, frame_addr++, wb);
+}
+
+void w5500_sim_spi_readburst(uint8_t *pBuf, uint16_t len) {
+    while (len--) {
+        *pBuf++ = w5500_sim_spi_readbyte();
+    }
+}
+
+void w5500_sim_spi_writeburst(uint8_t *pBuf, uint16_t len) {
+    while (len--) {
+        w5500_sim_spi_writebyte(*pBuf++);
+    }
+}
+
+/* ------------------------------------------------------------- statistics */
+
+void w5500_sim_get_stats(w5500_sim_stats *stats) {
+    *stats = sim_stats;
+}
+
+void w5500_sim_clear_stats(void) {
+    memset(&sim_stats, 0, sizeof(sim_stats));
+}
+
+void w5500_sim_print_stats(FILE *fp) {
+    static const char *op_name[W5500_SIM_OP_NUM] = {
+        "common read", "common write", "socket reg read", "socket reg write",
+        "TX buf read", "TX buf write", "RX buf read", "RX buf write"
+    };
+    static const char *cmd_name[W5500_SIM_CMD_NUM] = {
+        "OPEN", "LISTEN", "CONNECT", "DISCON", "CLOSE", "SEND", "RECV"
+    };
+    uint32_t frames = 0, bytes = 0;
+    int i;
+
+    fprintf(fp, "%-18s %10s %12s %10s\n", "SPI operation", "frames", "bytes", "bytes/frm");
+    for (i = 0; i < W5500_SIM_OP_NUM; i++) {
+        frames += sim_stats.frames[i];
+        bytes += sim_stats.bytes[i];
+        if (!sim_stats.frames[i]) continue;
+        fprintf(fp, "%-18s %10u %12u %10.1f\n", op_name[i], sim_stats.frames[i], sim_stats.bytes[i],
+                (double)sim_stats.bytes[i] / sim_stats.frames[i]);
+    }
+    fprintf(fp, "%-18s %10u %12u\n", "total", frames, bytes);
+    for (i = 0; i < W5500_SIM_CMD_NUM; i++) {
+        fprintf(fp, "%s %u%s", cmd_name[i], sim_stats.cmds[i], (i == W5500_SIM_CMD_NUM - 1) ? "\n" : ", ");
+    }
+    fprintf(fp, "payload tx %u, rx %u bytes", sim_stats.tx_payload, sim_stats.rx_payload);
+    if (sim_stats.tx_payload + sim_stats.rx_payload) {
+        fprintf(fp, ", %.2f SPI bytes per payload byte",
+                (double)bytes / (sim_stats.tx_payload + sim_stats.rx_payload));
+    }
+    fprintf(fp, "\n");
+}
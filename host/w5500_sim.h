@@ -0,0 +1,61 @@
+#ifndef _W5500_SIM_H_
+#define _W5500_SIM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+    Register-level W5500 model for the host build.
+
+    The model sits behind the reg_wizchip_cs_cbfunc(), reg_wizchip_spi_cbfunc()
+    and reg_wizchip_spiburst_cbfunc() callbacks. It decodes the 3-byte
+    address/control phase of each SPI frame, emulates the common and socket
+    register blocks with the TX/RX buffers, and maps the hardware sockets onto
+    non-blocking Linux TCP/UDP sockets, so socket.c and w5500.c run unmodified.
+
+    Network progress of a socket is made when the driver reads its Sn_SR,
+    Sn_IR, Sn_TX_FSR or Sn_RX_RSR, or the common SIR, as the polling loops do.
+
+    Environment:
+    W5500_SIM_PORT_OFFSET   added to the local port of every socket (ex> 10000 serves 502 on 10502)
+ */
+
+#define W5500_SIM_SOCK_NUM      8
+
+// SPI frame classes, [block][read/write]
+#define W5500_SIM_COMMON_READ   0
+#define W5500_SIM_COMMON_WRITE  1
+#define W5500_SIM_SREG_READ     2
+#define W5500_SIM_SREG_WRITE    3
+#define W5500_SIM_TXBUF_READ    4
+#define W5500_SIM_TXBUF_WRITE   5
+#define W5500_SIM_RXBUF_READ    6
+#define W5500_SIM_RXBUF_WRITE   7
+#define W5500_SIM_OP_NUM        8
+
+// Sn_CR commands counted, in order of their bit
+#define W5500_SIM_CMD_NUM       7   // OPEN, LISTEN, CONNECT, DISCON, CLOSE, SEND, RECV
+
+typedef struct {
+    uint32_t frames[W5500_SIM_OP_NUM];  // SPI frames, CS low to high
+    uint32_t bytes[W5500_SIM_OP_NUM];   // SPI bytes including the 3-byte address/control phase
+    uint32_t cmds[W5500_SIM_CMD_NUM];   // Sn_CR commands issued
+    uint32_t tx_payload;                // bytes sent to the network
+    uint32_t rx_payload;                // bytes received from the network
+} w5500_sim_stats;
+
+void    w5500_sim_init(void);
+
+// Callbacks for reg_wizchip_xxx_cbfunc()
+void    w5500_sim_cs_select(void);
+void    w5500_sim_cs_deselect(void);
+uint8_t w5500_sim_spi_readbyte(void);
+void    w5500_sim_spi_writebyte(uint8_t wb);
+void    w5500_sim_spi_readburst(uint8_t *pBuf, uint16_t len);
+void    w5500_sim_spi_writeburst(uint8_t *pBuf, uint16_t len);
+
+void    w5500_sim_get_stats(w5500_sim_stats *stats);
+void    w5500_sim_clear_stats(void);
+void    w5500_sim_print_stats(FILE *fp);
+
+#endif
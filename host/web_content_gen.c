@@ -0,0 +1,214 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ftw.h>
+
+/*
+    Build-time generator of the web content table of httpServer.c.
+
+    Every file under the root directory becomes an entry named by its path
+    below the root, e.g. "css/style.css", with its exact length, so binary
+    files are served whole. The entries are sorted by name for the binary
+    search of find_userReg_webContent(). On AVR the names, the data and the
+    table itself are in program memory (WEB_CONTENT_MEM). Hidden files are
+    left out.
+
+    The text files (html, css, js, json, xml, svg, txt) are compressed with
+    gzip -9 into a second entry named "<name>.gz" when that is smaller. The
+    server sends it as it is, with Content-Encoding: gzip, to the clients
+    which accept it. With -z the uncompressed data of those files is left
+    out to save flash; clients without gzip then get 406.
+
+    Each entry carries a strong entity tag, the FNV-1a hash of its data,
+    for the ETag / If-None-Match conditional GET of the server.
+
+    The application registers the table with
+        reg_httpServer_webContent(web_content_table, web_content_table_cnt);
+
+    usage: web_content_gen [-z] <root> > web_content.c
+ */
+
+#define GEN_MAX_FILES   256
+#define GEN_MAX_NAME    128     // MAX_CONTENT_NAME_LEN of httpServer.h
+
+typedef struct {
+    char*    name;
+    uint8_t* data;
+    long     len;
+} gen_entry;
+
+static gen_entry entries[GEN_MAX_FILES];
+static int       count;
+static size_t    root_len;
+
+static const char* gzip_types[] = {".htm", ".html", ".css", ".js", ".json", ".xml", ".svg", ".txt", 0};
+
+static int collect(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+    const char* name = path + root_len;
+
+    (void)st;
+    (void)ftw;
+    if(type != FTW_F) return 0;
+    while(*name == '/') name++;
+    // Hidden files and the content of hidden directories are left out
+    if(name[0] == '.' || strstr(name, "/.")) return 0;
+    // The room for ".gz" is kept
+    if(strlen(name) + 3 >= GEN_MAX_NAME) {
+        fprintf(stderr, "%s: name longer than %d\n", path, GEN_MAX_NAME - 4);
+        return 1;
+    }
+    if(count == GEN_MAX_FILES) {
+        fprintf(stderr, "more than %d files\n", GEN_MAX_FILES);
+        return 1;
+    }
+    entries[count++].name = strdup(name);
+    return 0;
+}
+
+// FNV-1a of the data; 0 stands for "no tag" in the server, so it is never given.
+static uint32_t etag_of(const gen_entry* e) {
+    uint32_t h = 2166136261u;
+    long i;
+
+    for(i = 0; i < e->len; i++) h = (h ^ e->data[i]) * 16777619u;
+    return h ? h : 1;
+}
+
+static int by_name(const void* a, const void* b) {
+    return strcmp(((const gen_entry*)a)->name, ((const gen_entry*)b)->name);
+}
+
+// Reads a whole file or the output of a command, gives its length or -1.
+static long slurp(FILE* f, uint8_t** data) {
+    long len = 0, size = 4096;
+    size_t n;
+
+    *data = malloc(size);
+    while((n = fread(*data + len, 1, size - len, f)) > 0) {
+        len += n;
+        if(len == size) *data = realloc(*data, size *= 2);
+    }
+    return ferror(f) ? -1 : len;
+}
+
+static int read_entry(const char* root, gen_entry* e) {
+    char path[4096];
+    FILE* f;
+
+    snprintf(path, sizeof(path), "%s/%s", root, e->name);
+    if(!(f = fopen(path, "rb")) || (e->len = slurp(f, &e->data)) < 0) {
+        perror(path);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+static int is_text(const char* name) {
+    const char* ext = strrchr(name, '.');
+    int i;
+
+    if(!ext) return 0;
+    for(i = 0; gzip_types[i]; i++)
+        if(!strcmp(ext, gzip_types[i])) return 1;
+    return 0;
+}
+
+// Compresses the file of e into gz with gzip -9 -n, gives -1 when gzip fails.
+static int gzip_entry(const char* root, const gen_entry* e, gen_entry* gz) {
+    char cmd[8192];
+    char* p = cmd;
+    const char* c;
+    FILE* f;
+
+    // The path is quoted for the shell
+    p += sprintf(p, "gzip -9 -n -c '");
+    for(c = root; *c; c++) {
+        if(*c == '\'') p += sprintf(p, "'\\''");
+        else *p++ = *c;
+    }
+    *p++ = '/';
+    for(c = e->name; *c; c++) {
+        if(*c == '\'') p += sprintf(p, "'\\''");
+        else *p++ = *c;
+    }
+    strcpy(p, "'");
+    if(!(f = popen(cmd, "r")) || (gz->len = slurp(f, &gz->data)) < 0 || pclose(f) != 0) {
+        fprintf(stderr, "%s: gzip failed\n", e->name);
+        return -1;
+    }
+    gz->name = malloc(strlen(e->name) + 4);
+    sprintf(gz->name, "%s.gz", e->name);
+    return 0;
+}
+
+// Prints s as a C string literal: quotes and backslashes escaped, the control and non-ASCII bytes in octal.
+static void emit_string(const char* s) {
+    putchar('"');
+    for(; *s; s++) {
+        if(*s == '"' || *s == '\\') printf("\\%c", *s);
+        else if((unsigned char)*s < ' ' || (unsigned char)*s >= 0x7f) printf("\\%03o", (unsigned char)*s);
+        else putchar(*s);
+    }
+    putchar('"');
+}
+
+static void emit_data(const gen_entry* e, int n) {
+    long i;
+
+    printf("static const uint8_t web_data_%d[] WEB_CONTENT_MEM =\n{", n);
+    for(i = 0; i < e->len; i++) printf("%s0x%02x,", (i % 16) ? " " : "\n\t", e->data[i]);
+    if(e->len == 0) printf("\n\t0x00");
+    printf("\n};\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* root;
+    int gzip_only = 0;
+    int files, i;
+
+    if(argc == 3 && !strcmp(argv[1], "-z")) gzip_only = 1;
+    else if(argc != 2) {
+        fprintf(stderr, "usage: %s [-z] <root> > web_content.c\n", argv[0]);
+        return 1;
+    }
+    root = argv[argc - 1];
+    root_len = strlen(root);
+    if(nftw(root, collect, 16, FTW_PHYS) != 0) return 1;
+    if(count == 0) {
+        fprintf(stderr, "%s: no files\n", root);
+        return 1;
+    }
+
+    files = count;
+    for(i = 0; i < files; i++) {
+        if(read_entry(root, &entries[i]) < 0) return 1;
+        if(!is_text(entries[i].name)) continue;
+        if(count == GEN_MAX_FILES) {
+            fprintf(stderr, "more than %d files\n", GEN_MAX_FILES);
+            return 1;
+        }
+        if(gzip_entry(root, &entries[i], &entries[count]) < 0) return 1;
+        // The compressed variant is kept only when it is smaller
+        if(entries[count].len >= entries[i].len) continue;
+        if(gzip_only) entries[i] = entries[count];
+        else count++;
+    }
+    qsort(entries, count, sizeof(entries[0]), by_name);
+
+    printf("/* Generated by web_content_gen from %s, do not edit */\n\n", root);
+    printf("#include \"httpServer.h\"\n\n");
+    for(i = 0; i < count; i++) {
+        emit_data(&entries[i], i);
+        printf("static const char web_name_%d[] WEB_CONTENT_MEM = ", i);
+        emit_string(entries[i].name);
+        printf(";\n\n");
+    }
+    printf("const httpServer_webContent web_content_table[] WEB_CONTENT_MEM =\n{\n");
+    for(i = 0; i < count; i++)
+        printf("\t{ web_name_%d, %ldUL, web_data_%d, 0x%08xUL },\n", i, entries[i].len, i, etag_of(&entries[i]));
+    printf("};\n\nconst uint16_t web_content_table_cnt = %d;\n", count);
+    return 0;
+}
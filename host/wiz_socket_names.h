@@ -0,0 +1,26 @@
+#ifndef _WIZ_SOCKET_NAMES_H_
+#define _WIZ_SOCKET_NAMES_H_
+
+/*
+    The socket.h API has the names of the BSD socket calls of the C library.
+    On the host the driver and the application are built with this header
+    forced in front (gcc -include), so their socket(), close(), send() ... link
+    as wiz_socket(), wiz_close(), wiz_send() ... and the model keeps the Linux
+    calls. Don't include system headers declaring these calls after it.
+ */
+
+#define socket          wiz_socket
+#define close           wiz_close
+#define listen          wiz_listen
+#define connect         wiz_connect
+#define disconnect      wiz_disconnect
+#define send            wiz_send
+#define sendv           wiz_sendv
+#define recv            wiz_recv
+#define sendto          wiz_sendto
+#define recvfrom        wiz_recvfrom
+#define ctlsocket       wiz_ctlsocket
+#define setsockopt      wiz_setsockopt
+#define getsockopt      wiz_getsockopt
+
+#endif
@@ -2,7 +2,6 @@
 #include "loopback.h"
 #include "socket.h"
 #include "wizchip_conf.h"
-#include "../../main.h"
 
 #if LOOPBACK_MODE == LOOPBACK_MAIN_NOBLCOK
 
@@ -14,7 +13,6 @@ int32_t loopback_tcps(uint8_t sn, uint8_t* buf, uint16_t port)
 #ifdef _LOOPBACK_DEBUG_
    uint8_t destip[4];
    uint16_t destport;
-   uint8_t i;
 #endif
 
    switch(getSn_SR(sn))
@@ -31,7 +29,7 @@ int32_t loopback_tcps(uint8_t sn, uint8_t* buf, uint16_t port)
          }
 		 if((size = getSn_RX_RSR(sn)) > 0) // Don't need to check SOCKERR_BUSY because it doesn't not occur.
          {
-			if(size > DATA_BUF_SIZE) size = DATA_BUF_SIZE;
+			if(size > DATA_BUF_SIZE - 1) size = DATA_BUF_SIZE - 1;	// room for the terminator
 			ret = recv(sn, buf, size);
 
 			if(ret <= 0) return ret;      // check SOCKERR_BUSY & SOCKERR_XXX. For showing the occurrence of SOCKERR_BUSY.
@@ -48,12 +46,7 @@ int32_t loopback_tcps(uint8_t sn, uint8_t* buf, uint16_t port)
 				}
 				sentsize += ret; // Don't care SOCKERR_BUSY, because it is zero.
 			}
-         //printf("   data (TCPS): ");
-         for(i = 0; i < ret; i++) {
-            //printf("%c", buf[i]);
-            ethBuf0[i] = buf[i];
-         }
-         //printf("\n\n");
+         buf[size] = 0;   // the caller reads the data as a string
          return 10;
          }
          break;
@@ -183,14 +176,13 @@ int32_t loopback_udps(uint8_t sn, uint8_t* buf, uint16_t port)
    uint16_t size, sentsize;
    uint8_t  destip[4];
    uint16_t destport;
-   uint8_t i;
 
    switch(getSn_SR(sn))
    {
       case SOCK_UDP :
          if((size = getSn_RX_RSR(sn)) > 0)
          {
-            if(size > DATA_BUF_SIZE) size = DATA_BUF_SIZE;
+            if(size > DATA_BUF_SIZE - 1) size = DATA_BUF_SIZE - 1;  // room for the terminator
             ret = recvfrom(sn, buf, size, destip, (uint16_t*)&destport);
             //printf("Data length: %lu\n", ret);
             if(ret <= 0)
@@ -214,12 +206,7 @@ int32_t loopback_udps(uint8_t sn, uint8_t* buf, uint16_t port)
                }
                sentsize += ret; // Don't care SOCKERR_BUSY, because it is zero.
             }
-            //printf("   data (UDPS): ");
-            for(i = 0; i < ret; i++) {
-               //printf("%c", buf[i]);
-               ethBuf1[i] = buf[i];
-            }
-            //printf("\n\n");
+            buf[size] = 0;   // the caller reads the data as a string
             return 10;
          }
          break;
@@ -1,14 +1,41 @@
 #include <stdio.h>
+#ifdef __AVR__
 #include <avr/io.h>
+#endif
 #include "string.h"
 #include "loopback.h"
 #include "socket.h"
 #include "wizchip_conf.h"
+#include "modbus.h"
+#ifdef __AVR__
 #include "../../main.h"
+#endif
 
-#define SOCK_MODBUS     2
 #define PORT_MODBUS   502
 
+/* Exception codes of the Modbus application protocol */
+#define MODBUS_EX_ILLEGAL_FUNCTION      0x01
+#define MODBUS_EX_ILLEGAL_DATA_ADDRESS  0x02
+#define MODBUS_EX_ILLEGAL_DATA_VALUE    0x03
+#define MODBUS_EX_SERVER_DEVICE_FAILURE 0x04
+
+/* Quantities the protocol allows in a read; within them, a span past the image is an address error */
+#define MODBUS_MAX_READ_BITS    0x07D0
+#define MODBUS_MAX_READ_REGS    0x007D
+
+/* Registers of a FC03 or FC04 read, the larger of the two banks */
+#if MODBUS_HOLDING_NUM > MODBUS_INPUT_REG_NUM
+#define MODBUS_READ_REGS_MAX    MODBUS_HOLDING_NUM
+#else
+#define MODBUS_READ_REGS_MAX    MODBUS_INPUT_REG_NUM
+#endif
+
+#if _MODBUS_DEBUG_
+#define MODBUS_DBG(...)     printf(__VA_ARGS__)
+#else
+#define MODBUS_DBG(...)     do { if(0) printf(__VA_ARGS__); } while(0)
+#endif
+
 /* Request parsing:
  * 0x00 0x0d - transaction id (word)
  * 0x00 0x00 - protocol
@@ -60,7 +87,18 @@ uint8_t modbus_request[] = {
     0x00, 0x02   // Quantity of Registers (2)
 };
 
-void parse_request(int32_t length, uint8_t *buf, uint8_t *ip_addr) {
+/* Coil writes of concurrent requests must not lose the other bits of the byte. */
+static void modbus_write_coil(uint8_t addr, uint8_t on) {
+#ifdef __AVR__
+    if (on) modbus_regs->coils[addr / 8] |= (1 << (addr % 8));
+    else    modbus_regs->coils[addr / 8] &= ~(1 << (addr % 8));
+#else
+    if (on) __atomic_fetch_or(&modbus_regs->coils[addr / 8], (uint8_t)(1 << (addr % 8)), __ATOMIC_RELAXED);
+    else    __atomic_fetch_and(&modbus_regs->coils[addr / 8], (uint8_t)~(1 << (addr % 8)), __ATOMIC_RELAXED);
+#endif
+}
+
+void parse_request(uint8_t sn, int32_t length, uint8_t *buf, uint8_t *ip_addr) {
     // sorting modbus variables big endian
     // MBAP Header
     uint8_t modbus_transaction_id[2] = {0, 0};       // Transaction Identifier Hi[0] Lo[1] (2 bytes)      
@@ -74,71 +112,77 @@ void parse_request(int32_t length, uint8_t *buf, uint8_t *ip_addr) {
     uint8_t modbus_wildcard[2] = {0, 0};             // Quantity of Registers/Outputs/Inputs (2 bytes)
 
     // MODBUS error response
-    uint8_t modbus_error[9]; // MBAP header (7) + function code (1) + code (1)
+    uint8_t modbus_error[2]; // function code (1) + code (1), sent after the MBAP header
+
+    // MBAP header & PDU are sent as two fragments with sendv(), no assembly copy
+    wiz_IOVec modbus_iov[2];
 
     uint8_t error1 = 0;
     uint8_t error2 = 0;
     uint8_t error3 = 0;
     uint8_t error4 = 0;
 
+    // one consistent copy of the registers read, a value of several registers is never half updated
+    uint16_t regs[MODBUS_READ_REGS_MAX];
 
-    printf("Parse (length): %d\n", (uint8_t)length);
+
+    MODBUS_DBG("Parse (length): %d\n", (uint8_t)length);
     uint16_t i;
     if (length > 12) {
-        printf("Error: Overflow\n");
+        MODBUS_DBG("Error: Overflow\n");
         return;
     }
     for (i = 0; i < length; i++) {
         if (i == 0) {
             modbus_transaction_id[0] = buf[i];
-            printf("Transaction ID: 0x%02x", buf[i]);
+            MODBUS_DBG("Transaction ID: 0x%02x", buf[i]);
         }
         if (i == 1) {
             modbus_transaction_id[1] = buf[i];
-            printf("%02x\n", buf[i]);
+            MODBUS_DBG("%02x\n", buf[i]);
         }
         if (i == 2) {
             modbus_protocol[0] = buf[i];
-            printf("Protocol: 0x%02x", buf[i]);
+            MODBUS_DBG("Protocol: 0x%02x", buf[i]);
         }
         if (i == 3) {
             modbus_protocol[1] = buf[i];
-            printf("%02x\n", buf[i]);
+            MODBUS_DBG("%02x\n", buf[i]);
         }
         if (i == 4) {
             modbus_length[0] = buf[i];
-            printf("Length: 0x%02x", buf[i]);
+            MODBUS_DBG("Length: 0x%02x", buf[i]);
         }
         if (i == 5) {
             modbus_length[1] = buf[i];
-            printf("%02x\n", buf[i]);
+            MODBUS_DBG("%02x\n", buf[i]);
         }
         if (i == 6) {
             modbus_unit_id[0] = buf[i];
-            printf("Unit ID: 0x%02x\n", buf[i]);
+            MODBUS_DBG("Unit ID: 0x%02x\n", buf[i]);
         }
         if (i == 7) {
             modbus_function_code[0] = buf[i];
-            printf("Function code: 0x%02x\n", buf[i]);
+            MODBUS_DBG("Function code: 0x%02x\n", buf[i]);
         }
         if (i == 8) {
             modbus_start_address[0] = buf[i];
-            printf("Address: 0x%02x", buf[i]);
+            MODBUS_DBG("Address: 0x%02x", buf[i]);
         }
         if (i == 9) {
             modbus_start_address[1] = buf[i];
-            printf("%02x\n", buf[i]);
+            MODBUS_DBG("%02x\n", buf[i]);
         }
         if (i == 10) {
             modbus_wildcard[0] = buf[i];
-            printf("wildcard value: 0x%02x", buf[i]);
+            MODBUS_DBG("wildcard value: 0x%02x", buf[i]);
         }
         if (i == 11) {
             modbus_wildcard[1] = buf[i];
-            printf("%02x\n", buf[i]);
+            MODBUS_DBG("%02x\n", buf[i]);
         }
         if (i > 11 ){
-            printf("ERROR: Overflow\n");
+            MODBUS_DBG("ERROR: Overflow\n");
         }
     }
 
@@ -147,6 +191,7 @@ void parse_request(int32_t length, uint8_t *buf, uint8_t *ip_addr) {
     uint16_t number_of_bytes = 0;   
     uint8_t remainder = 0; 
     uint8_t define_size = 0;
+    uint16_t start_address = (modbus_start_address[0] << 8) | modbus_start_address[1];
 
     /* For now handle function codes
     0x01 - Read Coils
@@ -171,7 +216,7 @@ void parse_request(int32_t length, uint8_t *buf, uint8_t *ip_addr) {
         // 15 coils then we need 1 byte and we have 7 more coils remaining which don't fill a full byte 
         // now we add 1 into our N value to represent another byte and pad the unused bits with 0. 
         number_of_coils = modbus_wildcard[1] | (modbus_wildcard[0] << 8);
-        if (!(number_of_coils >= 0x01 || number_of_coils <= 0x17)) {
+        if (number_of_coils < 0x01 || number_of_coils > MODBUS_MAX_READ_BITS) {
             error3 = 1;
         }
         number_of_bytes = number_of_coils / 8;
@@ -179,7 +224,7 @@ void parse_request(int32_t length, uint8_t *buf, uint8_t *ip_addr) {
         if (remainder > 0) {
             number_of_bytes += 1;   // need another byte for the partial bit(s)
         }
-        if (!(modbus_start_address[1] + number_of_bytes <= 0x17)) {
+        if (!((uint32_t)start_address + number_of_bytes <= MODBUS_COILS_SIZE)) {
             error2 = 1;
         }
         define_size = 7 + 2 + number_of_bytes;
@@ -187,7 +232,7 @@ void parse_request(int32_t length, uint8_t *buf, uint8_t *ip_addr) {
         // determine define size: MBAP header (7) + function code (1) + byte count (1) + N
         // N can be found with reading modbus_wildcard.  
         number_of_coils = modbus_wildcard[1] | (modbus_wildcard[0] << 8);
-        if (!(number_of_coils >= 0x01 || number_of_coils <= 0x04)) {
+        if (number_of_coils < 0x01 || number_of_coils > MODBUS_MAX_READ_BITS) {
             error3 = 1;
         }
         number_of_bytes = number_of_coils / 8;
@@ -195,7 +240,7 @@ void parse_request(int32_t length, uint8_t *buf, uint8_t *ip_addr) {
         if (remainder > 0) {
             number_of_bytes += 1;   // need another byte for the partial bit(s)
         }
-        if (!(modbus_start_address[1] + number_of_bytes <= 0x80)) {
+        if (!((uint32_t)start_address + number_of_bytes <= MODBUS_INPUTS_SIZE)) {
             error2 = 1;
         }
         define_size = 7 + 2 + number_of_bytes;  // MBAP header (7) + function code (1) + byte count (1) + number of bytes (N)
@@ -204,13 +249,16 @@ void parse_request(int32_t length, uint8_t *buf, uint8_t *ip_addr) {
         // In this case the value of modbus_wildcard represents N number of registers which is
         // N * 2. We multiply by 2 as we use two bytes to represent a full register.
         number_of_coils = modbus_wildcard[1] | (modbus_wildcard[0] << 8);   // 1 to 125 (0x7D)
-        if (!(number_of_coils >= 0x01 || number_of_coils <= 0x09)) {
+        if (number_of_coils < 0x01 || number_of_coils > MODBUS_MAX_READ_REGS) {
             error3 = 1;
         }
         number_of_bytes = number_of_coils * 2;  // our request will represent the register (16 bits) using 2 bytes
-        if (!(modbus_start_address[1] + number_of_bytes <= 0x09)) {
+        if (!((uint32_t)start_address + number_of_coils <= MODBUS_HOLDING_NUM)) {
             error2 = 1;
         }
+        if (!error2 && !error3 && modbus_read_holding(start_address, regs, number_of_coils) < 0) {
+            error4 = 1;     // the image was left in the middle of a write
+        }
         define_size = 7 + 2 + number_of_bytes;  // MBAP header (7) + function code (1) + byte count (1) + number of bytes (N)
     } else if (modbus_function_code[0] == 0x04) {
         // determine define size: MBAP header (7) + function code (1) + byte count (1) + N
@@ -218,144 +266,171 @@ void parse_request(int32_t length, uint8_t *buf, uint8_t *ip_addr) {
         // In this case the value of modbus_wildcard represents N number of registers which is
         // N * 2. We multiply by 2 as we use two bytes to represent a full register.
         number_of_coils = modbus_wildcard[1] | (modbus_wildcard[0] << 8);   // 1 to 125 (0x7D)
-        if (!(number_of_coils >= 0x01 || number_of_coils <= 0x09)) {
+        if (number_of_coils < 0x01 || number_of_coils > MODBUS_MAX_READ_REGS) {
             error3 = 1;
         }
         number_of_bytes = number_of_coils * 2;  // our request will represent the register (16 bits) using 2 bytes
-        if (!(modbus_start_address[1] + number_of_bytes <= 0x09)) {
+        if (!((uint32_t)start_address + number_of_coils <= MODBUS_INPUT_REG_NUM)) {
             error2 = 1;
         }
+        if (!error2 && !error3 && modbus_read_input_reg(start_address, regs, number_of_coils) < 0) {
+            error4 = 1;
+        }
         define_size = 7 + 2 + number_of_bytes;  
     } else if (modbus_function_code[0] == 0x05) {
-        if (!(modbus_wildcard[0] == 0xFF || modbus_wildcard[0] == 0x00)) {
+        // the output value is 0xFF00 (ON) or 0x0000 (OFF)
+        if (!((modbus_wildcard[0] == 0xFF || modbus_wildcard[0] == 0x00) && modbus_wildcard[1] == 0x00)) {
             error3 = 1;
         }
-        if (!(modbus_start_address[1] == 0x00 || modbus_start_address[1] == 0x03)) {
+        if (!(start_address == 0x00 || start_address == 0x03)) {
             error2 = 1;
         }
         define_size = 12;
-        printf("Size of modbus_response: %d\n", define_size);
+        MODBUS_DBG("Size of modbus_response: %d\n", define_size);
     } else {
-        define_size = 7 + 2;    // MBAP header + function code (1) + error code (1)
         error1 = 1;
     }
+    if (error1 || error2 || error3 || error4) {
+        define_size = 7 + 2;    // MBAP header + function code (1) + error code (1)
+    }
 
-    uint8_t modbus_response[define_size];
+    uint8_t modbus_mbap[7];
+    uint8_t modbus_pdu[define_size - 7];
 
-    /* Now update modbus_response starting with the MBAP header 
+    /* Now update modbus_mbap, the MBAP header 
         MBAP Header: 
-        modbus_response[0-1] - transaction id 
-        modbus_response[2-3] - modbus protocol
-        modbus_response[4-5] - length (number of bytes left) = unit id (1) + function code (1) + N (depending on function code) 
+        modbus_mbap[0-1] - transaction id 
+        modbus_mbap[2-3] - modbus protocol
+        modbus_mbap[4-5] - length (number of bytes left) = unit id (1) + function code (1) + N (depending on function code) 
+        modbus_mbap[6]   - unit id
     */
     // We also have to create the MODBUS response (PDU)
 
     // start out w/ transaction id
-    memcpy(&modbus_response[0], modbus_transaction_id, sizeof(modbus_transaction_id));
+    memcpy(&modbus_mbap[0], modbus_transaction_id, sizeof(modbus_transaction_id));
     // now get modbus protocol; 0x00
-    memcpy(&modbus_response[2], modbus_protocol, sizeof(modbus_protocol));
+    memcpy(&modbus_mbap[2], modbus_protocol, sizeof(modbus_protocol));
     // unit ID
-    modbus_response[6] = modbus_unit_id[0];
+    modbus_mbap[6] = modbus_unit_id[0];
     // function code
-    modbus_response[7] = modbus_function_code[0];
-
-    if (error1 || error2 || error3) {
-        memcpy(&modbus_error[0], modbus_transaction_id, sizeof(modbus_transaction_id));
-        memcpy(&modbus_error[2], modbus_protocol, sizeof(modbus_protocol));
-        modbus_error[6] = modbus_unit_id[0];
-        modbus_error[7] = modbus_function_code[0] + 0x80;
-        modbus_error[8] = 1;
+    modbus_pdu[0] = modbus_function_code[0];
+
+    if (error1 || error2 || error3 || error4) {
+        // length = unit id (1) + func. code (1) + exception code (1)
+        modbus_mbap[4] = 0;
+        modbus_mbap[5] = 1 + 1 + 1;
+        modbus_error[0] = modbus_function_code[0] + 0x80;
+        // in the order of the protocol: the function, then the quantity or value, then the address range,
+        // then the read of the registers
+        if (error1) {
+            modbus_error[1] = MODBUS_EX_ILLEGAL_FUNCTION;
+        } else if (error3) {
+            modbus_error[1] = MODBUS_EX_ILLEGAL_DATA_VALUE;
+        } else if (error2) {
+            modbus_error[1] = MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+        } else {
+            modbus_error[1] = MODBUS_EX_SERVER_DEVICE_FAILURE;
+        }
 
         // now send error...
-        printf("modbus response (error msg): ");
+        MODBUS_DBG("modbus response (error msg): ");
+        for (i = 0; i < sizeof(modbus_mbap); i++) {
+            MODBUS_DBG("%02x ", modbus_mbap[i]);
+        }
         for (i = 0; i < sizeof(modbus_error); i++) {
-            printf("%02x ", modbus_error[i]);
+            MODBUS_DBG("%02x ", modbus_error[i]);
         }
-        printf("\n-----\n");
+        MODBUS_DBG("\n-----\n");
 
-        int32_t sent_bytes = send(SOCK_MODBUS, modbus_error, sizeof(modbus_error));
+        modbus_iov[0].buf = modbus_mbap;
+        modbus_iov[0].len = sizeof(modbus_mbap);
+        modbus_iov[1].buf = modbus_error;
+        modbus_iov[1].len = sizeof(modbus_error);
+        int32_t sent_bytes = sendv(sn, modbus_iov, 2);
         if (sent_bytes > 0) {
-            printf("Sent %lo bytes\n", sent_bytes);
+            MODBUS_DBG("Sent %ld bytes\n", (long)sent_bytes);
         }
         return;
     }
 
     /* Now determine the length & send the data */
-    // length @ modbus_response[4-5]
+    // length @ modbus_mbap[4-5]
     if (modbus_function_code[0] == 0x01) {
-        modbus_response[4] = 0; // length HI byte
+        modbus_mbap[4] = 0; // length HI byte
         // length = unit id (1) + func. code (1) + byte count (1) + N 
-        modbus_response[5] = 1 + 1 + 1 + number_of_bytes; // length LO byte
+        modbus_mbap[5] = 1 + 1 + 1 + number_of_bytes; // length LO byte
         
         uint8_t i;
-        modbus_response[8] = number_of_bytes;   // byte count 
+        modbus_pdu[1] = number_of_bytes;   // byte count 
         for (i = 0; i < number_of_bytes; i++) {
             // start at the given address
-            modbus_response[9 + i] = coils[modbus_start_address[1] + i];    // just assume low byte only for addr
+            modbus_pdu[2 + i] = modbus_regs->coils[modbus_start_address[1] + i];    // just assume low byte only for addr
             if (i == (number_of_bytes - 1)) {
                 // now pad the zeroes if we have any remainders... 
                 if (remainder > 0) {
                     // perform mask of partial bits and pad rest with 0s
                     uint8_t bitmask;
                     bitmask = (1 << remainder) - 1;
-                    modbus_response[9 + i] = coils[modbus_start_address[1] + i] & bitmask;
+                    modbus_pdu[2 + i] = modbus_regs->coils[modbus_start_address[1] + i] & bitmask;
                 }
             }
         } 
     } else if (modbus_function_code[0] == 0x02) {
-        modbus_response[4] = 0; // length HI byte
+        modbus_mbap[4] = 0; // length HI byte
         // length = unit id (1) + func. code (1) + byte count (1) + N 
-        modbus_response[5] = 1 + 1 + 1 + number_of_bytes; // length LO byte
+        modbus_mbap[5] = 1 + 1 + 1 + number_of_bytes; // length LO byte
 
         uint8_t i;
-        modbus_response[8] = number_of_bytes;   // byte count 
+        modbus_pdu[1] = number_of_bytes;   // byte count 
         for (i = 0; i < number_of_bytes; i++) {
             // start at the given address
-            modbus_response[9 + i] = inputs[modbus_start_address[1] + i];    // just assume low byte only for addr
+            modbus_pdu[2 + i] = modbus_regs->inputs[modbus_start_address[1] + i];    // just assume low byte only for addr
             if (i == (number_of_bytes - 1)) {
                 // now pad the zeroes if we have any remainders... 
                 if (remainder > 0) {
                     // perform mask of partial bits and pad rest with 0s
                     uint8_t bitmask;
                     bitmask = (1 << remainder) - 1;
-                    modbus_response[9 + i] = inputs[modbus_start_address[1] + i] & bitmask;
+                    modbus_pdu[2 + i] = modbus_regs->inputs[modbus_start_address[1] + i] & bitmask;
                 }
             }
         } 
     } else if (modbus_function_code[0] == 0x03) {
-        modbus_response[4] = 0; // length HI byte
+        modbus_mbap[4] = 0; // length HI byte
         // length = unit id (1) + func. code (1) + byte count (1) + N 
-        modbus_response[5] = 1 + 1 + 1 + number_of_bytes; // length LO byte
+        modbus_mbap[5] = 1 + 1 + 1 + number_of_bytes; // length LO byte
 
         uint8_t i;
-        modbus_response[8] = number_of_bytes;   // byte count 
-        for (i = 0; i < number_of_bytes; i++) {
+        modbus_pdu[1] = number_of_bytes;   // byte count 
+        for (i = 0; i < number_of_coils; i++) {
             // start at the given address
             // HI byte 1st then LO byte 2nd
-            modbus_response[9 + (i * 2)] = (holding_register[modbus_start_address[1] + i]) >> 8;
-            modbus_response[9 + (i * 2) + 1] = (holding_register[modbus_start_address[1] + i]) & 0xFF;
+            modbus_pdu[2 + (i * 2)] = regs[i] >> 8;
+            modbus_pdu[2 + (i * 2) + 1] = regs[i] & 0xFF;
         } 
     } else if (modbus_function_code[0] == 0x04) {
-        modbus_response[4] = 0; // length HI byte
+        modbus_mbap[4] = 0; // length HI byte
         // length = unit id (1) + func. code (1) + byte count (1) + N 
-        modbus_response[5] = 1 + 1 + number_of_bytes; // length LO byte
+        modbus_mbap[5] = 1 + 1 + 1 + number_of_bytes; // length LO byte
         uint8_t i;
-        modbus_response[8] = number_of_bytes;   // byte count
-        for (i = 0; i < number_of_bytes; i++) {
+        modbus_pdu[1] = number_of_bytes;   // byte count
+        for (i = 0; i < number_of_coils; i++) {
             // start at the given address
             // HI byte 1st then LO byte 2nd
-            modbus_response[9 + (i * 2)] = (input_register[modbus_start_address[1] + i]) >> 8;
-            modbus_response[9 + (i * 2) + 1] = (input_register[modbus_start_address[1] + i]) & 0xFF;
+            modbus_pdu[2 + (i * 2)] = regs[i] >> 8;
+            modbus_pdu[2 + (i * 2) + 1] = regs[i] & 0xFF;
         } 
     } else if (modbus_function_code[0] == 0x05) {
-        modbus_response[4] = 0; // length HI byte
+        modbus_mbap[4] = 0; // length HI byte
         // length = unit id (1) + func. code (1) + output addr (2) + output value (2) 
-        modbus_response[5] = 1 + 1 + 2 + 2; // length LO byte
+        modbus_mbap[5] = 1 + 1 + 2 + 2; // length LO byte
         // coil address
-        memcpy(&modbus_response[8], modbus_start_address, sizeof(modbus_start_address));
+        memcpy(&modbus_pdu[1], modbus_start_address, sizeof(modbus_start_address));
         // coil value
-        memcpy(&modbus_response[10], modbus_wildcard, sizeof(modbus_wildcard));
+        memcpy(&modbus_pdu[3], modbus_wildcard, sizeof(modbus_wildcard));
 
+        modbus_write_coil(modbus_start_address[1], modbus_wildcard[0] == 0xFF);
+#ifdef __AVR__
         if (modbus_start_address[1] == 0) {
             if (modbus_wildcard[0] == 0xFF) {
                 PORTH |= 0x20;
@@ -370,19 +445,27 @@ void parse_request(int32_t length, uint8_t *buf, uint8_t *ip_addr) {
                 PORTH &= ~0x01;
             }
         }
+#endif
     }
 
     // now send data...
     if (modbus_function_code[0] >= 0x01 || modbus_function_code[0] <= 0x05) {
-         printf("modbus response: ");
-        for (i = 0; i < sizeof(modbus_response); i++) {
-            printf("%02x ", modbus_response[i]);
+         MODBUS_DBG("modbus response: ");
+        for (i = 0; i < sizeof(modbus_mbap); i++) {
+            MODBUS_DBG("%02x ", modbus_mbap[i]);
         }
-        printf("\n-----\n");
+        for (i = 0; i < sizeof(modbus_pdu); i++) {
+            MODBUS_DBG("%02x ", modbus_pdu[i]);
+        }
+        MODBUS_DBG("\n-----\n");
 
-        int32_t sent_bytes = send(SOCK_MODBUS, modbus_response, sizeof(modbus_response));
+        modbus_iov[0].buf = modbus_mbap;
+        modbus_iov[0].len = sizeof(modbus_mbap);
+        modbus_iov[1].buf = modbus_pdu;
+        modbus_iov[1].len = sizeof(modbus_pdu);
+        int32_t sent_bytes = sendv(sn, modbus_iov, 2);
         if (sent_bytes > 0) {
-            printf("Sent %lo bytes\n", sent_bytes);
+            MODBUS_DBG("Sent %ld bytes\n", (long)sent_bytes);
         }
     }
 
@@ -642,14 +725,15 @@ int32_t loopback_modbus(uint8_t sn, uint8_t* buf, uint16_t port, int8_t *ip_addr
          {
 			getSn_DIPR(sn, destip);
 			destport = getSn_DPORT(sn);
-			printf("%d:Connected - %d.%d.%d.%d : %u\r\n",sn, destip[0], destip[1], destip[2], destip[3], destport);
+			MODBUS_DBG("%d:Connected - %d.%d.%d.%d : %u\r\n",sn, destip[0], destip[1], destip[2], destip[3], destport);
 			setSn_IR(sn,Sn_IR_CON);
          }
 		 if((size = getSn_RX_RSR(sn)) > 0) // Don't need to check SOCKERR_BUSY because it doesn't not occur.
          {
 			if(size > DATA_BUF_SIZE) size = DATA_BUF_SIZE;
+			setSn_IR(sn, Sn_IR_RECV);
 			ret = recv(sn, buf, size);
-            printf("ret size: %d\n", (uint8_t)ret);
+            MODBUS_DBG("ret size: %d\n", (uint8_t)ret);
 
 			if(ret <= 0) return ret;      // check SOCKERR_BUSY & SOCKERR_XXX. For showing the occurrence of SOCKERR_BUSY.
 			size = (uint16_t) ret;
@@ -668,37 +752,36 @@ int32_t loopback_modbus(uint8_t sn, uint8_t* buf, uint16_t port, int8_t *ip_addr
 				sentsize += ret; // Don't care SOCKERR_BUSY, because it is zero.
 			}
             #endif
-        printf("==============\nRequest received! (MODBUS): ");
+        MODBUS_DBG("==============\nRequest received! (MODBUS): ");
         for(i = 0; i < ret; i++) {
-            printf("0x%02x ", buf[i]);
-            ethBuf2[i] = buf[i];
+            MODBUS_DBG("0x%02x ", buf[i]);
         }
-        printf("\n==============\n\n");
-        parse_request(ret, ethBuf2, ip_addr);
-        return 10;
+        MODBUS_DBG("\n==============\n\n");
+        parse_request(sn, ret, buf, (uint8_t*)ip_addr);
+        return ret;
         }
         break;
       case SOCK_CLOSE_WAIT :
-        printf("%d:CloseWait\r\n",sn);
+        MODBUS_DBG("%d:CloseWait\r\n",sn);
         if((ret = disconnect(sn)) != SOCK_OK) return ret;
-            printf("%d:Socket Closed\r\n", sn);
+            MODBUS_DBG("%d:Socket Closed\r\n", sn);
         break;
     case SOCK_INIT :
-        printf("%d:Listen, MODBUS server loopback, port [%d]\r\n", sn, port);
+        MODBUS_DBG("%d:Listen, MODBUS server loopback, port [%d]\r\n", sn, port);
         if( (ret = listen(sn)) != SOCK_OK) return ret;
         break;
     case SOCK_CLOSED:
-        printf("%d:MODBUS server loopback start\r\n",sn);
+        MODBUS_DBG("%d:MODBUS server loopback start\r\n",sn);
 
         if((ret = socket(sn, Sn_MR_TCP, port, 0x00)) != sn) return ret;
-        printf("%d:Socket opened\r\n",sn);
+        MODBUS_DBG("%d:Socket opened\r\n",sn);
         break;
     default:
         break;
     }
-   return 1;
+   return 0;
 }
 
 void test_it(void) {
-    printf("Got it!\n");
+    MODBUS_DBG("Got it!\n");
 }
\ No newline at end of file
@@ -1,9 +1,19 @@
 #ifndef _MODBUS_H_
 #define _MODBUS_H_
 
+#include <stdint.h>
+#include "modbus_store.h"
+
+/* Modbus request debug message printout enable */
+#ifndef _MODBUS_DEBUG_
+#define _MODBUS_DEBUG_  1
+#endif
+
 void send_modbus_request(uint8_t sn, uint8_t* buf, uint16_t port, uint8_t *ip_addr);
 void send_tcp_request(uint8_t sn, uint8_t* buf, uint16_t port, int8_t *ip_addr);
 void test_it(void);
+
+/* Modbus TCP server on socket sn. Returns the size of the request answered, 0 if none, or a negative SOCKERR_xxx. */
 int32_t loopback_modbus(uint8_t sn, uint8_t* buf, uint16_t port, int8_t *ip_addr);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,223 @@
+#include <string.h>
+#ifndef __AVR__
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#include "modbus_store.h"
+
+/* The register store in memory, until modbus_store_map() */
+static modbus_image modbus_local;
+
+modbus_image* modbus_regs = &modbus_local;
+
+#if MODBUS_SEQ_BLOCKS(MODBUS_HOLDING_NUM) > MODBUS_SEQ_BLOCKS(MODBUS_INPUT_REG_NUM)
+#define MODBUS_SEQ_MAX  MODBUS_SEQ_BLOCKS(MODBUS_HOLDING_NUM)
+#else
+#define MODBUS_SEQ_MAX  MODBUS_SEQ_BLOCKS(MODBUS_INPUT_REG_NUM)
+#endif
+
+/*
+ * One core on the AVR: the compiler must only keep the order and read the
+ * memory again. On the host the counters order the register accesses of the
+ * other cores (acquire / release), the registers themselves are relaxed.
+ * The same holds between processes sharing the image.
+ */
+#ifdef __AVR__
+#define SEQ_LOAD(p)         (*(volatile modbus_seq_t*)(p))
+#define SEQ_STORE(p, v)     (*(volatile modbus_seq_t*)(p) = (v))
+#define REG_LOAD(p)         (*(volatile uint16_t*)(p))
+#define REG_STORE(p, v)     (*(volatile uint16_t*)(p) = (v))
+#define READ_FENCE()        __asm__ __volatile__("" ::: "memory")
+#define WRITE_FENCE()       __asm__ __volatile__("" ::: "memory")
+#else
+#define SEQ_LOAD(p)         __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define SEQ_STORE(p, v)     __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define REG_LOAD(p)         __atomic_load_n(p, __ATOMIC_RELAXED)
+#define REG_STORE(p, v)     __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define READ_FENCE()        __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define WRITE_FENCE()       __atomic_thread_fence(__ATOMIC_RELEASE)
+#endif
+
+/*
+ * Between the tries of a read the other processes run: the first ones yield
+ * the CPU, the next ones sleep a millisecond. The AVR has nothing to wait for,
+ * a counter odd under a reader of the main loop is only left by a dead writer.
+ */
+static void seq_backoff(uint16_t tries) {
+#ifndef __AVR__
+    struct timespec ms = {0, 1000000};
+
+    if (tries < MODBUS_SEQ_SPINS) {
+        sched_yield();
+    } else {
+        nanosleep(&ms, NULL);
+    }
+#else
+    (void)tries;
+#endif
+}
+
+static int8_t seq_write(modbus_seq_t* seq, uint16_t* regs, uint16_t num, uint16_t addr, const uint16_t* val, uint16_t cnt) {
+    uint16_t first, last, b, i;
+
+    if (cnt == 0 || addr >= num || cnt > num - addr) {
+        return -1;
+    }
+    first = addr / MODBUS_SEQ_BLOCK;
+    last = (addr + cnt - 1) / MODBUS_SEQ_BLOCK;
+
+    // odd: the blocks are being written. Already odd if a writer died in
+    // the middle, its readers wait for this write.
+    for (b = first; b <= last; b++) {
+        SEQ_STORE(&seq[b], seq[b] | 1);
+    }
+    WRITE_FENCE();
+    for (i = 0; i < cnt; i++) {
+        REG_STORE(&regs[addr + i], val[i]);
+    }
+    // even again, after the registers
+    for (b = first; b <= last; b++) {
+        SEQ_STORE(&seq[b], seq[b] + 1);
+    }
+    return 0;
+}
+
+static int8_t seq_read(modbus_seq_t* seq, uint16_t* regs, uint16_t num, uint16_t addr, uint16_t* val, uint16_t cnt) {
+    modbus_seq_t snap[MODBUS_SEQ_MAX];
+    uint16_t first, last, b, i;
+    uint16_t tries;
+    uint8_t busy;
+
+    if (cnt == 0 || addr >= num || cnt > num - addr) {
+        return -1;
+    }
+    first = addr / MODBUS_SEQ_BLOCK;
+    last = (addr + cnt - 1) / MODBUS_SEQ_BLOCK;
+
+    for (tries = 0; tries < MODBUS_SEQ_TRIES; tries++) {
+        busy = 0;
+        for (b = first; b <= last; b++) {
+            snap[b - first] = SEQ_LOAD(&seq[b]);
+            busy |= snap[b - first] & 1;
+        }
+        if (!busy) {
+            for (i = 0; i < cnt; i++) {
+                val[i] = REG_LOAD(&regs[addr + i]);
+            }
+            READ_FENCE();
+            for (b = first; b <= last; b++) {
+                if (SEQ_LOAD(&seq[b]) != snap[b - first]) {
+                    break;
+                }
+            }
+            if (b > last) {
+                return 0;
+            }
+        }
+        seq_backoff(tries);     // a write is in progress
+    }
+    return -1;  // the writer died in the middle of a write
+}
+
+int8_t modbus_write_holding(uint16_t addr, const uint16_t* val, uint16_t cnt) {
+    modbus_image* m = modbus_regs;
+
+    return seq_write(m->holding_seq, m->holding_register, MODBUS_HOLDING_NUM, addr, val, cnt);
+}
+
+int8_t modbus_write_input_reg(uint16_t addr, const uint16_t* val, uint16_t cnt) {
+    modbus_image* m = modbus_regs;
+
+    return seq_write(m->input_reg_seq, m->input_register, MODBUS_INPUT_REG_NUM, addr, val, cnt);
+}
+
+int8_t modbus_read_holding(uint16_t addr, uint16_t* val, uint16_t cnt) {
+    modbus_image* m = modbus_regs;
+
+    return seq_read(m->holding_seq, m->holding_register, MODBUS_HOLDING_NUM, addr, val, cnt);
+}
+
+int8_t modbus_read_input_reg(uint16_t addr, uint16_t* val, uint16_t cnt) {
+    modbus_image* m = modbus_regs;
+
+    return seq_read(m->input_reg_seq, m->input_register, MODBUS_INPUT_REG_NUM, addr, val, cnt);
+}
+
+#ifndef __AVR__
+static void image_init(modbus_image* m) {
+    memset(m, 0, sizeof(*m));
+    m->version = MODBUS_IMAGE_VERSION;
+    m->seq_size = sizeof(modbus_seq_t);
+    m->image_size = sizeof(modbus_image);
+    m->coils_size = MODBUS_COILS_SIZE;
+    m->inputs_size = MODBUS_INPUTS_SIZE;
+    m->holding_num = MODBUS_HOLDING_NUM;
+    m->input_reg_num = MODBUS_INPUT_REG_NUM;
+    m->seq_block = MODBUS_SEQ_BLOCK;
+    m->created = (uint32_t)time(NULL);
+    // the magic last: an image without it is initialized again
+    __atomic_store_n(&m->magic, MODBUS_IMAGE_MAGIC, __ATOMIC_RELEASE);
+}
+
+static int image_valid(const modbus_image* m) {
+    return m->version == MODBUS_IMAGE_VERSION && m->seq_size == sizeof(modbus_seq_t) &&
+           m->image_size == sizeof(modbus_image) && m->coils_size == MODBUS_COILS_SIZE &&
+           m->inputs_size == MODBUS_INPUTS_SIZE && m->holding_num == MODBUS_HOLDING_NUM &&
+           m->input_reg_num == MODBUS_INPUT_REG_NUM && m->seq_block == MODBUS_SEQ_BLOCK;
+}
+
+int8_t modbus_store_map(const char* name) {
+    modbus_image* m;
+    struct stat st;
+    int fd;
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+    if (fd < 0) {
+        return -1;
+    }
+    // the first process initializes the image, the others wait for it
+    if (flock(fd, LOCK_EX) < 0 || fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size != 0 && st.st_size != sizeof(modbus_image)) {
+        close(fd);  // layout of another build
+        return -1;
+    }
+    if (st.st_size == 0 && ftruncate(fd, sizeof(modbus_image)) < 0) {
+        close(fd);
+        return -1;
+    }
+    m = mmap(NULL, sizeof(modbus_image), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    if (__atomic_load_n(&m->magic, __ATOMIC_ACQUIRE) != MODBUS_IMAGE_MAGIC) {
+        image_init(m);
+    } else if (!image_valid(m)) {
+        munmap(m, sizeof(modbus_image));
+        close(fd);
+        return -1;
+    }
+    __atomic_fetch_add(&m->maps, 1, __ATOMIC_RELAXED);
+    flock(fd, LOCK_UN);     // the mapping holds the file, close() alone would keep the lock
+    close(fd);
+
+    modbus_store_unmap();
+    modbus_regs = m;
+    return 0;
+}
+
+void modbus_store_unmap(void) {
+    if (modbus_regs != &modbus_local) {
+        munmap(modbus_regs, sizeof(modbus_image));
+    }
+    modbus_regs = &modbus_local;
+}
+#endif
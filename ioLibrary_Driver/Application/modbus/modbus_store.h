@@ -0,0 +1,106 @@
+#ifndef _MODBUS_STORE_H_
+#define _MODBUS_STORE_H_
+
+#include <stdint.h>
+
+/* Register store of the Modbus server.
+ *
+ * The holding and input registers are split in blocks of MODBUS_SEQ_BLOCK
+ * registers, each with a sequence counter (seqlock). The writer makes the
+ * counter odd, writes, and makes it even again; a reader copies the registers
+ * and retries if a counter was odd or has changed meanwhile. The readers take
+ * no lock and never hold the writer up, and a value of several registers
+ * (32-bit integer, float) written in one call is never seen half updated.
+ *
+ * One writer per register array: an acquisition thread or process on Linux,
+ * an ISR or the main loop on the AVR. The readers on the AVR must not be in
+ * an ISR which interrupts the writer, they would never see the write end.
+ *
+ * A reader gives up after MODBUS_SEQ_TRIES tries, yielding then sleeping
+ * between them on Linux, and the read returns -1: the Modbus server answers
+ * exception 04 (Server Device Failure). A writer which dies in the middle of a
+ * write leaves its blocks odd in the image; they stay so until the writer is
+ * started again, its next write of the blocks makes them even.
+ *
+ * The store is a modbus_image, in memory by default. On Linux
+ * modbus_store_map() puts it in a /dev/shm file instead, so an acquisition
+ * process and the server processes share one device model: the server reads
+ * the registers with plain memory loads, and starts again from the image left
+ * by its last run.
+ */
+
+/* Size of the register store shared by all the connections */
+#define MODBUS_COILS_SIZE       0x17    // bytes of coils, 8 coils each
+#define MODBUS_INPUTS_SIZE      0x80    // bytes of discrete inputs, 8 inputs each
+#define MODBUS_HOLDING_NUM      0x09    // holding registers
+#define MODBUS_INPUT_REG_NUM    0x09    // input registers
+
+/* Registers under one sequence counter */
+#ifndef MODBUS_SEQ_BLOCK
+#define MODBUS_SEQ_BLOCK        8
+#endif
+#define MODBUS_SEQ_BLOCKS(num)  (((num) + MODBUS_SEQ_BLOCK - 1) / MODBUS_SEQ_BLOCK)
+
+/* Tries of a read before the writer is taken for dead; the first MODBUS_SEQ_SPINS
+ * yield the CPU, the next ones sleep 1 ms on Linux (under 100 ms in all) */
+#ifndef MODBUS_SEQ_TRIES
+#define MODBUS_SEQ_TRIES        100
+#endif
+#ifndef MODBUS_SEQ_SPINS
+#define MODBUS_SEQ_SPINS        16
+#endif
+
+#ifdef __AVR__
+typedef uint8_t  modbus_seq_t;      // read in one instruction
+#else
+typedef uint32_t modbus_seq_t;
+#endif
+
+#define MODBUS_IMAGE_MAGIC      0x4952424D  // "MBRI"
+#define MODBUS_IMAGE_VERSION    1           // bump on any change of modbus_image
+
+typedef struct {
+    /* metadata, checked by modbus_store_map() against the layout of this build */
+    uint32_t     magic;
+    uint16_t     version;
+    uint16_t     seq_size;                  // sizeof(modbus_seq_t)
+    uint32_t     image_size;                // sizeof(modbus_image)
+    uint16_t     coils_size;
+    uint16_t     inputs_size;
+    uint16_t     holding_num;
+    uint16_t     input_reg_num;
+    uint16_t     seq_block;
+    uint16_t     maps;                      // count of modbus_store_map() on the image
+    uint32_t     created;                   // time of creation, seconds since the epoch
+    /* sequence counters of the register blocks */
+    modbus_seq_t holding_seq[MODBUS_SEQ_BLOCKS(MODBUS_HOLDING_NUM)];
+    modbus_seq_t input_reg_seq[MODBUS_SEQ_BLOCKS(MODBUS_INPUT_REG_NUM)];
+    /* registers */
+    uint8_t      coils[MODBUS_COILS_SIZE];
+    uint8_t      inputs[MODBUS_INPUTS_SIZE];
+    uint16_t     holding_register[MODBUS_HOLDING_NUM];
+    uint16_t     input_register[MODBUS_INPUT_REG_NUM];
+} modbus_image;
+
+/* The register store in use */
+extern modbus_image* modbus_regs;
+
+/* Write cnt registers from addr. Returns 0, or -1 if out of the store. */
+int8_t modbus_write_holding(uint16_t addr, const uint16_t* val, uint16_t cnt);
+int8_t modbus_write_input_reg(uint16_t addr, const uint16_t* val, uint16_t cnt);
+
+/* Copy cnt registers from addr, consistent with the writes.
+ * Returns 0, or -1 if out of the store or left in the middle of a write. */
+int8_t modbus_read_holding(uint16_t addr, uint16_t* val, uint16_t cnt);
+int8_t modbus_read_input_reg(uint16_t addr, uint16_t* val, uint16_t cnt);
+
+#ifndef __AVR__
+/* Use the register image of the shared memory object name ("/modbus"), created if none.
+ * Returns 0, or -1 if it can't be mapped or has the layout of another build. */
+int8_t modbus_store_map(const char* name);
+
+/* Go back to the store in memory. The image stays for the next modbus_store_map(). */
+void   modbus_store_unmap(void);
+#endif
+
+#endif
@@ -53,6 +53,9 @@
 //*****************************************************************************
 //#include <stdio.h>
 #include "w5500.h"
+#if _WIZCHIP_SPI_STATIC_
+   #include "wizchip_spi_port.h"
+#endif
 
 #define _W5500_SPI_VDM_OP_          0x00
 #define _W5500_SPI_FDM_OP_LEN1_     0x01
@@ -62,6 +65,69 @@
 #if   (_WIZCHIP_ == 5500)
 ////////////////////////////////////////////////////
 
+#if _WIZCHIP_SPI_STATIC_
+// The SPI transport is bound by wizchip_spi_port.h at compile time. No callback function is called per byte.
+static inline void wizchip_spi_addr(uint32_t AddrSel)
+{
+   uint8_t spi_data[3];
+
+   spi_data[0] = (uint8_t)(AddrSel >> 16);
+   spi_data[1] = (uint8_t)(AddrSel >>  8);
+   spi_data[2] = (uint8_t)(AddrSel >>  0);
+   wizchip_port_write_burst(spi_data, 3);
+}
+
+uint8_t  WIZCHIP_READ(uint32_t AddrSel)
+{
+   uint8_t ret;
+
+   WIZCHIP_CRITICAL_ENTER();
+   wizchip_port_select();
+   wizchip_spi_addr(AddrSel | (_W5500_SPI_READ_ | _W5500_SPI_VDM_OP_));
+   ret = wizchip_port_read();
+   wizchip_port_deselect();
+   WIZCHIP_CRITICAL_EXIT();
+   return ret;
+}
+
+void     WIZCHIP_WRITE(uint32_t AddrSel, uint8_t wb )
+{
+   WIZCHIP_CRITICAL_ENTER();
+   wizchip_port_select();
+   wizchip_spi_addr(AddrSel | (_W5500_SPI_WRITE_ | _W5500_SPI_VDM_OP_));
+   wizchip_port_write(wb);
+   wizchip_port_deselect();
+   WIZCHIP_CRITICAL_EXIT();
+}
+
+void     WIZCHIP_READ_BUF (uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
+{
+   WIZCHIP_CRITICAL_ENTER();
+   wizchip_port_select();
+   wizchip_spi_addr(AddrSel | (_W5500_SPI_READ_ | _W5500_SPI_VDM_OP_));
+   wizchip_port_read_burst(pBuf, len);
+   wizchip_port_deselect();
+   WIZCHIP_CRITICAL_EXIT();
+}
+
+void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
+{
+   WIZCHIP_CRITICAL_ENTER();
+   wizchip_port_select();
+   wizchip_spi_addr(AddrSel | (_W5500_SPI_WRITE_ | _W5500_SPI_VDM_OP_));
+   wizchip_port_write_burst(pBuf, len);
+   wizchip_port_deselect();
+   WIZCHIP_CRITICAL_EXIT();
+}
+
+#else
+#if _WIZCHIP_INSTANCE_NUM_ > 1
+// A socket block goes to the instance of the handle in the address, the common block to the selected one.
+// Nothing is selected, so a register access from an interrupt does not move the instance of the interrupted code.
+   #undef  WIZCHIP
+   #define WIZCHIP   WIZCHIP_INST[(AddrSel & (0x1F << 3)) ? WIZCHIP_SOCK_INST(WIZCHIP_ADDR_HANDLE(AddrSel)) : WIZCHIP_INST_CUR]
+#endif
+
 uint8_t  WIZCHIP_READ(uint32_t AddrSel)
 {
    uint8_t ret;
@@ -183,6 +249,7 @@ void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len)
    WIZCHIP.CS._deselect();
    WIZCHIP_CRITICAL_EXIT();
 }
+#endif   // _WIZCHIP_SPI_STATIC_
 
 
 uint16_t getSn_TX_FSR(uint8_t sn)
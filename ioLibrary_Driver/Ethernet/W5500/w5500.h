@@ -65,9 +65,20 @@ extern "C" {
 #define _W5500_SPI_WRITE_			   (0x01 << 2) //< SPI interface Write operation in Control Phase
 
 #define WIZCHIP_CREG_BLOCK          0x00 	//< Common register block
-#define WIZCHIP_SREG_BLOCK(N)       (1+4*N) //< Socket N register block
-#define WIZCHIP_TXBUF_BLOCK(N)      (2+4*N) //< Socket N Tx buffer address block
-#define WIZCHIP_RXBUF_BLOCK(N)      (3+4*N) //< Socket N Rx buffer address block
+// N is a socket handle. Refer to @ref \_WIZCHIP_INSTANCE_NUM_.
+// With several instances or the POSIX sockets, the handle rides in bits 24~31 of the address,
+// which are not sent in the SPI frame, and WIZCHIP_READ() and so on pick its chip or socket.
+#if (_WIZCHIP_INSTANCE_NUM_ > 1)
+   #define WIZCHIP_SOCK_BLOCK(N)    (4*WIZCHIP_SOCK_HWNUM(N) + ((uint32_t)(N) << 21))
+#elif _WIZCHIP_IO_POSIX_
+   #define WIZCHIP_SOCK_BLOCK(N)    ((uint32_t)(N) << 21)
+#else
+   #define WIZCHIP_SOCK_BLOCK(N)    (4*(N))
+#endif
+#define WIZCHIP_ADDR_HANDLE(ADDR)   ((uint8_t)((ADDR) >> 24)) //< Socket handle of a Sn_ register or buffer address
+#define WIZCHIP_SREG_BLOCK(N)       (1+WIZCHIP_SOCK_BLOCK(N)) //< Socket N register block
+#define WIZCHIP_TXBUF_BLOCK(N)      (2+WIZCHIP_SOCK_BLOCK(N)) //< Socket N Tx buffer address block
+#define WIZCHIP_RXBUF_BLOCK(N)      (3+WIZCHIP_SOCK_BLOCK(N)) //< Socket N Rx buffer address block
 
 #define WIZCHIP_OFFSET_INC(ADDR, N)    (ADDR + (N<<8)) //< Increase offset address
 
@@ -59,15 +59,23 @@
 //#define SOCK_ANY_PORT_NUM  0xC000;
 #define SOCK_ANY_PORT_NUM  0xC000
 
+// The socket states are kept for each socket handle of all WIZCHIP instances.
+#if _WIZCHIP_SOCK_HANDLE_NUM_ > 16
+   #define SOCK_MASK_T    uint32_t
+#else
+   #define SOCK_MASK_T    uint16_t
+#endif
+#define SOCK_BIT(sn)      ((SOCK_MASK_T)1 << (sn))
+
 static uint16_t sock_any_port = SOCK_ANY_PORT_NUM;
-static uint16_t sock_io_mode = 0;
-static uint16_t sock_is_sending = 0;
+static SOCK_MASK_T sock_io_mode = 0;
+static SOCK_MASK_T sock_is_sending = 0;
 
-static uint16_t sock_remained_size[_WIZCHIP_SOCK_NUM_] = {0,0,};
+static uint16_t sock_remained_size[_WIZCHIP_SOCK_HANDLE_NUM_] = {0,0,};
 
 //M20150601 : For extern decleation
 //static uint8_t  sock_pack_info[_WIZCHIP_SOCK_NUM_] = {0,};
-uint8_t  sock_pack_info[_WIZCHIP_SOCK_NUM_] = {0,};
+uint8_t  sock_pack_info[_WIZCHIP_SOCK_HANDLE_NUM_] = {0,};
 //
 
 #if _WIZCHIP_ == 5200
@@ -80,9 +88,17 @@ uint8_t  sock_pack_info[_WIZCHIP_SOCK_NUM_] = {0,};
 #endif
 
 
+// The Sn_ registers follow the handle. The instance is selected on entry for the common registers, such as SIPR.
+#if _WIZCHIP_INSTANCE_NUM_ > 1
+   #define SOCK_INST_SELECT()   (void)wizchip_inst_select(WIZCHIP_SOCK_INST(sn))
+#else
+   #define SOCK_INST_SELECT()
+#endif
+
 #define CHECK_SOCKNUM()   \
    do{                    \
-      if(sn > _WIZCHIP_SOCK_NUM_) return SOCKERR_SOCKNUM;   \
+      if(sn >= _WIZCHIP_SOCK_HANDLE_NUM_) return SOCKERR_SOCKNUM;   \
+      SOCK_INST_SELECT();                                           \
    }while(0);             \
 
 #define CHECK_SOCKMODE(mode)  \
@@ -100,6 +116,12 @@ uint8_t  sock_pack_info[_WIZCHIP_SOCK_NUM_] = {0,};
       if(len == 0) return SOCKERR_DATALEN;   \
    }while(0);              \
 
+#if _WIZCHIP_SOCKBUF_REBALANCE_ && (_WIZCHIP_ == 5500)
+   #define SOCKBUF_TRACK(txused, rxused)   wizchip_sockbuf_track(sn, txused, rxused)
+#else
+   #define SOCKBUF_TRACK(txused, rxused)
+#endif
+
 
 
 int8_t socket(uint8_t sn, uint8_t protocol, uint16_t port, uint8_t flag)
@@ -182,10 +204,10 @@ int8_t socket(uint8_t sn, uint8_t protocol, uint16_t port, uint8_t flag)
    setSn_CR(sn,Sn_CR_OPEN);
    while(getSn_CR(sn));
    //A20150401 : For release the previous sock_io_mode
-   sock_io_mode &= ~(1 <<sn);
+   sock_io_mode &= ~SOCK_BIT(sn);
    //
-	sock_io_mode |= ((flag & SF_IO_NONBLOCK) << sn);   
-   sock_is_sending &= ~(1<<sn);
+	if(flag & SF_IO_NONBLOCK) sock_io_mode |= SOCK_BIT(sn);   
+   sock_is_sending &= ~SOCK_BIT(sn);
    sock_remained_size[sn] = 0;
    //M20150601 : repalce 0 with PACK_COMPLETED
    //sock_pack_info[sn] = 0;
@@ -229,9 +251,9 @@ int8_t close(uint8_t sn)
 	/* clear all interrupt of the socket. */
 	setSn_IR(sn, 0xFF);
 	//A20150401 : Release the sock_io_mode of socket n.
-	sock_io_mode &= ~(1<<sn);
+	sock_io_mode &= ~SOCK_BIT(sn);
 	//
-	sock_is_sending &= ~(1<<sn);
+	sock_is_sending &= ~SOCK_BIT(sn);
 	sock_remained_size[sn] = 0;
 	sock_pack_info[sn] = 0;
 	while(getSn_SR(sn) != SOCK_CLOSED);
@@ -276,7 +298,7 @@ int8_t connect(uint8_t sn, uint8_t * addr, uint16_t port)
 	setSn_DPORT(sn,port);
 	setSn_CR(sn,Sn_CR_CONNECT);
    while(getSn_CR(sn));
-   if(sock_io_mode & (1<<sn)) return SOCK_BUSY;
+   if(sock_io_mode & SOCK_BIT(sn)) return SOCK_BUSY;
    while(getSn_SR(sn) != SOCK_ESTABLISHED)
    {
 		if (getSn_IR(sn) & Sn_IR_TIMEOUT)
@@ -301,8 +323,8 @@ int8_t disconnect(uint8_t sn)
 	setSn_CR(sn,Sn_CR_DISCON);
 	/* wait to process the command... */
 	while(getSn_CR(sn));
-	sock_is_sending &= ~(1<<sn);
-   if(sock_io_mode & (1<<sn)) return SOCK_BUSY;
+	sock_is_sending &= ~SOCK_BIT(sn);
+   if(sock_io_mode & SOCK_BIT(sn)) return SOCK_BUSY;
 	while(getSn_SR(sn) != SOCK_CLOSED)
 	{
 	   if(getSn_IR(sn) & Sn_IR_TIMEOUT)
@@ -324,7 +346,7 @@ int32_t send(uint8_t sn, uint8_t * buf, uint16_t len)
    CHECK_SOCKDATA();
    tmp = getSn_SR(sn);
    if(tmp != SOCK_ESTABLISHED && tmp != SOCK_CLOSE_WAIT) return SOCKERR_SOCKSTATUS;
-   if( sock_is_sending & (1<<sn) )
+   if( sock_is_sending & SOCK_BIT(sn) )
    {
       tmp = getSn_IR(sn);
       if(tmp & Sn_IR_SENDOK)
@@ -340,7 +362,7 @@ int32_t send(uint8_t sn, uint8_t * buf, uint16_t len)
                return SOCK_BUSY;
             }
          #endif
-         sock_is_sending &= ~(1<<sn);         
+         sock_is_sending &= ~SOCK_BIT(sn);         
       }
       else if(tmp & Sn_IR_TIMEOUT)
       {
@@ -360,9 +382,10 @@ int32_t send(uint8_t sn, uint8_t * buf, uint16_t len)
          close(sn);
          return SOCKERR_SOCKSTATUS;
       }
-      if( (sock_io_mode & (1<<sn)) && (len > freesize) ) return SOCK_BUSY;
+      if( (sock_io_mode & SOCK_BIT(sn)) && (len > freesize) ) return SOCK_BUSY;
       if(len <= freesize) break;
    }
+   SOCKBUF_TRACK(getSn_TxMAX(sn) - freesize + len, 0);
    wiz_send_data(sn, buf, len);
    #if _WIZCHIP_ == 5200
       sock_next_rd[sn] = getSn_TX_RD(sn) + len;
@@ -375,13 +398,92 @@ int32_t send(uint8_t sn, uint8_t * buf, uint16_t len)
    setSn_CR(sn,Sn_CR_SEND);
    /* wait to process the command... */
    while(getSn_CR(sn));
-   sock_is_sending |= (1 << sn);
+   sock_is_sending |= SOCK_BIT(sn);
    //M20150409 : Explicit Type Casting
    //return len;
    return (int32_t)len;
 }
 
 
+int32_t sendv(uint8_t sn, wiz_IOVec * iov, uint8_t iovcnt)
+{
+   uint8_t tmp=0;
+   uint8_t i;
+   uint16_t freesize=0;
+   uint16_t len=0, fraglen=0;
+   uint32_t total=0;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   for(i = 0; i < iovcnt; i++) total += iov[i].len;
+   if(total == 0) return SOCKERR_DATALEN;
+   tmp = getSn_SR(sn);
+   if(tmp != SOCK_ESTABLISHED && tmp != SOCK_CLOSE_WAIT) return SOCKERR_SOCKSTATUS;
+   if( sock_is_sending & SOCK_BIT(sn) )
+   {
+      tmp = getSn_IR(sn);
+      if(tmp & Sn_IR_SENDOK)
+      {
+         setSn_IR(sn, Sn_IR_SENDOK);
+         #if _WIZCHIP_ == 5200
+            if(getSn_TX_RD(sn) != sock_next_rd[sn])
+            {
+               setSn_CR(sn,Sn_CR_SEND);
+               while(getSn_CR(sn));
+               return SOCK_BUSY;
+            }
+         #endif
+         sock_is_sending &= ~SOCK_BIT(sn);
+      }
+      else if(tmp & Sn_IR_TIMEOUT)
+      {
+         close(sn);
+         return SOCKERR_TIMEOUT;
+      }
+      else return SOCK_BUSY;
+   }
+   freesize = getSn_TxMAX(sn);
+   // check size not to exceed MAX size. The trailing fragments are truncated.
+   if (total > freesize) len = freesize;
+   else len = (uint16_t)total;
+   while(1)
+   {
+      freesize = getSn_TX_FSR(sn);
+      tmp = getSn_SR(sn);
+      if ((tmp != SOCK_ESTABLISHED) && (tmp != SOCK_CLOSE_WAIT))
+      {
+         close(sn);
+         return SOCKERR_SOCKSTATUS;
+      }
+      if( (sock_io_mode & SOCK_BIT(sn)) && (len > freesize) ) return SOCK_BUSY;
+      if(len <= freesize) break;
+   }
+   SOCKBUF_TRACK(getSn_TxMAX(sn) - freesize + len, 0);
+   // Each fragment advances Sn_TX_WR; the TX ring wrap is handled by wiz_send_data().
+   total = len;
+   for(i = 0; (i < iovcnt) && (total != 0); i++)
+   {
+      fraglen = iov[i].len;
+      if(fraglen > total) fraglen = (uint16_t)total;
+      wiz_send_data(sn, iov[i].buf, fraglen);
+      total -= fraglen;
+   }
+   #if _WIZCHIP_ == 5200
+      sock_next_rd[sn] = getSn_TX_RD(sn) + len;
+   #endif
+
+   #if _WIZCHIP_ == 5300
+      setSn_TX_WRSR(sn,len);
+   #endif
+
+   setSn_CR(sn,Sn_CR_SEND);
+   /* wait to process the command... */
+   while(getSn_CR(sn));
+   sock_is_sending |= SOCK_BIT(sn);
+   return (int32_t)len;
+}
+
+
 int32_t recv(uint8_t sn, uint8_t * buf, uint16_t len)
 {
    uint8_t  tmp = 0;
@@ -427,9 +529,10 @@ int32_t recv(uint8_t sn, uint8_t * buf, uint16_t len)
                return SOCKERR_SOCKSTATUS;
             }
          }
-         if((sock_io_mode & (1<<sn)) && (recvsize == 0)) return SOCK_BUSY;
+         if((sock_io_mode & SOCK_BIT(sn)) && (recvsize == 0)) return SOCK_BUSY;
          if(recvsize != 0) break;
       };
+      SOCKBUF_TRACK(0, recvsize);
 #if _WIZCHIP_ == 5300
    }
 #endif
@@ -486,6 +589,60 @@ int32_t recv(uint8_t sn, uint8_t * buf, uint16_t len)
    return (int32_t)len;
 }
 
+int32_t recvpeek(uint8_t sn, uint8_t * buf, uint16_t len, uint16_t offset)
+{
+#if _WIZCHIP_ == 5300
+   //The W5300 reads its RX buffer through a FIFO, which can't be rewound.
+   return SOCKERR_SOCKMODE;
+#else
+   uint16_t recvsize;
+   uint16_t ptr;
+   uint8_t  tmp;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   CHECK_SOCKDATA();
+
+   tmp = getSn_SR(sn);
+   if(tmp != SOCK_ESTABLISHED && tmp != SOCK_CLOSE_WAIT) return SOCKERR_SOCKSTATUS;
+   recvsize = getSn_RX_RSR(sn);
+   if(recvsize <= offset) return 0;
+   recvsize -= offset;
+   if(recvsize < len) len = recvsize;
+   if(len == 0) return 0;
+   //The data are read without RECV command and the read pointer is put back.
+   ptr = getSn_RX_RD(sn);
+   setSn_RX_RD(sn, (uint16_t)(ptr + offset));
+   wiz_recv_data(sn, buf, len);
+   setSn_RX_RD(sn, ptr);
+   return (int32_t)len;
+#endif
+}
+
+int32_t recvskip(uint8_t sn, uint16_t len)
+{
+#if _WIZCHIP_ == 5300
+   return SOCKERR_SOCKMODE;
+#else
+   uint16_t recvsize;
+   uint8_t  tmp;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   CHECK_SOCKDATA();
+
+   tmp = getSn_SR(sn);
+   if(tmp != SOCK_ESTABLISHED && tmp != SOCK_CLOSE_WAIT) return SOCKERR_SOCKSTATUS;
+   recvsize = getSn_RX_RSR(sn);
+   if(recvsize < len) len = recvsize;
+   if(len == 0) return 0;
+   wiz_recv_ignore(sn, len);
+   setSn_CR(sn,Sn_CR_RECV);
+   while(getSn_CR(sn));
+   return (int32_t)len;
+#endif
+}
+
 int32_t sendto(uint8_t sn, uint8_t * buf, uint16_t len, uint8_t * addr, uint16_t port)
 {
    uint8_t tmp = 0;
@@ -534,9 +691,10 @@ int32_t sendto(uint8_t sn, uint8_t * buf, uint16_t len, uint8_t * addr, uint16_t
    {
       freesize = getSn_TX_FSR(sn);
       if(getSn_SR(sn) == SOCK_CLOSED) return SOCKERR_SOCKCLOSED;
-      if( (sock_io_mode & (1<<sn)) && (len > freesize) ) return SOCK_BUSY;
+      if( (sock_io_mode & SOCK_BIT(sn)) && (len > freesize) ) return SOCK_BUSY;
       if(len <= freesize) break;
    };
+   SOCKBUF_TRACK(getSn_TxMAX(sn) - freesize + len, 0);
 	wiz_send_data(sn, buf, len);
 
    #if _WIZCHIP_ < 5500   //M20150401 : for WIZCHIP Errata #4, #5 (ARP errata)
@@ -630,9 +788,10 @@ int32_t recvfrom(uint8_t sn, uint8_t * buf, uint16_t len, uint8_t * addr, uint16
       {
          pack_len = getSn_RX_RSR(sn);
          if(getSn_SR(sn) == SOCK_CLOSED) return SOCKERR_SOCKCLOSED;
-         if( (sock_io_mode & (1<<sn)) && (pack_len == 0) ) return SOCK_BUSY;
+         if( (sock_io_mode & SOCK_BIT(sn)) && (pack_len == 0) ) return SOCK_BUSY;
          if(pack_len != 0) break;
       };
+      SOCKBUF_TRACK(0, pack_len);
    }
 //D20150601 : Move it to bottom
 // sock_pack_info[sn] = PACK_COMPLETED;
@@ -780,8 +939,8 @@ int8_t  ctlsocket(uint8_t sn, ctlsock_type cstype, void* arg)
    {
       case CS_SET_IOMODE:
          tmp = *((uint8_t*)arg);
-         if(tmp == SOCK_IO_NONBLOCK)  sock_io_mode |= (1<<sn);
-         else if(tmp == SOCK_IO_BLOCK) sock_io_mode &= ~(1<<sn);
+         if(tmp == SOCK_IO_NONBLOCK)  sock_io_mode |= SOCK_BIT(sn);
+         else if(tmp == SOCK_IO_BLOCK) sock_io_mode &= ~SOCK_BIT(sn);
          else return SOCKERR_ARG;
          break;
       case CS_GET_IOMODE:   
@@ -249,6 +249,34 @@ int8_t  disconnect(uint8_t sn);
  */
 int32_t send(uint8_t sn, uint8_t * buf, uint16_t len);
 
+/**
+ * @ingroup DATA_TYPE
+ * @brief One fragment of a scatter-gather buffer list used in @ref sendv().
+ */
+typedef struct wiz_IOVec_t
+{
+   uint8_t * buf;   ///< Pointer to the fragment data
+   uint16_t  len;   ///< The byte length of the fragment
+}wiz_IOVec;
+
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Send several buffers to the connected peer in TCP socket with one SEND command.
+ * @details The fragments are written back to back into the socket TX buffer and then
+ *          a single @ref Sn_CR_SEND is issued, so a header and its payload leave in one segment
+ *          without copying them into a temporary buffer first.
+ * @note    It is valid only in TCP server or client mode. The total length is limited by the socket TX buffer size
+ *          and the trailing fragments are truncated to fit, as in @ref send(). \n
+ *          In block io mode, It doesn't return until the whole length fits in the free TX buffer. \n
+ *          In non-block io mode, It return @ref SOCK_BUSY immediately when socket buffer is not enough. \n
+ * @param sn Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @param iov Array of fragments to be sent in order.
+ * @param iovcnt The number of fragments in iov.
+ * @return	@b Success : The sent data size \n
+ *          @b Fail    : Same as @ref send().
+ */
+int32_t sendv(uint8_t sn, wiz_IOVec * iov, uint8_t iovcnt);
+
 /**
  * @ingroup WIZnet_socket_APIs
  * @brief	Receive data from the connected peer.
@@ -271,6 +299,41 @@ int32_t send(uint8_t sn, uint8_t * buf, uint16_t len);
  */
 int32_t recv(uint8_t sn, uint8_t * buf, uint16_t len);
 
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Copy the received data of a TCP socket without consuming it.
+ * @details The data stay in the socket RX buffer and the next @ref recvpeek() or @ref recv()
+ *          reads them again, so a request can be checked for completeness before it is taken.
+ *          With <I>offset</I>, the copy starts that far into the received data, so a parser
+ *          reads the bytes arrived since its last call only.
+ * @note    It is valid only in TCP server or client mode and never waits, whatever the io mode. \n
+ *          It is not supported by W5300.
+ * @param sn  Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @param buf Pointer buffer to copy the data to.
+ * @param len The max data length of data in buf.
+ * @param offset The received data to pass over, not consumed either.
+ * @return	@b Success : The copied data size, 0 when nothing is received behind <I>offset</I> \n
+ *          @b Fail    :\n
+ *                     @ref SOCKERR_SOCKSTATUS - Invalid socket status for socket operation \n
+ *                     @ref SOCKERR_SOCKMODE   - Invalid operation in the socket \n
+ *                     @ref SOCKERR_SOCKNUM    - Invalid socket number \n
+ *                     @ref SOCKERR_DATALEN    - zero data length
+ */
+int32_t recvpeek(uint8_t sn, uint8_t * buf, uint16_t len, uint16_t offset);
+
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Consume received data of a TCP socket without copying it.
+ * @details It completes a @ref recvpeek() : the first <I>len</I> bytes are released from the socket RX buffer.
+ * @note    It is valid only in TCP server or client mode and never waits, whatever the io mode. \n
+ *          It is not supported by W5300.
+ * @param sn  Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @param len The data length to release.
+ * @return	@b Success : The released data size \n
+ *          @b Fail    : Same as @ref recvpeek().
+ */
+int32_t recvskip(uint8_t sn, uint16_t len);
+
 /**
  * @ingroup WIZnet_socket_APIs
  * @brief	Sends datagram to the peer with destination IP address and port number passed as parameter.
@@ -482,6 +545,44 @@ int8_t  setsockopt(uint8_t sn, sockopt_type sotype, void* arg);
   */
 int8_t  getsockopt(uint8_t sn, sockopt_type sotype, void* arg);
 
+#if _WIZCHIP_IO_POSIX_
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief Wait for the sockets with an interrupt. Valid only with @ref \_WIZCHIP_IO_POSIX_.
+ * @details The POSIX counterpart of the interrupt pin and SIR. It sleeps until a socket has a bit of
+ *          @ref Sn_IR set in its @ref Sn_IMR (@ref CS_SET_INTMASK), and gives the sockets which have.
+ *          The cost is that of the sockets with events, not of all the sockets. \n
+ *          A socket is given again by each call until its interrupt is cleared (@ref CS_CLR_INTERRUPT or @ref setSn_IR()),
+ *          and a socket in @ref SOCK_CLOSED is never given, so the service opens it again when it closes it.
+ * @note Once it is called, the socket events are taken only by it.
+ * @param sn Array to receive the socket numbers.
+ * @param max Size of sn.
+ * @param timeout Time to wait in ms, -1 for ever.
+ * @return The count of sockets given in sn, 0 on timeout.
+ */
+int16_t wizchip_posix_wait(uint8_t* sn, uint16_t max, int32_t timeout);
+
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief Give the calling thread an event loop of its own. Valid only with @ref \_WIZCHIP_IO_POSIX_.
+ * @details The thread gets its own poller, its own list for @ref wizchip_posix_wait() and its own
+ *          listeners. Each thread listening on a port binds a listener of its own with SO_REUSEPORT,
+ *          and the kernel spreads the connections over the threads. \n
+ *          The threads share the socket handles : a handle is used by one thread at a time, the one
+ *          which opened it with @ref socket(). Call @ref wizchip_init() before starting the threads.
+ * @return
+ * - @b Success : @ref SOCK_OK \n
+ * - @b Fail    : @ref SOCKERR_SOCKINIT - No poller
+ */
+int8_t  wizchip_posix_attach(void);
+
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief Release the event loop of @ref wizchip_posix_attach(). Close the sockets of the thread before.
+ */
+void    wizchip_posix_detach(void);
+#endif
+
 #ifdef __cplusplus
  }
 #endif
@@ -162,33 +162,59 @@ _WIZCHIP  WIZCHIP =
 //    .IF.SPI._write_byte  = wizchip_spi_writebyte
       };
 */      
-_WIZCHIP  WIZCHIP =
+#define _WIZCHIP_DEFAULT_                \
+{                                        \
+    _WIZCHIP_IO_MODE_,                   \
+    _WIZCHIP_ID_ ,                       \
+    {                                    \
+        wizchip_cris_enter,              \
+        wizchip_cris_exit                \
+    },                                   \
+    {                                    \
+        wizchip_cs_select,               \
+        wizchip_cs_deselect              \
+    },                                   \
+    {                                    \
+        {                                \
+            wizchip_bus_readdata,        \
+            wizchip_bus_writedata        \
+        },                               \
+    }                                    \
+}
+
+#if _WIZCHIP_INSTANCE_NUM_ > 1
+_WIZCHIP  WIZCHIP_INST[_WIZCHIP_INSTANCE_NUM_] =
 {
-    _WIZCHIP_IO_MODE_,
-    _WIZCHIP_ID_ ,
-    {
-        wizchip_cris_enter,
-        wizchip_cris_exit
-    },
-    {
-        wizchip_cs_select,
-        wizchip_cs_deselect
-    },
-    {
-        {
-            //M20150601 : Rename the function 
-            //wizchip_bus_readbyte,
-            //wizchip_bus_writebyte
-            wizchip_bus_readdata,
-            wizchip_bus_writedata
-        },
-
-    }
+    _WIZCHIP_DEFAULT_,
+    _WIZCHIP_DEFAULT_,
+#if _WIZCHIP_INSTANCE_NUM_ > 2
+    _WIZCHIP_DEFAULT_,
+#endif
+#if _WIZCHIP_INSTANCE_NUM_ > 3
+    _WIZCHIP_DEFAULT_,
+#endif
 };
+uint8_t   WIZCHIP_INST_CUR = 0;
 
+static uint8_t    _DNS_INST_[_WIZCHIP_INSTANCE_NUM_][4];   // DNS server ip address of each instance
+static dhcp_mode  _DHCP_INST_[_WIZCHIP_INSTANCE_NUM_];     // DHCP mode of each instance
+   #define _DNS_     _DNS_INST_[WIZCHIP_INST_CUR]
+   #define _DHCP_    _DHCP_INST_[WIZCHIP_INST_CUR]
+#else
+_WIZCHIP  WIZCHIP = _WIZCHIP_DEFAULT_;
 
 static uint8_t    _DNS_[4];      // DNS server ip address
 static dhcp_mode  _DHCP_;        // DHCP mode
+#endif
+
+int8_t wizchip_inst_select(uint8_t inst)
+{
+   if(inst >= _WIZCHIP_INSTANCE_NUM_) return -1;
+#if _WIZCHIP_INSTANCE_NUM_ > 1
+   WIZCHIP_INST_CUR = inst;
+#endif
+   return 0;
+}
 
 void reg_wizchip_cris_cbfunc(void(*cris_en)(void), void(*cris_ex)(void))
 {
@@ -454,9 +480,9 @@ int8_t wizchip_init(uint8_t* txsize, uint8_t* rxsize)
 #if _WIZCHIP_ < W5200	//2016.10.28 peter add condition for w5100
 			j = 0;
 			while((txsize[i] >> j != 1)&&(txsize[i] !=0)){j++;}
-			setSn_TXBUF_SIZE(i, j);
+			setSn_TXBUF_SIZE(WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, i), j);
 #else
-			setSn_TXBUF_SIZE(i, txsize[i]);
+			setSn_TXBUF_SIZE(WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, i), txsize[i]);
 #endif
 		}	
    }
@@ -488,9 +514,9 @@ int8_t wizchip_init(uint8_t* txsize, uint8_t* rxsize)
 #if _WIZCHIP_ < W5200	// add condition for w5100
 			j = 0;
 			while((rxsize[i] >> j != 1)&&(txsize[i] !=0)){j++;}
-			setSn_RXBUF_SIZE(i, j);
+			setSn_RXBUF_SIZE(WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, i), j);
 #else
-			setSn_RXBUF_SIZE(i, rxsize[i]);
+			setSn_RXBUF_SIZE(WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, i), rxsize[i]);
 #endif
 		}
    }
@@ -523,7 +549,7 @@ void wizchip_clrinterrupt(intr_kind intr)
 //M20200227 : For clear
    //setSIR(sir);
    for(ir=0; ir<8; ir++){
-       if(sir & (0x01 <<ir) ) setSn_IR(ir, 0xff);
+       if(sir & (0x01 <<ir) ) setSn_IR(WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, ir), 0xff);
    }
 
 #endif   
@@ -905,3 +931,213 @@ void wizchip_gettimeout(wiz_NetTimeout* nettime)
    nettime->retry_cnt = getRCR();
    nettime->time_100us = getRTR();
 }
+
+#if _WIZCHIP_ == W5500
+static uint8_t*        _SOCKBUF_POLICY_[2] = {0,0};     // TX, RX policy table
+static wiz_SockBufStat _SOCKBUF_STAT_[_WIZCHIP_SOCK_HANDLE_NUM_];
+
+void wizchip_sockbuf_setpolicy(uint8_t* txpolicy, uint8_t* rxpolicy)
+{
+   _SOCKBUF_POLICY_[0] = txpolicy;
+   _SOCKBUF_POLICY_[1] = rxpolicy;
+}
+
+void wizchip_sockbuf_track(uint8_t sn, uint16_t txused, uint16_t rxused)
+{
+   if(txused > _SOCKBUF_STAT_[sn].tx_hwm) _SOCKBUF_STAT_[sn].tx_hwm = txused;
+   if(rxused > _SOCKBUF_STAT_[sn].rx_hwm) _SOCKBUF_STAT_[sn].rx_hwm = rxused;
+}
+
+void wizchip_sockbuf_sample(void)
+{
+   uint8_t i, sn;
+   for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+   {
+      sn = WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, i);
+      if(getSn_SR(sn) == SOCK_CLOSED) continue;
+      wizchip_sockbuf_track(sn, getSn_TxMAX(sn) - getSn_TX_FSR(sn), getSn_RX_RSR(sn));
+   }
+}
+
+void wizchip_sockbuf_getstat(uint8_t sn, wiz_SockBufStat* stat)
+{
+   stat->tx_hwm = _SOCKBUF_STAT_[sn].tx_hwm;
+   stat->rx_hwm = _SOCKBUF_STAT_[sn].rx_hwm;
+}
+
+/*
+ * Decide the buffer sizes(KB) of one direction.
+ * size : Input the current sizes, output the new sizes.
+ * dir  : 0 - TX, 1 - RX
+ */
+static int8_t wizchip_sockbuf_plan(uint8_t* size, uint8_t* policy, uint8_t dir)
+{
+   uint8_t i, k;
+   uint8_t total = 0;
+   uint8_t sat = 0;        // saturated learned sockets
+   uint8_t learn = 0;      // learned sockets
+   uint16_t limit;
+   uint16_t hwm[_WIZCHIP_SOCK_NUM_];
+   wiz_SockBufStat* stat = &_SOCKBUF_STAT_[WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, 0)];
+
+   for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+   {
+      hwm[i] = dir ? stat[i].rx_hwm : stat[i].tx_hwm;
+      if(policy && (policy[i] != SOCKBUF_LEARN))
+      {
+         if((policy[i] > 16) || (policy[i] & (policy[i] - 1))) return -1;
+         size[i] = policy[i];
+      }
+      else
+      {
+         learn |= (1 << i);
+         limit = (uint16_t)size[i] << 10;
+         // The mark can not pass the size : grow when full, shrink only below half
+         // and to twice the mark, so that a steady load keeps its size.
+         if((size[i] != 0) && (hwm[i] >= limit)) sat |= (1 << i);
+         else if((size[i] == 0) || (hwm[i] < (limit >> 1)))
+         {
+            size[i] = 1;
+            while(((uint16_t)size[i] << 10) < (hwm[i] << 1)) size[i] <<= 1;
+         }
+      }
+      total += size[i];
+   }
+   // Over 16KB : halve the largest learned socket, the idle ones first.
+   while(total > 16)
+   {
+      k = _WIZCHIP_SOCK_NUM_;
+      for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+      {
+         if(!(learn & (1 << i)) || (size[i] <= 1)) continue;
+         if(k == _WIZCHIP_SOCK_NUM_) k = i;
+         else if(((sat >> i) & 1) != ((sat >> k) & 1))
+         {
+            if(!((sat >> i) & 1)) k = i;
+         }
+         else if(size[i] > size[k]) k = i;
+      }
+      if(k == _WIZCHIP_SOCK_NUM_) return -1;
+      size[k] >>= 1;
+      total -= size[k];
+      sat &= ~(1 << k);
+   }
+   // Spare memory : double the saturated sockets, the busiest first.
+   while(sat)
+   {
+      k = _WIZCHIP_SOCK_NUM_;
+      for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+         if((sat & (1 << i)) && ((k == _WIZCHIP_SOCK_NUM_) || (hwm[i] > hwm[k]))) k = i;
+      sat &= ~(1 << k);
+      if((size[k] < 16) && (total + size[k] <= 16))
+      {
+         total += size[k];
+         size[k] <<= 1;
+      }
+   }
+   return 0;
+}
+
+// The marks of the instance start over after a plan, so that they follow the recent traffic.
+static void wizchip_sockbuf_reset(void)
+{
+   uint8_t i, sn;
+   for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+   {
+      sn = WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, i);
+      _SOCKBUF_STAT_[sn].tx_hwm = 0;
+      _SOCKBUF_STAT_[sn].rx_hwm = 0;
+   }
+}
+
+#if !_WIZCHIP_IO_POSIX_
+// A listening socket holds no data. It is closed over the move and opened again with its Sn_MR and Sn_PORT.
+static void wizchip_sockbuf_relisten(uint8_t listening)
+{
+   uint8_t i, sn;
+   for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+   {
+      if(!(listening & (1 << i))) continue;
+      sn = WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, i);
+      setSn_CR(sn, Sn_CR_OPEN);
+      while(getSn_CR(sn));
+      while(getSn_SR(sn) != SOCK_INIT);
+      setSn_CR(sn, Sn_CR_LISTEN);
+      while(getSn_CR(sn));
+   }
+}
+#endif
+
+int8_t wizchip_sockbuf_rebalance(void)
+{
+   uint8_t i, j, sn, sr;
+   uint8_t cur[2][_WIZCHIP_SOCK_NUM_];
+   uint8_t size[2][_WIZCHIP_SOCK_NUM_];
+   uint8_t obase[2] = {0,0};
+   uint8_t nbase[2] = {0,0};
+   uint8_t moved = 0;      // sockets whose buffer moves
+#if !_WIZCHIP_IO_POSIX_
+   uint8_t listening = 0;  // listening sockets closed over the move
+#endif
+
+   for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+   {
+      sn = WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, i);
+      size[0][i] = cur[0][i] = getSn_TXBUF_SIZE(sn);
+      size[1][i] = cur[1][i] = getSn_RXBUF_SIZE(sn);
+   }
+   if(wizchip_sockbuf_plan(size[0], _SOCKBUF_POLICY_[0], 0) != 0) return -1;
+   if(wizchip_sockbuf_plan(size[1], _SOCKBUF_POLICY_[1], 1) != 0) return -1;
+   // The buffers are mapped in order of socket number. Moving or resizing a connected one corrupts its data.
+   for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+   {
+      for(j = 0; j < 2; j++)
+      {
+         if((obase[j] != nbase[j]) || (cur[j][i] != size[j][i])) moved |= (1 << i);
+         obase[j] += cur[j][i];
+         nbase[j] += size[j][i];
+      }
+   }
+   if(!moved)
+   {
+      wizchip_sockbuf_reset();
+      return 0;
+   }
+   for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+   {
+      if(!(moved & (1 << i))) continue;
+      sn = WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, i);
+      sr = getSn_SR(sn);
+   #if !_WIZCHIP_IO_POSIX_
+      if(sr == SOCK_LISTEN)
+      {
+         setSn_CR(sn, Sn_CR_CLOSE);
+         while(getSn_CR(sn));
+         while(getSn_SR(sn) != SOCK_CLOSED);
+         setSn_IR(sn, 0xFF);
+         listening |= (1 << i);
+         continue;
+      }
+      if(sr != SOCK_CLOSED)
+      {
+         // Deferred with the marks kept, the usage of the busy socket counts in the next plan.
+         wizchip_sockbuf_relisten(listening);
+         return 0;
+      }
+   #else
+      if(sr != SOCK_CLOSED) return 0;
+   #endif
+   }
+   for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+   {
+      sn = WIZCHIP_SOCK_HANDLE(WIZCHIP_INST_CUR, i);
+      setSn_TXBUF_SIZE(sn, size[0][i]);
+      setSn_RXBUF_SIZE(sn, size[1][i]);
+   }
+#if !_WIZCHIP_IO_POSIX_
+   wizchip_sockbuf_relisten(listening);
+#endif
+   wizchip_sockbuf_reset();
+   return 1;
+}
+#endif
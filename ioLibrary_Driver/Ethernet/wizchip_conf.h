@@ -217,6 +217,93 @@ extern "C" {
    #define _WIZCHIP_SOCK_NUM_   4   ///< The count of independant socket of @b WIZCHIP
 #endif      
 
+/**
+ * @brief Define the count of WIZCHIP instances.
+ * @todo Define it as 2 ~ 4 to drive several WIZCHIPs on their own chip select. Valid only in W5500. \n
+ *       Each instance has its own callback functions, socket states and network information. \n
+ *       The socket number of the socket APIs and the Sn_ register macros is a socket handle made by
+ *       @ref WIZCHIP_SOCK_HANDLE(). The Sn_ register macros carry the handle in their address, so the
+ *       register access goes to the instance of the socket without selecting it. The socket APIs select
+ *       the instance of the socket on entry for the common registers they read. \n
+ *       reg_wizchip_xxx_cbfunc(), @ref wizchip_init(), @ref ctlwizchip(), @ref ctlnetwork() and
+ *       the common register macros are applied to the instance selected by @ref wizchip_inst_select().
+ */
+#ifndef _WIZCHIP_INSTANCE_NUM_
+#define _WIZCHIP_INSTANCE_NUM_         1
+#endif
+
+#if (_WIZCHIP_INSTANCE_NUM_ > 1) && (_WIZCHIP_ != W5500)
+   #error "_WIZCHIP_INSTANCE_NUM_ over 1 is valid only in W5500."
+#elif (_WIZCHIP_INSTANCE_NUM_ < 1) || (_WIZCHIP_INSTANCE_NUM_ > 4)
+   #error "_WIZCHIP_INSTANCE_NUM_ should be 1 ~ 4."
+#endif
+
+/**
+ * @brief Run the socket APIs on the POSIX sockets of the host.
+ * @todo Define it as 1 to build host/socket_posix.c in place of socket.c and the WIZCHIP driver (w5500.c).
+ *       The socket APIs map onto non-blocking BSD sockets and the Sn_ register macros read the state kept by it,
+ *       so the application code runs unmodified on a Linux gateway. \n
+ *       The common registers are kept in memory for @ref wizchip_init() and @ref ctlnetwork().
+ */
+#ifndef _WIZCHIP_IO_POSIX_
+#define _WIZCHIP_IO_POSIX_             0
+#endif
+
+#if _WIZCHIP_IO_POSIX_
+/**
+ * @brief Define the count of sockets of the POSIX socket APIs.
+ * @todo Define it as 8 ~ 255. The socket number of the socket APIs is uint8_t.
+ */
+   #ifndef _WIZCHIP_POSIX_SOCK_NUM_
+   #define _WIZCHIP_POSIX_SOCK_NUM_    64
+   #endif
+   #if (_WIZCHIP_POSIX_SOCK_NUM_ < _WIZCHIP_SOCK_NUM_) || (_WIZCHIP_POSIX_SOCK_NUM_ > 255)
+      #error "_WIZCHIP_POSIX_SOCK_NUM_ should be 8 ~ 255."
+   #endif
+   #if (_WIZCHIP_ != W5500) || (_WIZCHIP_INSTANCE_NUM_ > 1)
+      #error "_WIZCHIP_IO_POSIX_ is valid only in W5500 with one instance."
+   #endif
+   #define _WIZCHIP_SOCK_HANDLE_NUM_   _WIZCHIP_POSIX_SOCK_NUM_                         ///< The count of socket handles
+#else
+#define _WIZCHIP_SOCK_HANDLE_NUM_      (_WIZCHIP_SOCK_NUM_ * _WIZCHIP_INSTANCE_NUM_)   ///< The count of socket handles of all instances
+#endif
+
+#define WIZCHIP_SOCK_HANDLE(inst, sn)  ((uint8_t)((inst) * _WIZCHIP_SOCK_NUM_ + (sn)))   ///< Socket handle of socket @b sn in instance @b inst
+#define WIZCHIP_SOCK_INST(handle)      ((handle) / _WIZCHIP_SOCK_NUM_)                    ///< Instance of a socket handle
+#define WIZCHIP_SOCK_HWNUM(handle)     ((handle) % _WIZCHIP_SOCK_NUM_)                    ///< Socket number in the chip of a socket handle
+
+/**
+ * @brief Bind the SPI transport at compile time.
+ * @todo Define it as 1 to access WIZCHIP through the static inline functions of "wizchip_spi_port.h"
+ *       supplied by the host, instead of the callback functions registered by reg_wizchip_cs_cbfunc(),
+ *       reg_wizchip_spi_cbfunc() and reg_wizchip_spiburst_cbfunc(). Valid only in W5500 SPI mode. \n
+ *       The header should define wizchip_port_select(), wizchip_port_deselect(), wizchip_port_write(),
+ *       wizchip_port_read(), wizchip_port_write_burst() and wizchip_port_read_burst()
+ *       with the same prototypes as the callback functions.
+ */
+#ifndef _WIZCHIP_SPI_STATIC_
+#define _WIZCHIP_SPI_STATIC_           0
+#endif
+
+#if _WIZCHIP_SPI_STATIC_ && (_WIZCHIP_INSTANCE_NUM_ > 1)
+   #error "_WIZCHIP_SPI_STATIC_ can not select the chip of each instance. Use the callback functions."
+#endif
+
+#if _WIZCHIP_SPI_STATIC_ && _WIZCHIP_IO_POSIX_
+   #error "_WIZCHIP_SPI_STATIC_ is not valid with _WIZCHIP_IO_POSIX_."
+#endif
+
+/**
+ * @brief Enable runtime socket buffer rebalancing.
+ * @todo Define it as 1 to track the TX/RX high-water mark of each socket in @ref send(), @ref sendto(),
+ *       @ref recv() and @ref recvfrom(). \n
+ *       The application calls @ref wizchip_sockbuf_rebalance() periodically, out of the socket APIs. \n
+ *       Valid only in W5500.
+ */
+#ifndef _WIZCHIP_SOCKBUF_REBALANCE_
+#define _WIZCHIP_SOCKBUF_REBALANCE_    0
+#endif
+
 
 /********************************************************
 * WIZCHIP BASIC IF functions for SPI, SDIO, I2C , ETC.
@@ -280,7 +367,14 @@ typedef struct __WIZCHIP
    }IF;
 }_WIZCHIP;
 
+#if _WIZCHIP_INSTANCE_NUM_ > 1
+extern _WIZCHIP  WIZCHIP_INST[_WIZCHIP_INSTANCE_NUM_];
+extern uint8_t   WIZCHIP_INST_CUR;     ///< Index of the selected instance
+   #define WIZCHIP                     WIZCHIP_INST[WIZCHIP_INST_CUR]
+#else
 extern _WIZCHIP  WIZCHIP;
+   #define WIZCHIP_INST_CUR            0
+#endif
 
 /**
  * @ingroup DATA_TYPE
@@ -447,6 +541,24 @@ typedef struct wiz_NetTimeout_t
    uint16_t time_100us;    ///< time unit 100us
 }wiz_NetTimeout;
 
+#if _WIZCHIP_ == W5500
+/**
+ * @ingroup DATA_TYPE
+ *  Buffer usage of a socket observed since the last plan of @ref wizchip_sockbuf_rebalance(). Used in @ref wizchip_sockbuf_getstat().
+ */
+typedef struct wiz_SockBufStat_t
+{
+   uint16_t tx_hwm;        ///< The most bytes held in TX buffer
+   uint16_t rx_hwm;        ///< The most bytes held in RX buffer
+}wiz_SockBufStat;
+
+/**
+ * @brief Policy value of a socket whose buffer size is decided by the observed usage.
+ * @sa wizchip_sockbuf_setpolicy()
+ */
+#define SOCKBUF_LEARN      0xFF
+#endif
+
 /**
  *@brief Registers call back function for critical section of I/O functions such as
  *\ref WIZCHIP_READ, @ref WIZCHIP_WRITE, @ref WIZCHIP_READ_BUF and @ref WIZCHIP_WRITE_BUF.
@@ -499,6 +611,16 @@ void reg_wizchip_spi_cbfunc(uint8_t (*spi_rb)(void), void (*spi_wb)(uint8_t wb))
  */
 void reg_wizchip_spiburst_cbfunc(void (*spi_rb)(uint8_t* pBuf, uint16_t len), void (*spi_wb)(uint8_t* pBuf, uint16_t len));
 
+/**
+ * @ingroup extra_functions
+ * @brief Select the WIZCHIP instance to be configured.
+ * @details The socket APIs select the instance of their socket handle by themselves.
+ * @param inst : Index of instance, 0 ~ @ref \_WIZCHIP_INSTANCE_NUM_ - 1
+ * @return  0 : Success \n
+ *         -1 : Fail because of invalid instance
+ */
+int8_t wizchip_inst_select(uint8_t inst);
+
 /**
  * @ingroup extra_functions
  * @brief Controls to the WIZCHIP.
@@ -649,6 +771,62 @@ void wizchip_settimeout(wiz_NetTimeout* nettime);
  * @param nettime @ref _RTR_ value and @ref _RCR_ value. Refer to @ref wiz_NetTimeout. 
  */
 void wizchip_gettimeout(wiz_NetTimeout* nettime);
+
+#if _WIZCHIP_ == W5500
+/**
+ * @ingroup extra_functions
+ * @brief Set the buffer size policy used by @ref wizchip_sockbuf_rebalance().
+ * @details Each entry is a fixed buffer size in KB(0,1,2,4,8,16) of the socket, or @ref SOCKBUF_LEARN
+ *          to size it from the observed high-water mark.
+ * @param txpolicy TX policy table of @ref \_WIZCHIP_SOCK_NUM_ entries. If null, all sockets are learned.
+ * @param rxpolicy RX policy table of @ref \_WIZCHIP_SOCK_NUM_ entries. If null, all sockets are learned.
+ * @note The tables are referenced, not copied.
+ */
+void wizchip_sockbuf_setpolicy(uint8_t* txpolicy, uint8_t* rxpolicy);
+
+/**
+ * @ingroup extra_functions
+ * @brief Record the buffer usage of a socket.
+ * @details Called by the socket APIs when @ref \_WIZCHIP_SOCKBUF_REBALANCE_ is set.
+ * @param sn Socket number
+ * @param txused Bytes held in TX buffer
+ * @param rxused Bytes held in RX buffer
+ */
+void wizchip_sockbuf_track(uint8_t sn, uint16_t txused, uint16_t rxused);
+
+/**
+ * @ingroup extra_functions
+ * @brief Sample the TX/RX buffer usage of all opened sockets from @ref Sn_TX_FSR and @ref Sn_RX_RSR.
+ */
+void wizchip_sockbuf_sample(void);
+
+/**
+ * @ingroup extra_functions
+ * @brief Get the buffer usage of a socket observed since the last plan of @ref wizchip_sockbuf_rebalance().
+ * @param sn Socket number
+ * @param stat : @ref wiz_SockBufStat
+ */
+void wizchip_sockbuf_getstat(uint8_t sn, wiz_SockBufStat* stat);
+
+/**
+ * @ingroup extra_functions
+ * @brief Re-assign @ref Sn_TXBUF_SIZE and @ref Sn_RXBUF_SIZE from the policy and the observed usage.
+ * @details A saturated learned socket is doubled. One used below half of its size is shrunk
+ *          to twice its high-water mark. Between the two it keeps its size. All of it stays
+ *          within 16KB of each TX and RX memory. \n
+ *          The socket buffers are mapped in order of socket number, so the new sizes are applied
+ *          only if every socket whose buffer size or position changes is closed or listening.
+ *          A listening socket is closed over the move and opened again on its port.
+ *          Otherwise it is deferred to the next call, with the high-water marks kept.
+ *          Once a plan is applied or changes nothing, the marks start over. \n
+ *          Call it periodically from the application, e.g. every several seconds
+ *          after @ref wizchip_sockbuf_sample(). It reads about 4 registers per socket.
+ * @return 1 : Applied the new sizes \n
+ *         0 : No change or deferred \n
+ *        -1 : Invalid policy
+ */
+int8_t wizchip_sockbuf_rebalance(void);
+#endif
 #ifdef __cplusplus
  }
 #endif
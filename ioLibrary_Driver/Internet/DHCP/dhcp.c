@@ -53,6 +53,28 @@
 #include "socket.h"
 #include "dhcp.h"
 
+#if _USE_TIMER_WHEEL_
+#include "timer_wheel.h"
+
+#define DHCP_TIMER_PART		3600UL		// s; a longer wait, as the lease, is armed an hour at a time
+
+static wheel_timer dhcp_timer;			// the wait of an answer or of the lease renewal
+static uint32_t dhcp_timer_left;		// s of the wait past the part armed
+static uint8_t dhcp_expired;
+
+static void dhcp_timer_fn(void* arg)
+{
+	uint32_t part = (dhcp_timer_left > DHCP_TIMER_PART) ? DHCP_TIMER_PART : dhcp_timer_left;
+
+	if(part == 0) {
+		dhcp_expired = 1;
+		return;
+	}
+	dhcp_timer_left -= part;
+	wheel_arm(&dhcp_timer, part * 1000, dhcp_timer_fn, NULL);
+}
+#endif
+
 /* If you want to display debug & processing message, Define _DHCP_DEBUG_ in dhcp.h */
 
 #ifdef _DHCP_DEBUG_
@@ -250,6 +272,10 @@ uint8_t  check_DHCP_timeout(void);
 /* Initialize to timeout process.  */
 void     reset_DHCP_timeout(void);
 
+/* Start a wait of sec seconds, and tell when it is over */
+void     start_DHCP_wait(uint32_t sec);
+uint8_t  is_DHCP_wait_over(void);
+
 /* Parse message as OFFER and ACK and NACK from DHCP server.*/
 int8_t   parseDHCPCMSG(void);
 
@@ -750,6 +776,7 @@ uint8_t DHCP_run(void)
 					// Network info assignment from DHCP
 					dhcp_ip_assign();
 					reset_DHCP_timeout();
+					start_DHCP_wait(dhcp_lease_time / 2);
 
 					dhcp_state = STATE_DHCP_LEASED;
 				} else {
@@ -772,7 +799,7 @@ uint8_t DHCP_run(void)
 
 		case STATE_DHCP_LEASED :
 		   ret = DHCP_IP_LEASED;
-			if ((dhcp_lease_time != INFINITE_LEASETIME) && ((dhcp_lease_time/2) < dhcp_tick_1s)) {
+			if ((dhcp_lease_time != INFINITE_LEASETIME) && is_DHCP_wait_over()) {
 				
 #ifdef _DHCP_DEBUG_
  				printf("> Maintains the IP address \r\n");
@@ -814,6 +841,7 @@ uint8_t DHCP_run(void)
             else printf(">IP is continued.\r\n");
          #endif            				
 				reset_DHCP_timeout();
+				start_DHCP_wait(dhcp_lease_time / 2);
 				dhcp_state = STATE_DHCP_LEASED;
 			} else if (type == DHCP_NAK) {
 
@@ -837,6 +865,9 @@ void    DHCP_stop(void)
 {
    close(DHCP_SOCKET);
    dhcp_state = STATE_DHCP_STOP;
+#if _USE_TIMER_WHEEL_
+   wheel_cancel(&dhcp_timer);
+#endif
 }
 
 uint8_t check_DHCP_timeout(void)
@@ -844,7 +875,7 @@ uint8_t check_DHCP_timeout(void)
 	uint8_t ret = DHCP_RUNNING;
 	
 	if (dhcp_retry_count < MAX_DHCP_RETRY) {
-		if (dhcp_tick_next < dhcp_tick_1s) {
+		if (is_DHCP_wait_over()) {
 
 			switch ( dhcp_state ) {
 				case STATE_DHCP_DISCOVER :
@@ -868,8 +899,7 @@ uint8_t check_DHCP_timeout(void)
 				break;
 			}
 
-			dhcp_tick_1s = 0;
-			dhcp_tick_next = dhcp_tick_1s + DHCP_WAIT_TIME;
+			start_DHCP_wait(DHCP_WAIT_TIME);
 			dhcp_retry_count++;
 		}
 	} else { // timeout occurred
@@ -896,6 +926,9 @@ int8_t check_DHCP_leasedIP(void)
 {
 	uint8_t tmp;
 	int32_t ret;
+#if _USE_TIMER_WHEEL_
+	uint32_t tick;
+#endif
 
 	//WIZchip RCR value changed for ARP Timeout count control
 	tmp = getRCR();
@@ -920,8 +953,13 @@ int8_t check_DHCP_leasedIP(void)
 		// Received ARP reply or etc : IP address conflict occur, DHCP Failed
 		send_DHCP_DECLINE();
 
+#if _USE_TIMER_WHEEL_
+		tick = wheel_now();
+		while((wheel_now() - tick) < 1000) ;   // wait for 1s over; wait to complete to send DECLINE message;
+#else
 		ret = dhcp_tick_1s;
 		while((dhcp_tick_1s - ret) < 2) ;   // wait for 1s over; wait to complete to send DECLINE message;
+#endif
 
 		return 0;
 	}
@@ -964,11 +1002,31 @@ void DHCP_init(uint8_t s, uint8_t * buf)
 /* Reset the DHCP timeout count and retry count. */
 void reset_DHCP_timeout(void)
 {
-	dhcp_tick_1s = 0;
-	dhcp_tick_next = DHCP_WAIT_TIME;
+	start_DHCP_wait(DHCP_WAIT_TIME);
 	dhcp_retry_count = 0;
 }
 
+void start_DHCP_wait(uint32_t sec)
+{
+#if _USE_TIMER_WHEEL_
+	dhcp_expired = 0;
+	dhcp_timer_left = sec;
+	dhcp_timer_fn(NULL);
+#else
+	dhcp_tick_1s = 0;
+	dhcp_tick_next = sec;
+#endif
+}
+
+uint8_t is_DHCP_wait_over(void)
+{
+#if _USE_TIMER_WHEEL_
+	return dhcp_expired;
+#else
+	return (dhcp_tick_next < dhcp_tick_1s);
+#endif
+}
+
 void DHCP_time_handler(void)
 {
 	dhcp_tick_1s++;
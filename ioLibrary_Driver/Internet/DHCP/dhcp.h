@@ -95,6 +95,7 @@ void DHCP_init(uint8_t s, uint8_t * buf);
 /*
  * @brief DHCP 1s Tick Timer handler
  * @note SHOULD BE register to your system 1s Tick timer handler 
+ *       Not needed with _USE_TIMER_WHEEL_: the retries and the lease are timed on the wheel.
  */
 void DHCP_time_handler(void);
 
@@ -55,6 +55,25 @@
 #include "socket.h"
 #include "dns.h"
 
+#if _USE_TIMER_WHEEL_
+#include "timer_wheel.h"
+
+// Armed with each query for DNS_WAIT_TIME, cancelled when the answer comes
+static wheel_timer dns_timer;
+static uint8_t dns_expired;
+
+static void dns_timer_fn(void* arg)
+{
+	dns_expired = 1;
+}
+
+#define DNS_TIMER_START()	do { dns_expired = 0; wheel_arm(&dns_timer, DNS_WAIT_TIME * 1000UL, dns_timer_fn, NULL); } while(0)
+#define DNS_TIMER_STOP()	wheel_cancel(&dns_timer)
+#else
+#define DNS_TIMER_START()	(dns_1s_tick = 0)
+#define DNS_TIMER_STOP()
+#endif
+
 #ifdef _DNS_DEBUG_
    #include <stdio.h>
 #endif
@@ -474,9 +493,12 @@ int16_t dns_makequery(uint16_t op, char * name, uint8_t * buf, uint16_t len)
 int8_t check_DNS_timeout(void)
 {
 
+#if _USE_TIMER_WHEEL_
+	if(dns_expired)
+#else
 	if(dns_1s_tick >= DNS_WAIT_TIME)
+#endif
 	{
-		dns_1s_tick = 0;
 		if(retry_count >= MAX_DNS_RETRY) {
 			retry_count = 0;
 			return -1; // timeout occurred
@@ -505,10 +527,10 @@ int8_t DNS_run(uint8_t * dns_ip, uint8_t * name, uint8_t * ip_from_dns)
 	struct dhdr dhp;
 	uint8_t ip[4];
 	uint16_t len, port;
+	uint16_t query_len;
 	int8_t ret_check_timeout;
 
 	retry_count = 0;
-	dns_1s_tick = 0;
 
    // Socket open
    socket(DNS_SOCKET, Sn_MR_UDP, 0, 0);
@@ -517,8 +539,9 @@ int8_t DNS_run(uint8_t * dns_ip, uint8_t * name, uint8_t * ip_from_dns)
 	printf("> DNS Query to DNS Server : %d.%d.%d.%d\r\n", dns_ip[0], dns_ip[1], dns_ip[2], dns_ip[3]);
 #endif
 
-	len = dns_makequery(0, (char *)name, pDNSMSG, MAX_DNS_BUF_SIZE);
-	sendto(DNS_SOCKET, pDNSMSG, len, dns_ip, IPPORT_DOMAIN);
+	query_len = dns_makequery(0, (char *)name, pDNSMSG, MAX_DNS_BUF_SIZE);
+	sendto(DNS_SOCKET, pDNSMSG, query_len, dns_ip, IPPORT_DOMAIN);
+	DNS_TIMER_START();
 
 	while (1)
 	{
@@ -532,6 +555,10 @@ int8_t DNS_run(uint8_t * dns_ip, uint8_t * name, uint8_t * ip_from_dns)
          ret = parseDNSMSG(&dhp, pDNSMSG, ip_from_dns);
 			break;
 		}
+#if _USE_TIMER_WHEEL_
+		// the main loop waits on this loop
+		wheel_run();
+#endif
 		// Check Timeout
 		ret_check_timeout = check_DNS_timeout();
 		if (ret_check_timeout < 0) {
@@ -539,6 +566,7 @@ int8_t DNS_run(uint8_t * dns_ip, uint8_t * name, uint8_t * ip_from_dns)
 #ifdef _DNS_DEBUG_
 			printf("> DNS Server is not responding : %d.%d.%d.%d\r\n", dns_ip[0], dns_ip[1], dns_ip[2], dns_ip[3]);
 #endif
+			DNS_TIMER_STOP();
 			close(DNS_SOCKET);
 			return 0; // timeout occurred
 		}
@@ -547,9 +575,12 @@ int8_t DNS_run(uint8_t * dns_ip, uint8_t * name, uint8_t * ip_from_dns)
 #ifdef _DNS_DEBUG_
 			printf("> DNS Timeout\r\n");
 #endif
-			sendto(DNS_SOCKET, pDNSMSG, len, dns_ip, IPPORT_DOMAIN);
+			// pDNSMSG still holds the query
+			sendto(DNS_SOCKET, pDNSMSG, query_len, dns_ip, IPPORT_DOMAIN);
+			DNS_TIMER_START();
 		}
 	}
+	DNS_TIMER_STOP();
 	close(DNS_SOCKET);
 	// Return value
 	// 0 > :  failed / 1 - success
@@ -99,6 +99,7 @@ int8_t DNS_run(uint8_t * dns_ip, uint8_t * name, uint8_t * ip_from_dns);
 /*
  * @brief DNS 1s Tick Timer handler
  * @note SHOULD BE register to your system 1s Tick timer handler 
+ *       Not needed with _USE_TIMER_WHEEL_: DNS_run() arms a timer on the wheel for each query.
  */
 void DNS_time_handler(void);
 
@@ -44,14 +44,23 @@
 #include "wizchip_conf.h"
 #include "socket.h"
 
+#if _USE_TIMER_WHEEL_
+#include "timer_wheel.h"
+
+// the millisecond clock of the timer wheel, no tick handler
+#define MilliTimer ((unsigned long)wheel_now())
+#else
 unsigned long MilliTimer;
+#endif
 
 /*
  * @brief MQTT MilliTimer handler
  * @note MUST BE register to your system 1m Tick timer handler.
  */
 void MilliTimer_Handler(void) {
+#if !_USE_TIMER_WHEEL_
 	MilliTimer++;
+#endif
 }
 
 /*
@@ -222,6 +222,7 @@ extern "C" {
 /*
  * @brief MQTT MilliTimer handler
  * @note MUST BE register to your system 1m Tick timer handler
+ *       Not needed with _USE_TIMER_WHEEL_: the timers read wheel_now().
  */
 void MilliTimer_Handler(void);
 
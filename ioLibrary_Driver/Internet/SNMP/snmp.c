@@ -8,6 +8,10 @@
 #include "snmp.h"
 #include "snmp_custom.h"
 
+#if _USE_TIMER_WHEEL_
+#include "timer_wheel.h"
+#endif
+
 /********************************************************************************************/
 /* SNMP : Functions declaration                                                             */
 /********************************************************************************************/
@@ -78,7 +82,11 @@ void SNMP_time_handler(void)
 uint32_t getSNMPTimeTick(void)
 {
 	//return snmp_tick_1ms;
+#if _USE_TIMER_WHEEL_
+	return wheel_now() / 10;
+#else
 	return snmp_tick_10ms;
+#endif
 }
 
 
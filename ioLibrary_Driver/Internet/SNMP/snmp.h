@@ -110,7 +110,7 @@ void snmpd_init(uint8_t * managerIP, uint8_t * agentIP, uint8_t sn_agent, uint8_
 int32_t snmpd_run(void);
 int32_t snmp_sendTrap(uint8_t * managerIP, uint8_t * agentIP, int8_t* community, dataEntryType enterprise_oid, uint32_t genericTrap, uint32_t specificTrap, uint32_t va_count, ...);
 
-// SNMP Time handler functions
+// SNMP Time handler functions (10ms, not needed with _USE_TIMER_WHEEL_: the ticks are read from the wheel clock)
 void SNMP_time_handler(void);
 uint32_t getSNMPTimeTick(void);
 void currentUptime(void *ptr, uint8_t *len);
@@ -11,6 +11,10 @@
 #include "socket.h"
 #include "netutil.h"
 
+#if _USE_TIMER_WHEEL_
+#include "timer_wheel.h"
+#endif
+
 /* define -------------------------------------------------------*/
 
 /* typedef ------------------------------------------------------*/
@@ -52,6 +56,21 @@ uint8_t g_progress_state = TFTP_PROGRESS;
 int dbg_level = (INFO_DBG | ERROR_DBG | IPC_DBG);
 #endif
 
+#if _USE_TIMER_WHEEL_
+static wheel_timer tftp_timer;			// the wait of the answer to the last packet sent
+
+static void tftp_timer_fn(void* arg)
+{
+	tftp_time_cnt = g_timeout;
+}
+
+#define TFTP_TIMER_START()	wheel_arm(&tftp_timer, g_timeout * 1000, tftp_timer_fn, NULL)
+#define TFTP_TIMER_STOP()	wheel_cancel(&tftp_timer)
+#else
+#define TFTP_TIMER_START()
+#define TFTP_TIMER_STOP()
+#endif
+
 /* static function define ---------------------------------------*/
 static void set_filename(uint8_t *file, uint32_t file_size)
 {
@@ -211,6 +230,7 @@ static void init_tftp(void)
 	/* timeout flag */
 	g_resend_flag = 0;
 	tftp_retry_cnt = tftp_time_cnt = 0;
+	TFTP_TIMER_STOP();
 
 	g_progress_state = TFTP_PROGRESS;
 }
@@ -220,6 +240,7 @@ static void tftp_cancel_timeout(void)
 	if(g_resend_flag) {
 		g_resend_flag = 0;
 		tftp_retry_cnt = tftp_time_cnt = 0;
+		TFTP_TIMER_STOP();
 	}
 }
 
@@ -228,6 +249,7 @@ static void tftp_reg_timeout()
 	if(g_resend_flag == 0) {
 		g_resend_flag = 1;
 		tftp_retry_cnt = tftp_time_cnt = 0;
+		TFTP_TIMER_START();
 	}
 }
 
@@ -624,7 +646,8 @@ int TFTP_run(void)
 			if(tftp_retry_cnt >= 5) {
 				init_tftp();
 				g_progress_state = TFTP_FAIL;
-			}
+			} else
+				TFTP_TIMER_START();
 		}
 	}
 
@@ -92,7 +92,7 @@ void TFTP_init(uint8_t socket, uint8_t *buf);
 void TFTP_exit(void);
 int TFTP_run(void);
 void TFTP_read_request(uint32_t server_ip, uint8_t *filename);
-void tftp_timeout_handler(void);
+void tftp_timeout_handler(void);		// 1s tick, not needed with _USE_TIMER_WHEEL_
 
 #ifdef __cplusplus
 }
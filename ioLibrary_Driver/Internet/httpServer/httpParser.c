@@ -5,6 +5,8 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
 #include "socket.h"
 #include "httpParser.h"
 
@@ -19,6 +21,27 @@ uint8_t BUFPUB[256];
  ****************************************************************************/
 static void replacetochar(uint8_t * str, uint8_t oldchar, uint8_t newchar); 	/* Replace old character with new character in the string */
 static uint8_t C2D(uint8_t c); 												/* Convert a character to HEX */
+static uint8_t match_nocase(char * str, char * word);						/* Compare the head of a string regardless of case */
+static uint8_t accept_gzip(char * value);									/* Check the gzip coding in an Accept-Encoding value */
+static void match_word_step(const char * const * words, uint8_t cnt, st_http_parser * parser, uint8_t c);	/* Match the next character of a token */
+static uint8_t match_word_end(const char * const * words, uint8_t cnt, uint16_t cand, uint8_t idx);		/* Find the word matched by a token */
+static void end_of_head(st_http_parser * parser);							/* Frame the body at the end of the header */
+static void copy_value(char * dst, uint8_t * src, uint16_t len);			/* Copy a part of the request as a string */
+static uint8_t has_token(char * value, uint16_t len, char * token);		/* Find a token in a comma separated list */
+static void sha1(uint8_t * data, uint16_t len, uint8_t * digest);			/* SHA-1 digest of the data */
+
+/* Words recognized by the request parser, any case */
+#define HTTP_METHOD_CNT		3
+#define HTTP_VERSION_CNT	2
+static const char * const http_methods[HTTP_METHOD_CNT] = {"GET", "HEAD", "POST"};		/* METHOD_GET... in order */
+static const char * const http_versions[HTTP_VERSION_CNT] = {"HTTP/1.0", "HTTP/1.1"};
+static const char * const http_fields[HTTP_FIELD_CNT] = {"Content-Length", "Connection", "If-None-Match",
+														 "Accept-Encoding", "Range", "Transfer-Encoding", "Upgrade",
+														 "Sec-WebSocket-Key", "Sec-WebSocket-Version",
+														 "Sec-WebSocket-Protocol", "If-Range"};	/* HTTP_FIELD_xxx in order */
+
+/* GUID appended to a Sec-WebSocket-Key by RFC 6455 */
+#define WS_GUID				"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
 
 /**
  @brief	convert escape characters(%XX) to ASCII character
@@ -44,12 +67,15 @@ void unescape_http_url(
  */ 
 void make_http_response_head(
 	char * buf, 	/**< pointer to response header to be made */
+	uint16_t status,	/**< STATUS_OK, or STATUS_PARTIAL for a part of the content */
 	char type, 	/**< response type */
-	uint32_t len	/**< size of response header */
+	uint32_t len,	/**< size of response header */
+	uint8_t keep_alive,	/**< the connection stays open after the response */
+	char * fields	/**< further header fields ended by CRLF each, or NULL */
 	)
 {
 	char * head;
-	char tmp[10];
+	char tmp[11];	// the digits of a uint32_t
 			
 	/*  file type*/
 	if 	(type == PTYPE_HTML) 		head = RES_HTMLHEAD_OK;
@@ -72,17 +98,26 @@ void make_http_response_head(
 #ifdef _HTTPPARSER_DEBUG_
 	else
 	{
-		head = NULL;
+		head = RES_BINHEAD_OK;
 		printf("\r\n\r\n-MAKE HEAD UNKNOWN-\r\n");
 	}
 #else
-	else head = NULL;
+	else head = RES_BINHEAD_OK;
 #endif	
 
-	sprintf(tmp, "%ld", len);
-	strcpy(buf, head);
+	snprintf(tmp, sizeof(tmp), "%lu", (unsigned long)len);
+	if(status == STATUS_PARTIAL)
+	{
+		// Same header under the status line of a part
+		strcpy(buf, RES_PARTIAL_STATUS);
+		strcat(buf, strchr(head, '\n') + 1);
+	}
+	else strcpy(buf, head);
 	strcat(buf, tmp);
-	strcat(buf, "\r\n\r\n");
+	strcat(buf, "\r\n");
+	strcat(buf, keep_alive ? RES_CONNECTION_KEEPALIVE : RES_CONNECTION_CLOSE);
+	if(fields) strcat(buf, fields);
+	strcat(buf, "\r\n");
 }
 
 
@@ -122,48 +157,330 @@ void find_http_uri_type(
 
 
 /**
- @brief	parse http request from a peer
- */ 
-void parse_http_request(
-	st_http_request * request, 	/**< request to be returned */
-	uint8_t * buf				/**< pointer to be parsed */
+ @brief	wait for a new request
+ */
+void init_http_parser(
+	st_http_parser * parser	/**< parser of the connection */
+	)
+{
+	memset(parser, 0, sizeof(st_http_parser));
+	parser->state = HTTP_PARSE_METHOD;
+	parser->cand = (1 << HTTP_METHOD_CNT) - 1;
+}
+
+/**
+ @brief	parse the next bytes of a request
+ @details	The bytes are the continuation of those given before, from offset parser->pos of the request.
+ 			The parser stops at the end of the request; the bytes after it belong to the next one.
+ @return	the number of bytes taken; the request is complete when parser->state is HTTP_PARSE_DONE
+ */
+uint16_t run_http_parser(
+	st_http_parser * parser,	/**< parser of the connection */
+	uint8_t * buf,				/**< bytes received */
+	uint16_t len				/**< number of bytes */
+	)
+{
+	uint16_t i = 0;
+	uint16_t n;
+	uint8_t c;
+	uint8_t f;
+
+	while((i < len) && (parser->state < HTTP_PARSE_DONE))
+	{
+		// The body is only counted
+		if(parser->state == HTTP_PARSE_BODY)
+		{
+			n = parser->head_len + parser->content_len - parser->pos;
+			if(n > len - i) n = len - i;
+			i += n;
+			parser->pos += n;
+			if(parser->pos == parser->head_len + parser->content_len) parser->state = HTTP_PARSE_DONE;
+			continue;
+		}
+
+		c = buf[i++];
+		parser->pos++;
+		switch(parser->state)
+		{
+			case HTTP_PARSE_METHOD :
+				if(c == ' ')
+				{
+					f = match_word_end(http_methods, HTTP_METHOD_CNT, parser->cand, parser->idx);
+					parser->method = (f < HTTP_METHOD_CNT) ? (f + METHOD_GET) : METHOD_ERR;
+					parser->uri = parser->pos;
+					parser->state = HTTP_PARSE_URI;
+				}
+				else if(((c == '\r') || (c == '\n')) && (parser->uri == parser->pos - 1))
+				{
+					// Blank lines ahead of the request line are passed over; uri marks the start of the method till then
+					parser->uri = parser->pos;
+				}
+				else if((c < ' ') || (c >= 0x7f)) parser->state = HTTP_PARSE_ERROR;
+				else match_word_step(http_methods, HTTP_METHOD_CNT, parser, c);
+				break;
+
+			case HTTP_PARSE_URI :
+				if(c == ' ')
+				{
+					parser->uri_len = parser->pos - 1 - parser->uri;
+					if(!parser->uri_len || (parser->uri_len >= MAX_URI_SIZE)) parser->state = HTTP_PARSE_ERROR;
+					else
+					{
+						parser->cand = (1 << HTTP_VERSION_CNT) - 1;
+						parser->idx = 0;
+						parser->state = HTTP_PARSE_VERSION;
+					}
+				}
+				else if((c < ' ') || (c >= 0x7f)) parser->state = HTTP_PARSE_ERROR;
+				break;
+
+			case HTTP_PARSE_VERSION :
+				if((c == '\r') || (c == '\n'))
+				{
+					// HTTP/1.1 is the only version with persistent connections by default
+					parser->version = (match_word_end(http_versions, HTTP_VERSION_CNT, parser->cand, parser->idx) == 1);
+					parser->state = (c == '\r') ? HTTP_PARSE_LINE_LF : HTTP_PARSE_LINE;
+				}
+				else match_word_step(http_versions, HTTP_VERSION_CNT, parser, c);
+				break;
+
+			case HTTP_PARSE_LINE_LF :
+				parser->state = (c == '\n') ? HTTP_PARSE_LINE : HTTP_PARSE_ERROR;
+				break;
+
+			case HTTP_PARSE_LINE :
+				if(c == '\r')
+				{
+					parser->state = HTTP_PARSE_HEAD_LF;
+					break;
+				}
+				if(c == '\n')
+				{
+					end_of_head(parser);
+					break;
+				}
+				parser->cand = (1 << HTTP_FIELD_CNT) - 1;
+				parser->idx = 0;
+				// The character begins the name
+				parser->state = HTTP_PARSE_NAME;
+				/* fall through */
+
+			case HTTP_PARSE_NAME :
+				if(c == ':')
+				{
+					parser->field = match_word_end(http_fields, HTTP_FIELD_CNT, parser->cand, parser->idx);
+					// A second Content-Length could frame the request otherwise than a proxy in front did
+					if((parser->field == HTTP_FIELD_CONTENT_LENGTH) && parser->value[HTTP_FIELD_CONTENT_LENGTH])
+						parser->state = HTTP_PARSE_ERROR;
+					else parser->state = HTTP_PARSE_OWS;
+				}
+				else if((c <= ' ') || (c >= 0x7f)) parser->state = HTTP_PARSE_ERROR;
+				else match_word_step(http_fields, HTTP_FIELD_CNT, parser, c);
+				break;
+
+			case HTTP_PARSE_OWS :
+				if((c == ' ') || (c == '\t')) break;
+				if(parser->field < HTTP_FIELD_CNT) parser->value[parser->field] = parser->pos - 1;
+				// The character begins the value
+				parser->state = HTTP_PARSE_VALUE;
+				/* fall through */
+
+			case HTTP_PARSE_VALUE :
+				if((c == '\r') || (c == '\n'))
+				{
+					if(parser->field < HTTP_FIELD_CNT)
+						parser->value_len[parser->field] = parser->pos - 1 - parser->value[parser->field];
+					parser->state = (c == '\r') ? HTTP_PARSE_LINE_LF : HTTP_PARSE_LINE;
+				}
+				else if(parser->field == HTTP_FIELD_CONTENT_LENGTH)
+				{
+					if((c >= '0') && (c <= '9') && (parser->content_len < 6553))
+						parser->content_len = parser->content_len * 10 + (c - '0');
+					else if((c != ' ') && (c != '\t')) parser->state = HTTP_PARSE_ERROR;
+				}
+				break;
+
+			case HTTP_PARSE_HEAD_LF :
+				if(c == '\n') end_of_head(parser);
+				else parser->state = HTTP_PARSE_ERROR;
+				break;
+
+			default :
+				break;
+		}
+	}
+	return i;
+}
+
+/**
+ @brief	copy out a parsed request
+ @details	A request whose parser didn't reach HTTP_PARSE_DONE is given as METHOD_ERR.
+ */
+void get_http_request(
+	st_http_request * request,	/**< request to be returned */
+	st_http_parser * parser,	/**< parser which has taken the request */
+	uint8_t * buf				/**< the whole request, null terminated */
+	)
+{
+	uint16_t * value = parser->value;
+	uint16_t * value_len = parser->value_len;
+
+	request->TYPE = PTYPE_ERR;
+	request->ACCEPT_GZIP = 0;
+	request->IF_NONE_MATCH[0] = 0;
+	request->RANGE[0] = 0;
+	request->IF_RANGE[0] = 0;
+	request->WS_KEY[0] = 0;
+	request->WS_PROTOCOL = 0;
+	request->URI[0] = 0;
+	request->BODY = request->URI;
+	request->BODY_LEN = 0;
+	if(parser->state != HTTP_PARSE_DONE)
+	{
+		request->METHOD = METHOD_ERR;
+		request->VERSION = 0;
+		request->KEEP_ALIVE = 0;
+		return;
+	}
+	request->METHOD = parser->method;
+	request->VERSION = parser->version;
+
+	/* HTTP/1.1 connections persist unless the client closes them; HTTP/1.0 ones only when asked */
+	request->KEEP_ALIVE = parser->version;
+	if(value[HTTP_FIELD_CONNECTION])
+	{
+		if(match_nocase((char *)buf + value[HTTP_FIELD_CONNECTION], "close")) request->KEEP_ALIVE = 0;
+		else if(match_nocase((char *)buf + value[HTTP_FIELD_CONNECTION], "keep-alive")) request->KEEP_ALIVE = 1;
+	}
+	if(value[HTTP_FIELD_ACCEPT_ENCODING])
+		request->ACCEPT_GZIP = accept_gzip((char *)buf + value[HTTP_FIELD_ACCEPT_ENCODING]);
+	if(value[HTTP_FIELD_IF_NONE_MATCH])
+	{
+		// A longer list is cut
+		copy_value(request->IF_NONE_MATCH, buf + value[HTTP_FIELD_IF_NONE_MATCH],
+				   (value_len[HTTP_FIELD_IF_NONE_MATCH] < MAX_ETAG_LIST_SIZE) ? value_len[HTTP_FIELD_IF_NONE_MATCH] : (MAX_ETAG_LIST_SIZE - 1));
+	}
+	if(value[HTTP_FIELD_RANGE] && (value_len[HTTP_FIELD_RANGE] < MAX_RANGE_SIZE))
+		copy_value(request->RANGE, buf + value[HTTP_FIELD_RANGE], value_len[HTTP_FIELD_RANGE]);
+	if(value[HTTP_FIELD_IF_RANGE])
+	{
+		// A longer value, a date or a list, is kept as "-", which no entity tag matches
+		if(value_len[HTTP_FIELD_IF_RANGE] < MAX_IF_RANGE_SIZE)
+			copy_value(request->IF_RANGE, buf + value[HTTP_FIELD_IF_RANGE], value_len[HTTP_FIELD_IF_RANGE]);
+		else strcpy(request->IF_RANGE, "-");
+	}
+
+	// WebSocket upgrade of RFC 6455, version 13
+	if(value[HTTP_FIELD_UPGRADE] && match_nocase((char *)buf + value[HTTP_FIELD_UPGRADE], "websocket") &&
+	   (value_len[HTTP_FIELD_WS_VERSION] == 2) && !memcmp(buf + value[HTTP_FIELD_WS_VERSION], "13", 2) &&
+	   (value_len[HTTP_FIELD_WS_KEY] == WS_KEY_SIZE - 1))
+	{
+		copy_value(request->WS_KEY, buf + value[HTTP_FIELD_WS_KEY], WS_KEY_SIZE - 1);
+		request->WS_PROTOCOL = (value[HTTP_FIELD_WS_PROTOCOL] &&
+								has_token((char *)buf + value[HTTP_FIELD_WS_PROTOCOL], value_len[HTTP_FIELD_WS_PROTOCOL], WS_SUBPROTOCOL));
+	}
+
+	// The body is kept behind the target; end_of_head() has checked that both fit
+	copy_value((char *)request->URI, buf + parser->uri, parser->uri_len);
+	request->BODY = request->URI + parser->uri_len + 1;
+	request->BODY_LEN = parser->content_len;
+	copy_value((char *)request->BODY, buf + parser->head_len, parser->content_len);
+}
+
+/**
+ @brief	find an entity tag in the value of an If-None-Match field
+ @return	1 when the list is "*" or holds the tag, weak ("W/") or not
+ */
+uint8_t match_http_etag(
+	char * list,	/**< field value, null terminated */
+	char * etag		/**< quoted tag of the content */
+	)
+{
+	while(*list == ' ') list++;
+	if(*list == '*') return 1;
+	return (strstr(list, etag) != NULL);
+}
+
+/**
+ @brief	find the part of a content asked by the value of a Range field
+ @details	Only a single range of bytes is served: "bytes=first-last", "bytes=first-" or "bytes=-suffix".
+ 			Other units, lists of ranges and invalid values are passed over, and the whole content is sent.
+ @return	HTTP_RANGE_OK with the first and the last byte of the part, HTTP_RANGE_NONE, or
+ 			HTTP_RANGE_NOT_SATISF when the part holds no byte of the content
+ */
+uint8_t get_http_range(
+	char * range,		/**< field value, null terminated */
+	uint32_t len,		/**< length of the content */
+	uint32_t * first,	/**< first byte to be returned */
+	uint32_t * last		/**< last byte to be returned */
+	)
+{
+	uint32_t num[2] = {0, 0};
+	uint8_t digits[2] = {0, 0};
+	uint8_t i;
+
+	if(!match_nocase(range, "bytes=")) return HTTP_RANGE_NONE;
+	range += 6;
+	while(*range == ' ' || *range == '\t') range++;
+	for(i = 0; i < 2; i++)
+	{
+		for(; isdigit((unsigned char)*range); range++, digits[i]++)
+		{
+			// Past 32 bits
+			if(num[i] > 429496728UL) return HTTP_RANGE_NONE;
+			num[i] = num[i] * 10 + (*range - '0');
+		}
+		if((i == 0) && (*range++ != '-')) return HTTP_RANGE_NONE;
+	}
+	while(*range == ' ' || *range == '\t') range++;
+	if(*range) return HTTP_RANGE_NONE;
+
+	if(!digits[0])
+	{
+		// The last bytes
+		if(!digits[1]) return HTTP_RANGE_NONE;
+		if(!num[1] || !len) return HTTP_RANGE_NOT_SATISF;
+		*first = (num[1] < len) ? (len - num[1]) : 0;
+		*last = len - 1;
+		return HTTP_RANGE_OK;
+	}
+	if(digits[1] && (num[1] < num[0])) return HTTP_RANGE_NONE;
+	if(num[0] >= len) return HTTP_RANGE_NOT_SATISF;
+	*first = num[0];
+	*last = (digits[1] && (num[1] < len)) ? num[1] : (len - 1);
+	return HTTP_RANGE_OK;
+}
+
+/**
+ @brief	make the Sec-WebSocket-Accept of a Sec-WebSocket-Key
+ @details	base64 of the SHA-1 of the key and the GUID of RFC 6455
+ */
+void make_websocket_accept(
+	char * key,		/**< Sec-WebSocket-Key, null terminated */
+	char * accept	/**< value to be returned, 29 bytes with the null */
 	)
 {
-  char * nexttok;
-  nexttok = strtok((char*)buf," ");
-  if(!nexttok)
-  {
-    request->METHOD = METHOD_ERR;
-    return;
-  }
-  if(!strcmp(nexttok, "GET") || !strcmp(nexttok,"get"))
-  {
-    request->METHOD = METHOD_GET;
-    nexttok = strtok(NULL," ");
-
-  }
-  else if (!strcmp(nexttok, "HEAD") || !strcmp(nexttok,"head"))
-  {
-    request->METHOD = METHOD_HEAD;
-    nexttok = strtok(NULL," ");
-
-  }
-  else if (!strcmp(nexttok, "POST") || !strcmp(nexttok,"post"))
-  {
-    nexttok = strtok(NULL,"\0");
-    request->METHOD = METHOD_POST;
-  }
-  else
-  {
-    request->METHOD = METHOD_ERR;
-  }
-
-  if(!nexttok)
-  {
-    request->METHOD = METHOD_ERR;
-    return;
-  }
-  strcpy((char *)request->URI, nexttok);
+	static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	uint8_t data[WS_KEY_SIZE - 1 + sizeof(WS_GUID) - 1];
+	uint8_t digest[21];
+	uint32_t v;
+	uint8_t i;
+
+	memcpy(data, key, WS_KEY_SIZE - 1);
+	memcpy(data + WS_KEY_SIZE - 1, WS_GUID, sizeof(WS_GUID) - 1);
+	sha1(data, sizeof(data), digest);
+
+	// 20 bytes: 6 groups of 3, and 2 bytes ending with one '='
+	digest[20] = 0;
+	for(i = 0; i < 21; i += 3)
+	{
+		v = ((uint32_t)digest[i] << 16) | ((uint32_t)digest[i + 1] << 8) | digest[i + 2];
+		*accept++ = b64[(v >> 18) & 0x3F];
+		*accept++ = b64[(v >> 12) & 0x3F];
+		*accept++ = b64[(v >> 6) & 0x3F];
+		*accept++ = (i < 18) ? b64[v & 0x3F] : '=';
+	}
+	*accept = '\0';
 }
 
 #ifdef _OLD_
@@ -200,27 +517,19 @@ uint8_t * get_http_param_value(
 #else
 /**
  @brief	get next parameter value in the request
+ @details	The body of the request (st_http_request BODY) holds the parameters, form encoded.
  */
-uint8_t * get_http_param_value(char* uri, char* param_name)
+uint8_t * get_http_param_value(char* body, char* param_name)
 {
 
 	uint8_t * name = 0;
 	uint8_t * ret = BUFPUB;
 	uint8_t * pos2;
-	uint16_t len = 0, content_len = 0;
-	uint8_t tmp_buf[10]={0x00, };
-
-	if(!uri || !param_name) return 0;
+	uint16_t len = 0;
 
-	/***************/
-	mid(uri, "Content-Length: ", "\r\n", (char *)tmp_buf);
-	content_len = ATOI(tmp_buf, 10);
-	uri = strstr(uri, "\r\n\r\n");
-	uri += 4;
-	uri[content_len] = 0;
-	/***************/
+	if(!body || !param_name) return 0;
 
-	if((name = (uint8_t *)strstr(uri, param_name)))
+	if((name = (uint8_t *)strstr(body, param_name)))
 	{
 		name += strlen(param_name) + 1;
 		pos2 = (uint8_t*)strstr((char*)name, "&");
@@ -280,15 +589,18 @@ uint8_t * get_http_uri_name(uint8_t * uri)
 
 uint8_t get_http_uri_name(uint8_t * uri, uint8_t * uri_buf)
 {
-	uint8_t * uri_ptr;
+	uint16_t len;
 	if(!uri) return 0;
 
-	strcpy((char *)uri_buf, (char *)uri);
-
-	uri_ptr = (uint8_t *)strtok((char *)uri_buf, " ?");
-
-	if(strcmp((char *)uri_ptr,"/")) uri_ptr++;
-	strcpy((char *)uri_buf, (char *)uri_ptr);
+	// The name ends at the query; its leading '/' is dropped, but from the root itself
+	len = strcspn((char *)uri, " ?");
+	if(len > 1)
+	{
+		uri++;
+		len--;
+	}
+	memcpy(uri_buf, uri, len);
+	uri_buf[len] = '\0';
 
 #ifdef _HTTPPARSER_DEBUG_
 	printf("  uri_name = %s\r\n", uri_buf);
@@ -398,5 +710,194 @@ static uint8_t C2D(
 	return (char)c;
 }
 
+/**
+@brief	check the gzip coding in the value of an Accept-Encoding field
+@return	1 unless gzip is missing or has a zero quality ("gzip;q=0")
+*/
+static uint8_t accept_gzip(
+		char * value	/**< field value, ended by CRLF */
+	)
+{
+	char * end = value + strcspn(value, "\r\n");
+	char * p;
+
+	for(p = value; (p = strstr(p, "gzip")) && (p < end); p += 4)
+	{
+		if((p > value) && (p[-1] != ' ') && (p[-1] != ',') && (p[-1] != '\t')) continue;
+		p += 4;
+		while(*p == ' ') p++;
+		if(*p++ != ';') return 1;
+		while(*p == ' ') p++;
+		if(!match_nocase(p, "q=0")) return 1;
+		p += 3;
+		if(*p == '.') p++;
+		while(*p == '0') p++;
+		return (*p >= '1' && *p <= '9');
+	}
+	return 0;
+}
+
+/**
+@brief	compare the head of a string with a word regardless of case
+@return	1 when str begins with word
+*/
+static uint8_t match_nocase(
+		char * str,	/**< string to be compared */
+		char * word	/**< word to be found */
+	)
+{
+	for(; *word; str++, word++)
+		if(tolower((unsigned char)*str) != tolower((unsigned char)*word)) return 0;
+	return 1;
+}
+
+/**
+@brief	match the next character of a token against the words still possible
+*/
+static void match_word_step(
+		const char * const * words,	/**< words to be recognized */
+		uint8_t cnt,				/**< number of words */
+		st_http_parser * parser,	/**< parser holding the candidates and the index */
+		uint8_t c					/**< next character of the token */
+	)
+{
+	uint8_t i;
+
+	if(!parser->cand) return;
+	for(i = 0; i < cnt; i++)
+		if((parser->cand & (1 << i)) && (tolower((unsigned char)words[i][parser->idx]) != tolower(c))) parser->cand &= ~(1 << i);
+	parser->idx++;
+}
+
+/**
+@brief	find the word matched by a whole token
+@return	the index of the word, cnt when there is none
+*/
+static uint8_t match_word_end(
+		const char * const * words,	/**< words to be recognized */
+		uint8_t cnt,				/**< number of words */
+		uint16_t cand,				/**< words still matching the token */
+		uint8_t idx					/**< length of the token */
+	)
+{
+	uint8_t i;
+
+	for(i = 0; i < cnt; i++)
+		if((cand & (1 << i)) && !words[i][idx]) return i;
+	return cnt;
+}
+
+/**
+@brief	frame the body of a request at the blank line ending its header
+*/
+static void end_of_head(
+		st_http_parser * parser	/**< parser of the request */
+	)
+{
+	parser->head_len = parser->pos;
+	// The body is kept behind the target in st_http_request
+	if(parser->value[HTTP_FIELD_TRANSFER_ENCODING] || (parser->uri_len + parser->content_len + 2 > MAX_URI_SIZE))
+		parser->state = HTTP_PARSE_ERROR;
+	else parser->state = parser->content_len ? HTTP_PARSE_BODY : HTTP_PARSE_DONE;
+}
+
+/**
+@brief	copy a part of the request as a null terminated string
+*/
+static void copy_value(
+		char * dst,		/**< string to be returned */
+		uint8_t * src,	/**< part of the request */
+		uint16_t len	/**< length of the part */
+	)
+{
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+/**
+@brief	find a token in a comma separated list, regardless of case
+@return	1 when the list holds the token
+*/
+static uint8_t has_token(
+		char * value,	/**< list */
+		uint16_t len,	/**< length of the list */
+		char * token	/**< token to be found */
+	)
+{
+	uint16_t n = strlen(token);
+	uint16_t i = 0;
+
+	while(i < len)
+	{
+		while((i < len) && ((value[i] == ' ') || (value[i] == '\t') || (value[i] == ','))) i++;
+		if((len - i >= n) && match_nocase(value + i, token) &&
+		   ((i + n == len) || (value[i + n] == ',') || (value[i + n] == ' ') || (value[i + n] == '\t'))) return 1;
+		while((i < len) && (value[i] != ',')) i++;
+	}
+	return 0;
+}
+
+static uint32_t rol32(uint32_t x, uint8_t n)
+{
+	return (x << n) | (x >> (32 - n));
+}
+
+/**
+@brief	SHA-1 of 64 bytes, with the message schedule in 16 words
+*/
+static void sha1_block(
+		uint32_t * h,	/**< hash value to be updated */
+		uint8_t * p		/**< block */
+	)
+{
+	uint32_t w[16];
+	uint32_t a, b, c, d, e, f, t;
+	uint8_t i;
 
+	for(i = 0; i < 16; i++)
+		w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) | ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+	a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+	for(i = 0; i < 80; i++)
+	{
+		if(i >= 16) w[i & 15] = rol32(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15], 1);
+		if(i < 20) f = ((b & c) | (~b & d)) + 0x5A827999;
+		else if(i < 40) f = (b ^ c ^ d) + 0x6ED9EBA1;
+		else if(i < 60) f = ((b & c) | (b & d) | (c & d)) + 0x8F1BBCDC;
+		else f = (b ^ c ^ d) + 0xCA62C1D6;
+		t = rol32(a, 5) + f + e + w[i & 15];
+		e = d; d = c; c = rol32(b, 30); b = a; a = t;
+	}
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
 
+/**
+@brief	SHA-1 digest of the data
+*/
+static void sha1(
+		uint8_t * data,		/**< data */
+		uint16_t len,		/**< length of the data */
+		uint8_t * digest	/**< 20 bytes to be returned */
+	)
+{
+	uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+	uint8_t block[64];
+	uint32_t bits = (uint32_t)len * 8;
+	uint16_t n;
+	uint8_t i;
+
+	for(n = len; n >= 64; n -= 64, data += 64) sha1_block(h, data);
+
+	// Padding: 0x80, zeros and the length in bits, over one or two blocks
+	memset(block, 0, sizeof(block));
+	memcpy(block, data, n);
+	block[n] = 0x80;
+	if(n >= 56)
+	{
+		sha1_block(h, block);
+		memset(block, 0, sizeof(block));
+	}
+	for(i = 0; i < 4; i++) block[63 - i] = (uint8_t)(bits >> (8 * i));
+	sha1_block(h, block);
+
+	for(i = 0; i < 20; i++) digest[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+}
@@ -47,10 +47,12 @@ extern "C" {
 
 
 /* HTTP response */
+#define		STATUS_SWITCHING	101
 #define		STATUS_OK			200
 #define		STATUS_CREATED		201
 #define		STATUS_ACCEPTED		202
 #define		STATUS_NO_CONTENT	204
+#define		STATUS_PARTIAL		206
 #define		STATUS_MV_PERM		301
 #define		STATUS_MV_TEMP		302
 #define		STATUS_NOT_MODIF	304
@@ -58,20 +60,60 @@ extern "C" {
 #define		STATUS_UNAUTH		401
 #define		STATUS_FORBIDDEN	403
 #define		STATUS_NOT_FOUND	404
+#define		STATUS_NOT_ACCEPT	406
+#define		STATUS_RANGE_NOT_SATISF	416
 #define		STATUS_INT_SERR		500
 #define		STATUS_NOT_IMPL		501
 #define		STATUS_BAD_GATEWAY	502
 #define		STATUS_SERV_UNAVAIL	503
 
 /* HTML Doc. for ERROR */
-static const char  	ERROR_HTML_PAGE[] = "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nContent-Length: 78\r\n\r\n<HTML>\r\n<BODY>\r\nSorry, the page you requested was not found.\r\n</BODY>\r\n</HTML>\r\n\0";
-static const char 	ERROR_REQUEST_PAGE[] = "HTTP/1.1 400 OK\r\nContent-Type: text/html\r\nContent-Length: 50\r\n\r\n<HTML>\r\n<BODY>\r\nInvalid request.\r\n</BODY>\r\n</HTML>\r\n\0";
+static const char  	ERROR_HTML_PAGE[] = "HTTP/1.1 404 Not Found\r\nContent-Type: text/html\r\nContent-Length: 80\r\n\r\n<HTML>\r\n<BODY>\r\nSorry, the page you requested was not found.\r\n</BODY>\r\n</HTML>\r\n\0";
+static const char 	ERROR_NOT_ACCEPT_PAGE[] = "HTTP/1.1 406 Not Acceptable\r\nContent-Type: text/html\r\nContent-Length: 76\r\n\r\n<HTML>\r\n<BODY>\r\nThe content is only stored gzip encoded.\r\n</BODY>\r\n</HTML>\r\n\0";
+static const char 	ERROR_SERV_UNAVAIL_PAGE[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Type: text/html\r\nContent-Length: 67\r\n\r\n<HTML>\r\n<BODY>\r\nToo many live streams are open.\r\n</BODY>\r\n</HTML>\r\n\0";
+static const char 	ERROR_REQUEST_PAGE[] = "HTTP/1.1 400 Bad Request\r\nContent-Type: text/html\r\nContent-Length: 52\r\n\r\n<HTML>\r\n<BODY>\r\nInvalid request.\r\n</BODY>\r\n</HTML>\r\n\0";
+
+/* Connection header of a response, after its Content-Length */
+#define RES_CONNECTION_KEEPALIVE	"Connection: keep-alive\r\n"
+#define RES_CONNECTION_CLOSE		"Connection: close\r\n"
+
+/* Response head for a conditional GET of an unchanged content; no body follows */
+#define RES_NOT_MODIF_HEAD			"HTTP/1.1 304 Not Modified\r\n"
+
+/* Header fields of a content stored with a gzip variant */
+#define RES_CONTENT_ENCODING_GZIP	"Content-Encoding: gzip\r\n"
+#define RES_VARY_ENCODING			"Vary: Accept-Encoding\r\n"
+
+/* Byte ranges of a stored content: the status line of a part, and the head of a range past its end;
+   Content-Range and the Connection header follow the latter */
+#define RES_ACCEPT_RANGES			"Accept-Ranges: bytes\r\n"
+#define RES_PARTIAL_STATUS			"HTTP/1.1 206 Partial Content\r\n"
+#define RES_RANGE_NOT_SATISF_HEAD	"HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n"
+
+/* Results of get_http_range() */
+#define HTTP_RANGE_NONE				0		/**< the whole content is sent; no range, or one the server passes over */
+#define HTTP_RANGE_OK				1		/**< a part of the content is sent */
+#define HTTP_RANGE_NOT_SATISF		2		/**< the range starts past the end of the content */
+
+/* Response head of a Server-Sent Events stream; the body lasts until the connection closes */
+#define RES_EVENTSHEAD_OK	"HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n"
+
+/* Response head of a WebSocket upgrade; Sec-WebSocket-Accept and the end of the header follow */
+#define RES_WEBSOCKETHEAD	"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
+
+/* WebSocket sub-protocol of the server, confirmed when the client offers it */
+#define WS_SUBPROTOCOL		"modbus"
+#define RES_WS_PROTOCOL		"Sec-WebSocket-Protocol: " WS_SUBPROTOCOL "\r\n"
+
+/* Response head of a streamed CGI; its body is chunked for an HTTP/1.1 client */
+#define RES_CGIHEAD_STREAM		"HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n"
+#define RES_TRANSFER_CHUNKED	"Transfer-Encoding: chunked\r\n"
 
 /* HTML Doc. for CGI result  */
 #define HTML_HEADER "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: "
 
 /* Response header for HTML*/
-#define RES_HTMLHEAD_OK	"HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nConnection: keep-alive\r\nContent-Length: "
+#define RES_HTMLHEAD_OK	"HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: "
 
 /* Response head for TEXT */
 #define RES_TEXTHEAD_OK	"HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: "
@@ -89,7 +131,7 @@ static const char 	ERROR_REQUEST_PAGE[] = "HTTP/1.1 400 OK\r\nContent-Type: text
 #define RES_FLASHHEAD_OK "HTTP/1.1 200 OK\r\nContent-Type: application/x-shockwave-flash\r\nContent-Length: "
 
 /* Response head for XML */
-#define RES_XMLHEAD_OK "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nConnection: keep-alive\r\nContent-Length: "
+#define RES_XMLHEAD_OK "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nContent-Length: "
 
 /* Response head for CSS */
 #define RES_CSSHEAD_OK	"HTTP/1.1 200 OK\r\nContent-Type: text/css\r\nContent-Length: "		
@@ -121,26 +163,99 @@ static const char 	ERROR_REQUEST_PAGE[] = "HTTP/1.1 400 OK\r\nContent-Type: text
 /* Response head for SVG, Font */
 #define RES_SVGHEAD_OK	"HTTP/1.1 200 OK\r\nContent-Type: image/svg+xml\r\nContent-Length: "
 
+/* Response header for the other files, e.g. logs and firmware images */
+#define RES_BINHEAD_OK	"HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: "
+
 /**
  @brief 	Structure of HTTP REQUEST 
  */
 
 //#define MAX_URI_SIZE	1461
 #define MAX_URI_SIZE	512
+#define MAX_ETAG_LIST_SIZE	48			/**< room for the If-None-Match value; a longer list is cut and may miss */
+#define MAX_RANGE_SIZE		32			/**< room for the Range value; a longer one is left out */
+#define MAX_IF_RANGE_SIZE	12			/**< room for an If-Range entity tag; a longer value never matches */
+#define WS_KEY_SIZE			25			/**< Sec-WebSocket-Key, 16 bytes in base64, null terminated */
 
 typedef struct _st_http_request
 {
 	uint8_t	METHOD;						/**< request method(METHOD_GET...). */
 	uint8_t	TYPE;						/**< request type(PTYPE_HTML...).   */
-	uint8_t	URI[MAX_URI_SIZE];			/**< request file name.             */
+	uint8_t	VERSION;					/**< 1 for HTTP/1.1, 0 for HTTP/1.0. */
+	uint8_t	KEEP_ALIVE;					/**< the client keeps the connection open after the response. */
+	uint8_t	ACCEPT_GZIP;				/**< the client takes a gzip encoded body (Accept-Encoding). */
+	char	IF_NONE_MATCH[MAX_ETAG_LIST_SIZE];	/**< entity tags of the client's cached copies, empty for none. */
+	char	RANGE[MAX_RANGE_SIZE];		/**< value of the Range field, empty for none. */
+	char	IF_RANGE[MAX_IF_RANGE_SIZE];	/**< value of the If-Range field, empty for none. */
+	char	WS_KEY[WS_KEY_SIZE];		/**< Sec-WebSocket-Key of a valid WebSocket upgrade, empty for none. */
+	uint8_t	WS_PROTOCOL;				/**< the client offers the WS_SUBPROTOCOL sub-protocol. */
+	uint16_t	BODY_LEN;				/**< length of the request body. */
+	uint8_t *	BODY;					/**< request body, null terminated; it is kept in URI behind the target. */
+	uint8_t	URI[MAX_URI_SIZE];			/**< request target (file name and query), null terminated. */
 }st_http_request;
 
+/* States of the request parser */
+#define		HTTP_PARSE_METHOD	0		/**< request method */
+#define		HTTP_PARSE_URI		1		/**< request target */
+#define		HTTP_PARSE_VERSION	2		/**< protocol version, up to the end of the request line */
+#define		HTTP_PARSE_LINE_LF	3		/**< LF ending a line */
+#define		HTTP_PARSE_LINE		4		/**< start of a header line, or the blank line */
+#define		HTTP_PARSE_NAME		5		/**< header field name */
+#define		HTTP_PARSE_OWS		6		/**< white space before a field value */
+#define		HTTP_PARSE_VALUE	7		/**< field value */
+#define		HTTP_PARSE_HEAD_LF	8		/**< LF of the blank line ending the header */
+#define		HTTP_PARSE_BODY		9		/**< body of Content-Length bytes */
+#define		HTTP_PARSE_DONE		10		/**< the request is complete */
+#define		HTTP_PARSE_ERROR	11		/**< the request is malformed or too large */
+
+/* Header fields taken by the request parser; the others are passed over */
+#define		HTTP_FIELD_CONTENT_LENGTH		0
+#define		HTTP_FIELD_CONNECTION			1
+#define		HTTP_FIELD_IF_NONE_MATCH		2
+#define		HTTP_FIELD_ACCEPT_ENCODING		3
+#define		HTTP_FIELD_RANGE				4
+#define		HTTP_FIELD_TRANSFER_ENCODING	5	/**< a chunked request body isn't supported */
+#define		HTTP_FIELD_UPGRADE				6
+#define		HTTP_FIELD_WS_KEY				7
+#define		HTTP_FIELD_WS_VERSION			8
+#define		HTTP_FIELD_WS_PROTOCOL			9
+#define		HTTP_FIELD_IF_RANGE				10
+#define		HTTP_FIELD_CNT					11
+
+/**
+ @brief 	State of the request parser of a connection
+ @details	The parser takes the bytes of a request as they arrive, in pieces of any size, and reads each
+ 			of them once. It only keeps where the request target and the values of the fields taken lie in
+ 			the request; they are copied out by get_http_request() once the whole request is in a buffer.
+ */
+typedef struct _st_http_parser
+{
+	uint8_t		state;						/**< HTTP_PARSE_xxx */
+	uint8_t		method;						/**< METHOD_xxx of the request line */
+	uint8_t		version;					/**< 1 for HTTP/1.1, 0 for the others */
+	uint8_t		field;						/**< HTTP_FIELD_xxx of the header line, HTTP_FIELD_CNT for the others */
+	uint8_t		idx;						/**< characters of the token matched so far */
+	uint16_t	cand;						/**< words still matching the token, a bit each */
+	uint16_t	pos;						/**< bytes of the request parsed so far */
+	uint16_t	uri;						/**< offset of the request target */
+	uint16_t	uri_len;					/**< length of the request target */
+	uint16_t	value[HTTP_FIELD_CNT];		/**< offset of the value of each field taken, 0 when it is missing */
+	uint16_t	value_len[HTTP_FIELD_CNT];	/**< length of the value of each field taken */
+	uint16_t	head_len;					/**< length of the request line and the header */
+	uint16_t	content_len;				/**< length of the body */
+}st_http_parser;
+
 // HTTP Parsing functions
 void unescape_http_url(char * url);								/* convert escape character to ascii */
-void parse_http_request(st_http_request *, uint8_t *);			/* parse request from peer */
+void init_http_parser(st_http_parser * parser);					/* wait for a new request */
+uint16_t run_http_parser(st_http_parser * parser, uint8_t * buf, uint16_t len);	/* parse the next bytes of a request */
+void get_http_request(st_http_request * request, st_http_parser * parser, uint8_t * buf);	/* copy out a parsed request */
 void find_http_uri_type(uint8_t *, uint8_t *);					/* find MIME type of a file */
-void make_http_response_head(char *, char, uint32_t);			/* make response header */
-uint8_t * get_http_param_value(char* uri, char* param_name);	/* get the user-specific parameter value */
+void make_http_response_head(char *, uint16_t, char, uint32_t, uint8_t, char *);	/* make response header */
+uint8_t match_http_etag(char * list, char * etag);				/* find an entity tag in an If-None-Match list */
+uint8_t get_http_range(char * range, uint32_t len, uint32_t * first, uint32_t * last);	/* find the part asked by a Range value */
+void make_websocket_accept(char * key, char * accept);			/* make the Sec-WebSocket-Accept of a key */
+uint8_t * get_http_param_value(char* body, char* param_name);	/* get the user-specific parameter value */
 uint8_t get_http_uri_name(uint8_t * uri, uint8_t * uri_buf);	/* get the requested URI name */
 #ifdef _OLD_
 uint8_t * get_http_uri_name(uint8_t * uri);
@@ -1,6 +1,6 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
-#include <stdlib.h>
 
 #include "socket.h"
 #include "wizchip_conf.h"
@@ -9,26 +9,115 @@
 #include "httpParser.h"
 #include "httpUtil.h"
 
+#if _USE_TIMER_WHEEL_
+#include "timer_wheel.h"
+#endif
+
 #ifdef	_USE_SDCARD_
 #include "ff.h" 	// header file for FatFs library (FAT file system)
 #endif
 
+#if _USE_MODBUS_EVENTS_ || _USE_WEBSOCKET_
+#include "modbus_store.h"
+
+// Clock of the event rate limit: milliseconds on the timer wheel, else the 1 s tick of the server
+#if _USE_TIMER_WHEEL_
+#define http_events_now()			wheel_now()
+#define HTTP_EVENTS_TICK_MS			1
+#else
+#define http_events_now()			get_httpServer_timecount()
+#define HTTP_EVENTS_TICK_MS			1000
+#endif
+#define HTTP_EVENTS_PERIOD			((HTTP_EVENTS_INTERVAL_MS + HTTP_EVENTS_TICK_MS - 1) / HTTP_EVENTS_TICK_MS)
+#define HTTP_EVENTS_HEARTBEAT		(HTTP_EVENTS_HEARTBEAT_SEC * (1000 / HTTP_EVENTS_TICK_MS))
+
+// Register values last sent on a stream
+typedef struct _st_http_events
+{
+	uint16_t	holding[MODBUS_HOLDING_NUM];
+	uint16_t	input_reg[MODBUS_INPUT_REG_NUM];
+	uint32_t	sent;		// http_events_now() of the last event
+	uint8_t		full;		// The next event lists all the registers
+	uint16_t	close;		// Status code of the WebSocket close frame still to go out, 0 for none
+}st_http_events;
+#endif
+
+#if _USE_WEBSOCKET_
+#if (MODBUS_HOLDING_NUM > HTTP_WS_MAX_REGS) || (MODBUS_INPUT_REG_NUM > HTTP_WS_MAX_REGS)
+#error "An update of the registers doesn't fit a WebSocket frame of 125 bytes"
+#endif
+
+// WebSocket frame
+#define WS_FIN						0x80
+#define WS_MASK						0x80
+#define WS_OP_CONT					0x0
+#define WS_OP_TEXT					0x1
+#define WS_OP_BINARY				0x2
+#define WS_OP_CLOSE					0x8
+#define WS_OP_PING					0x9
+#define WS_OP_PONG					0xA
+#define WS_CLOSE_NORMAL				1000
+#define WS_CLOSE_PROTOCOL			1002
+#define WS_CLOSE_UNSUPPORTED		1003
+#define WS_CLOSE_TOO_BIG			1009
+
+// Messages of the sub-protocol
+#define WS_FC_READ_HOLDING			0x03
+#define WS_FC_READ_INPUT_REG		0x04
+#define WS_FC_WRITE_HOLDING			0x10
+#define WS_FC_EXCEPTION				0x80
+#define WS_EXC_FUNCTION				0x01
+#define WS_EXC_ADDRESS				0x02
+#define WS_EXC_VALUE				0x03
+#define WS_EXC_DEVICE				0x04
+
+#define HTTP_WS_MAX_FRAME			(4 + 6 + 2 * HTTP_WS_MAX_REGS)		// Largest frame sent, the answer of a read
+#define HTTP_WS_MAX_UPDATE			(2 * 8 + 2 * (MODBUS_HOLDING_NUM + MODBUS_INPUT_REG_NUM))	// Update frames of both banks
+#define HTTP_WS_ANSWER				(6 + 125 + 4)						// Offset of an answer in the buffer, behind the frame taken
+#endif
+
 #ifndef DATA_BUF_SIZE
 	#define DATA_BUF_SIZE		2048
 #endif
 
+#if _USE_CGI_STREAM_
+// Streamed CGI of a socket
+typedef struct _st_http_cgi
+{
+	http_cgi_stream	handler;
+	uint32_t		cursor;		// Cursor of the writer, kept across the parts
+	uint8_t			chunked;	// The parts are chunks; else the body ends with the connection
+}st_http_cgi;
+
+#define HTTP_CGI_CHUNK_HEAD			6			// "xxxx\r\n", the length of a chunk in hex
+#define HTTP_CGI_CHUNK_TAIL			(2 + 5)		// "\r\n" ending a chunk, and "0\r\n\r\n" the last chunk
+#endif
+
 /*****************************************************************************
  * Private types/enumerations/variables
  ****************************************************************************/
 static uint8_t HTTPSock_Num[_WIZCHIP_SOCK_NUM_] = {0, };
+static st_http_parser HTTPSock_Parser[_WIZCHIP_SOCK_NUM_];	/**< Request parser of each socket, kept across the received segments */
+#if _USE_MODBUS_EVENTS_ || _USE_WEBSOCKET_
+static st_http_events HTTPSock_Events[_WIZCHIP_SOCK_NUM_];	/**< Server-Sent Events stream or WebSocket updates of each socket */
+#endif
+#if _USE_CGI_STREAM_
+static st_http_cgi HTTPSock_Cgi[_WIZCHIP_SOCK_NUM_];		/**< Streamed CGI of each socket */
+#endif
 static st_http_request * http_request;				/**< Pointer to received HTTP request */
 static st_http_request * parsed_http_request;		/**< Pointer to parsed HTTP request */
 static uint8_t * http_response;						/**< Pointer to HTTP response */
+static uint16_t http_response_head_len = 0;			/**< Length of the response header waiting to go out with the body */
+static uint8_t http_response_head_sock = 0;			/**< Socket the pending response header belongs to */
+#if _USE_TIMER_WHEEL_
+static wheel_timer HTTPSock_Timer[_WIZCHIP_SOCK_NUM_];	/**< Idle timeout of each socket, run out once no longer armed */
+#endif
 
 // ## For Debugging
 //static uint8_t uri_buf[128];
 
-// Number of registered web content in code flash memory
+// Registered web content table in code flash memory, sorted by name
+static const httpServer_webContent * web_content = NULL;
 static uint16_t total_content_cnt = 0;
 /*****************************************************************************
  * Public types/enumerations/variables
@@ -38,11 +127,17 @@ uint8_t * pHTTP_RX;
 
 volatile uint32_t httpServer_tick_1s = 0;
 st_http_socket HTTPSock_Status[_WIZCHIP_SOCK_NUM_] = { {STATE_HTTP_IDLE, }, };
-httpServer_webContent web_content[MAX_CONTENT_CALLBACK];
 
 #ifdef	_USE_SDCARD_
 FIL fs;		// FatFs: File object
 FRESULT fr;	// FatFs: File function return code
+static int8_t fs_owner = -1;	// Socket whose file is open in fs; another one reopens its file at its offset
+#endif
+
+#ifdef _USE_FLASH_
+// Web content of the external data flash, registered by the application
+static uint8_t (*dataflash_find)(uint8_t * name, uint32_t * addr, uint32_t * len) = NULL;
+static void (*dataflash_read)(uint32_t addr, uint8_t * buf, uint16_t len) = NULL;
 #endif
 
 /*****************************************************************************
@@ -52,11 +147,43 @@ void httpServer_Sockinit(uint8_t cnt, uint8_t * socklist);
 static uint8_t getHTTPSocketNum(uint8_t seqnum);
 static int8_t getHTTPSequenceNum(uint8_t socket);
 static int8_t http_disconnect(uint8_t sn);
+static uint16_t make_http_error_page(uint8_t * buf, const char * page, uint8_t keep_alive);
+static uint16_t http_tx_free(uint8_t s);
 
 static void http_process_handler(uint8_t s, st_http_request * p_http_request);
 static void send_http_response_header(uint8_t s, uint8_t content_type, uint32_t body_len, uint16_t http_status);
-static void send_http_response_body(uint8_t s, uint8_t * uri_name, uint8_t * buf, uint32_t start_addr, uint32_t file_len);
+static uint8_t flush_http_response_header(uint8_t s);
+static void send_http_response_body(uint8_t s, uint8_t * uri_name, uint8_t * buf, uint32_t start_addr, uint32_t offset, uint32_t file_len);
+static void end_http_response_body(int8_t seqnum);
+static void start_http_timeout(uint8_t seqnum, uint8_t sec);
+static void stop_http_timeout(uint8_t seqnum);
+static uint8_t http_timed_out(uint8_t seqnum);
+#ifdef _USE_SDCARD_
+static FRESULT open_http_file(int8_t seqnum, uint8_t * name, uint32_t offset);
+#endif
 static void send_http_response_cgi(uint8_t s, uint8_t * buf, uint8_t * http_body, uint16_t file_len);
+static void get_webContent(uint16_t content_num, httpServer_webContent * entry);
+static void make_http_content_fields(char * fields, int8_t seqnum);
+#if _USE_MODBUS_EVENTS_ || _USE_WEBSOCKET_
+static uint8_t count_http_streams(uint8_t sock_status);
+static void commit_http_events(st_http_events * ev, uint16_t * holding, uint16_t * input_reg, uint32_t now);
+#endif
+#if _USE_MODBUS_EVENTS_
+static void start_http_events(uint8_t s, int8_t seqnum, uint8_t method);
+static void send_http_events(uint8_t s, uint8_t seqnum);
+#endif
+#if _USE_WEBSOCKET_
+static void start_http_websocket(uint8_t s, int8_t seqnum, st_http_request * p_http_request);
+static void run_http_websocket(uint8_t s, uint8_t seqnum);
+static void close_http_websocket(uint8_t s, uint8_t seqnum, uint16_t code);
+static uint8_t send_ws_frame(uint8_t s, uint8_t op, uint8_t * payload, uint16_t len);
+static uint16_t run_ws_request(uint8_t * req, uint16_t len, uint8_t * res);
+static uint8_t * put_ws_update(uint8_t * p, uint8_t fc, uint16_t * val, uint16_t * last, uint16_t num, uint8_t full);
+#endif
+#if _USE_CGI_STREAM_
+static void start_http_cgi_stream(uint8_t s, int8_t seqnum, http_cgi_stream handler, st_http_request * p_http_request);
+static uint8_t send_http_cgi_stream(uint8_t s, uint8_t seqnum);
+#endif
 
 /*****************************************************************************
  * Public functions
@@ -75,6 +202,7 @@ void httpServer_Sockinit(uint8_t cnt, uint8_t * socklist)
 	{
 		// Mapping the H/W socket numbers to the sequential index numbers
 		HTTPSock_Num[i] = socklist[i];
+		init_http_parser(&HTTPSock_Parser[i]);
 	}
 }
 
@@ -113,12 +241,35 @@ void reg_httpServer_cbfunc(void(*mcu_reset)(void), void(*wdt_reset)(void))
 	if(wdt_reset) HTTPServer_WDT_Reset = wdt_reset;
 }
 
+#ifdef _USE_FLASH_
+/* Register the web content of the external data flash */
+void reg_httpServer_dataflash(uint8_t(*find)(uint8_t * name, uint32_t * addr, uint32_t * len),
+							  void(*read)(uint32_t addr, uint8_t * buf, uint16_t len))
+{
+	// Both or none; the content of the data flash is looked for after the code flash
+	if(find && read)
+	{
+		dataflash_find = find;
+		dataflash_read = read;
+	}
+	else
+	{
+		dataflash_find = NULL;
+		dataflash_read = NULL;
+	}
+}
+#endif
+
 
 void httpServer_run(uint8_t seqnum)
 {
 	uint8_t s;	// socket number
 	uint16_t len;
-	uint32_t gettime = 0;
+	uint16_t req_len;
+	uint16_t from;
+	int32_t ret;
+	uint8_t next;
+	st_http_parser * parser;
 
 #ifdef _HTTPSERVER_DEBUG_
 	uint8_t destip[4] = {0, };
@@ -139,21 +290,77 @@ void httpServer_run(uint8_t seqnum)
 			if(getSn_IR(s) & Sn_IR_CON)
 			{
 				setSn_IR(s, Sn_IR_CON);
+				// New connection; it is closed when no request comes within the idle timeout
+				HTTPSock_Status[seqnum].requests = 0;
+				start_http_timeout(seqnum, HTTP_KEEPALIVE_TIMEOUT_SEC);
+				HTTPSock_Status[seqnum].sock_status = STATE_HTTP_IDLE;
+				end_http_response_body(seqnum);
+				init_http_parser(&HTTPSock_Parser[seqnum]);
 			}
+			parser = &HTTPSock_Parser[seqnum];
+
+			// The shared buffers hold the header still pending on another socket; this one waits for it to go out
+			if(http_response_head_len && (http_response_head_sock != s)) break;
 
-			// HTTP Process states
-			switch(HTTPSock_Status[seqnum].sock_status)
+			// Pipelined requests are served back to back as long as their responses go out at once
+			do
 			{
+				next = 0;
 
-				case STATE_HTTP_IDLE :
-					if ((len = getSn_RX_RSR(s)) > 0)
-					{
-						if (len > DATA_BUF_SIZE) len = DATA_BUF_SIZE;
-						len = recv(s, (uint8_t *)http_request, len);
+				// HTTP Process states
+				switch(HTTPSock_Status[seqnum].sock_status)
+				{
 
-						*(((uint8_t *)http_request) + len) = '\0';
+					case STATE_HTTP_IDLE :
+						from = parser->pos;
+						// A response only starts when the socket takes its header and first part at once;
+						// the header and the error pages are built in the buffer shared by all sockets
+						if (((len = getSn_RX_RSR(s)) > from) &&
+							(http_tx_free(s) >= ((getSn_TxMAX(s) < DATA_BUF_SIZE) ? getSn_TxMAX(s) : DATA_BUF_SIZE)))
+						{
+							// The request stays in the socket until complete and only the bytes arrived since the
+							// last call are parsed; they are read to their place in the request, so a request
+							// received at once is whole in the buffer
+							len -= from;
+							if (len > DATA_BUF_SIZE - 1 - from) len = DATA_BUF_SIZE - 1 - from;
+							if ((ret = recvpeek(s, (uint8_t *)http_request + from, len, from)) > 0)
+								run_http_parser(parser, (uint8_t *)http_request + from, (uint16_t)ret);
+
+							// A request which can't fit in the buffer is answered 400
+							if((parser->state < HTTP_PARSE_DONE) && (parser->pos >= DATA_BUF_SIZE - 1))
+								parser->state = HTTP_PARSE_ERROR;
+						}
 
-						parse_http_request(parsed_http_request, (uint8_t *)http_request);
+						if(parser->state < HTTP_PARSE_DONE)
+						{
+							if(http_timed_out(seqnum))
+							{
+#ifdef _HTTPSERVER_DEBUG_
+								printf("> HTTPSocket[%d] : Idle timeout\r\n", s);
+#endif
+								http_disconnect(s);
+							}
+							break;
+						}
+
+						// The data after the request stay in the socket for the next one
+						req_len = parser->pos;
+						if(parser->state == HTTP_PARSE_DONE)
+						{
+							if(from) recv(s, (uint8_t *)http_request, req_len);
+							else recvskip(s, req_len);
+							*(((uint8_t *)http_request) + req_len) = '\0';
+						}
+
+						get_http_request(parsed_http_request, parser, (uint8_t *)http_request);
+						init_http_parser(parser);
+						stop_http_timeout(seqnum);
+
+						// The connection persists when the client asks for it, up to HTTP_KEEPALIVE_MAX_REQ requests
+						HTTPSock_Status[seqnum].requests++;
+						HTTPSock_Status[seqnum].keep_alive = parsed_http_request->KEEP_ALIVE &&
+															 (parsed_http_request->METHOD != METHOD_ERR) &&
+															 (HTTPSock_Status[seqnum].requests < HTTP_KEEPALIVE_MAX_REQ);
 #ifdef _HTTPSERVER_DEBUG_
 						getSn_DIPR(s, destip);
 						destport = getSn_DPORT(s);
@@ -167,57 +374,92 @@ void httpServer_run(uint8_t seqnum)
 						// HTTP 'response' handler; includes send_http_response_header / body function
 						http_process_handler(s, parsed_http_request);
 
-						gettime = get_httpServer_timecount();
-						// Check the TX socket buffer for End of HTTP response sends
-						while(getSn_TX_FSR(s) != (getSn_TxMAX(s)))
+						// The rest of the body goes out as the TX buffer frees up, without waiting here
+						if((HTTPSock_Status[seqnum].sock_status == STATE_HTTP_EVENTS) ||
+						   (HTTPSock_Status[seqnum].sock_status == STATE_HTTP_WEBSOCKET)) next = 1;
+						else if(HTTPSock_Status[seqnum].sock_status == STATE_HTTP_CGI) break;
+						else if(HTTPSock_Status[seqnum].file_len > 0) HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_INPROC;
+						else
 						{
-							if((get_httpServer_timecount() - gettime) > 3)
-							{
-#ifdef _HTTPSERVER_DEBUG_
-								printf("> HTTPSocket[%d] : [State] STATE_HTTP_REQ_DONE: TX Buffer clear timeout\r\n", s);
-#endif
-								break;
-							}
+							HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE; // Send the 'HTTP response' end
+							start_http_timeout(seqnum, HTTP_MAX_TIMEOUT_SEC);
+							next = 1;
 						}
+						break;
 
-						if(HTTPSock_Status[seqnum].file_len > 0) HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_INPROC;
-						else HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE; // Send the 'HTTP response' end
-					}
-					break;
-
-				case STATE_HTTP_RES_INPROC :
-					/* Repeat: Send the remain parts of HTTP responses */
+					case STATE_HTTP_RES_INPROC :
+						/* Repeat: Send the remain parts of HTTP responses */
 #ifdef _HTTPSERVER_DEBUG_
-					printf("> HTTPSocket[%d] : [State] STATE_HTTP_RES_INPROC\r\n", s);
+						printf("> HTTPSocket[%d] : [State] STATE_HTTP_RES_INPROC\r\n", s);
 #endif
-					// Repeatedly send remaining data to client
-					send_http_response_body(s, 0, http_response, 0, 0);
+						// Repeatedly send remaining data to client
+						send_http_response_body(s, 0, http_response, 0, 0, 0);
 
-					if(HTTPSock_Status[seqnum].file_len == 0) HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE;
-					break;
+						if(HTTPSock_Status[seqnum].file_len == 0)
+						{
+							HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE;
+							start_http_timeout(seqnum, HTTP_MAX_TIMEOUT_SEC);
+							next = 1;
+						}
+						break;
 
-				case STATE_HTTP_RES_DONE :
+					case STATE_HTTP_RES_DONE :
 #ifdef _HTTPSERVER_DEBUG_
-					printf("> HTTPSocket[%d] : [State] STATE_HTTP_RES_DONE\r\n", s);
+						printf("> HTTPSocket[%d] : [State] STATE_HTTP_RES_DONE\r\n", s);
 #endif
-					// Socket file info structure re-initialize
-					HTTPSock_Status[seqnum].file_len = 0;
-					HTTPSock_Status[seqnum].file_offset = 0;
-					HTTPSock_Status[seqnum].file_start = 0;
-					HTTPSock_Status[seqnum].sock_status = STATE_HTTP_IDLE;
+						// A header the socket didn't take yet goes out first
+						if(!flush_http_response_header(s)) break;
+
+						// A connection to be closed waits until the client has the whole response
+						if(!HTTPSock_Status[seqnum].keep_alive && (getSn_TX_FSR(s) != getSn_TxMAX(s)) &&
+						   !http_timed_out(seqnum)) break;
+
+						// Socket file info structure re-initialize
+						end_http_response_body(seqnum);
+						HTTPSock_Status[seqnum].sock_status = STATE_HTTP_IDLE;
 
-//#ifdef _USE_SDCARD_
-//					f_close(&fs);
-//#endif
 #ifdef _USE_WATCHDOG_
-					HTTPServer_WDT_Reset();
+						HTTPServer_WDT_Reset();
+#endif
+						if(HTTPSock_Status[seqnum].keep_alive)
+						{
+							// Wait for the next request; one already received is served right away
+							start_http_timeout(seqnum, HTTP_KEEPALIVE_TIMEOUT_SEC);
+							next = (getSn_RX_RSR(s) > 0);
+						}
+						else http_disconnect(s);
+						break;
+
+#if _USE_MODBUS_EVENTS_
+					case STATE_HTTP_EVENTS :
+						// The registers are checked on each call; an event goes out at most every HTTP_EVENTS_INTERVAL_MS
+						if(flush_http_response_header(s)) send_http_events(s, seqnum);
+						break;
 #endif
-					http_disconnect(s);
-					break;
 
-				default :
-					break;
-			}
+#if _USE_WEBSOCKET_
+					case STATE_HTTP_WEBSOCKET :
+						// The frames of the client are answered, then the changes of the registers pushed
+						run_http_websocket(s, seqnum);
+						break;
+#endif
+
+#if _USE_CGI_STREAM_
+					case STATE_HTTP_CGI :
+						// The handler is called for the next part once the TX buffer has room for it
+						if(send_http_cgi_stream(s, seqnum))
+						{
+							HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE;
+							start_http_timeout(seqnum, HTTP_MAX_TIMEOUT_SEC);
+							next = 1;
+						}
+						break;
+#endif
+
+					default :
+						break;
+				}
+			} while(next);
 			break;
 
 		case SOCK_CLOSE_WAIT:
@@ -231,6 +473,10 @@ void httpServer_run(uint8_t seqnum)
 #ifdef _HTTPSERVER_DEBUG_
 			printf("> HTTPSocket[%d] : CLOSED\r\n", s);
 #endif
+			HTTPSock_Status[seqnum].sock_status = STATE_HTTP_IDLE;
+			end_http_response_body(seqnum);
+			stop_http_timeout(seqnum);
+			if(http_response_head_sock == s) http_response_head_len = 0;
 			if(socket(s, Sn_MR_TCP, HTTP_SERVER_PORT, 0x00) == s)    /* Reinitialize the socket */
 			{
 #ifdef _HTTPSERVER_DEBUG_
@@ -261,15 +507,24 @@ void httpServer_run(uint8_t seqnum)
 ////////////////////////////////////////////
 static void send_http_response_header(uint8_t s, uint8_t content_type, uint32_t body_len, uint16_t http_status)
 {
+	int8_t get_seqnum = getHTTPSequenceNum(s);
+	char fields[160];
+
 	switch(http_status)
 	{
 		case STATUS_OK: 		// HTTP/1.1 200 OK
+		case STATUS_PARTIAL:	// HTTP/1.1 206 Partial Content
 			if((content_type != PTYPE_CGI) && (content_type != PTYPE_XML)) // CGI/XML type request does not respond HTTP header
 			{
 #ifdef _HTTPSERVER_DEBUG_
 			printf("> HTTPSocket[%d] : HTTP Response Header - STATUS_OK\r\n", s);
 #endif
-				make_http_response_head((char*)http_response, content_type, body_len);
+				make_http_content_fields(fields, get_seqnum);
+				make_http_response_head((char*)http_response, http_status, content_type, body_len, HTTPSock_Status[get_seqnum].keep_alive, fields);
+				// The body follows right away; hold the header so both leave in one segment
+				http_response_head_len = (uint16_t)strlen((char *)http_response);
+				http_response_head_sock = s;
+				http_status = 0;
 			}
 			else
 			{
@@ -280,17 +535,47 @@ static void send_http_response_header(uint8_t s, uint8_t content_type, uint32_t
 				http_status = 0;
 			}
 			break;
+		case STATUS_NOT_MODIF:	// HTTP/1.1 304 Not Modified
+#ifdef _HTTPSERVER_DEBUG_
+			printf("> HTTPSocket[%d] : HTTP Response Header - STATUS_NOT_MODIF\r\n", s);
+#endif
+			// The header alone; the client keeps its cached copy
+			make_http_content_fields(fields, get_seqnum);
+			sprintf((char *)http_response, "%s%s%s\r\n", RES_NOT_MODIF_HEAD,
+					HTTPSock_Status[get_seqnum].keep_alive ? RES_CONNECTION_KEEPALIVE : RES_CONNECTION_CLOSE, fields);
+			break;
 		case STATUS_BAD_REQ: 	// HTTP/1.1 400 OK
 #ifdef _HTTPSERVER_DEBUG_
 			printf("> HTTPSocket[%d] : HTTP Response Header - STATUS_BAD_REQ\r\n", s);
 #endif
-			memcpy(http_response, ERROR_REQUEST_PAGE, sizeof(ERROR_REQUEST_PAGE));
+			make_http_error_page(http_response, ERROR_REQUEST_PAGE, 0);
 			break;
 		case STATUS_NOT_FOUND:	// HTTP/1.1 404 Not Found
 #ifdef _HTTPSERVER_DEBUG_
 			printf("> HTTPSocket[%d] : HTTP Response Header - STATUS_NOT_FOUND\r\n", s);
 #endif
-			memcpy(http_response, ERROR_HTML_PAGE, sizeof(ERROR_HTML_PAGE));
+			make_http_error_page(http_response, ERROR_HTML_PAGE, HTTPSock_Status[get_seqnum].keep_alive);
+			break;
+		case STATUS_NOT_ACCEPT:	// HTTP/1.1 406 Not Acceptable
+#ifdef _HTTPSERVER_DEBUG_
+			printf("> HTTPSocket[%d] : HTTP Response Header - STATUS_NOT_ACCEPT\r\n", s);
+#endif
+			make_http_error_page(http_response, ERROR_NOT_ACCEPT_PAGE, HTTPSock_Status[get_seqnum].keep_alive);
+			break;
+		case STATUS_RANGE_NOT_SATISF:	// HTTP/1.1 416 Range Not Satisfiable
+#ifdef _HTTPSERVER_DEBUG_
+			printf("> HTTPSocket[%d] : HTTP Response Header - STATUS_RANGE_NOT_SATISF\r\n", s);
+#endif
+			// No body; Content-Range gives the length of the content
+			sprintf((char *)http_response, "%sContent-Range: bytes */%lu\r\n%s\r\n", RES_RANGE_NOT_SATISF_HEAD,
+					(unsigned long)HTTPSock_Status[get_seqnum].range_total,
+					HTTPSock_Status[get_seqnum].keep_alive ? RES_CONNECTION_KEEPALIVE : RES_CONNECTION_CLOSE);
+			break;
+		case STATUS_SERV_UNAVAIL:	// HTTP/1.1 503 Service Unavailable
+#ifdef _HTTPSERVER_DEBUG_
+			printf("> HTTPSocket[%d] : HTTP Response Header - STATUS_SERV_UNAVAIL\r\n", s);
+#endif
+			make_http_error_page(http_response, ERROR_SERV_UNAVAIL_PAGE, HTTPSock_Status[get_seqnum].keep_alive);
 			break;
 		default:
 			break;
@@ -306,102 +591,111 @@ static void send_http_response_header(uint8_t s, uint8_t content_type, uint32_t
 	}
 }
 
-static void send_http_response_body(uint8_t s, uint8_t * uri_name, uint8_t * buf, uint32_t start_addr, uint32_t file_len)
+// Send the pending HTTP Response 'header' on its own; 0 while the socket is busy and the header still pending
+static uint8_t flush_http_response_header(uint8_t s)
+{
+	if(http_response_head_len)
+	{
+#ifdef _HTTPSERVER_DEBUG_
+		printf("> HTTPSocket[%d] : [Send] HTTP Response Header [ %d ]byte\r\n", s, http_response_head_len);
+#endif
+		if(send(s, http_response, http_response_head_len) == SOCK_BUSY) return 0;
+		http_response_head_len = 0;
+	}
+	return 1;
+}
+
+// Send the bytes from offset up to file_len of a content, as much as the socket takes on each call
+static void send_http_response_body(uint8_t s, uint8_t * uri_name, uint8_t * buf, uint32_t start_addr, uint32_t offset, uint32_t file_len)
 {
 	int8_t get_seqnum;
+	int32_t ret;
 	uint32_t send_len;
+	uint32_t remain_len;
+	uint16_t tx_free;
+	uint8_t * body = buf;
+	wiz_IOVec http_iov[2];
+	uint8_t iovcnt = 0;
 
 	uint8_t flag_datasend_end = 0;
 
 #ifdef _USE_SDCARD_
-	uint16_t blocklen;
-#endif
-#ifdef _USE_FLASH_
-	uint32_t addr = 0;
+	UINT blocklen;
 #endif
 
-	if((get_seqnum = getHTTPSequenceNum(s)) == -1) return; // exception handling; invalid number
+	if((get_seqnum = getHTTPSequenceNum(s)) == -1) // exception handling; invalid number
+	{
+		flush_http_response_header(s);
+		return;
+	}
 
 	// Send the HTTP Response 'body'; requested file
 	if(!HTTPSock_Status[get_seqnum].file_len) // ### Send HTTP response body: First part ###
 	{
-		if (file_len > DATA_BUF_SIZE - 1)
-		{
-			HTTPSock_Status[get_seqnum].file_start = start_addr;
-			HTTPSock_Status[get_seqnum].file_len = file_len;
-			send_len = DATA_BUF_SIZE - 1;
+		HTTPSock_Status[get_seqnum].file_start = start_addr;
+		HTTPSock_Status[get_seqnum].file_len = file_len;
+		HTTPSock_Status[get_seqnum].file_offset = offset;
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 // ## 20141219 Eric added, for 'File object structure' (fs) allocation reduced (8 -> 1)
-			memset(HTTPSock_Status[get_seqnum].file_name, 0x00, MAX_CONTENT_NAME_LEN);
-			strcpy((char *)HTTPSock_Status[get_seqnum].file_name, (char *)uri_name);
+		memset(HTTPSock_Status[get_seqnum].file_name, 0x00, MAX_CONTENT_NAME_LEN);
+		strcpy((char *)HTTPSock_Status[get_seqnum].file_name, (char *)uri_name);
 #ifdef _HTTPSERVER_DEBUG_
-			printf("> HTTPSocket[%d] : HTTP Response body - file name [ %s ]\r\n", s, HTTPSock_Status[get_seqnum].file_name);
+		printf("> HTTPSocket[%d] : HTTP Response body - file name [ %s ]\r\n", s, HTTPSock_Status[get_seqnum].file_name);
 #endif
 /////////////////////////////////////////////////////////////////////////////////////////////////
 
 #ifdef _HTTPSERVER_DEBUG_
-			printf("> HTTPSocket[%d] : HTTP Response body - file len [ %ld ]byte\r\n", s, file_len);
-#endif
-		}
-		else
-		{
-			// Send process end
-			send_len = file_len;
-
-#ifdef _HTTPSERVER_DEBUG_
-			printf("> HTTPSocket[%d] : HTTP Response end - file len [ %ld ]byte\r\n", s, send_len);
-#endif
-		}
-#ifdef _USE_FLASH_
-		if(HTTPSock_Status[get_seqnum]->storage_type == DATAFLASH) addr = start_addr;
+		printf("> HTTPSocket[%d] : HTTP Response body - file len [ %lu ]byte from [ %lu ]\r\n", s, (unsigned long)file_len, (unsigned long)offset);
 #endif
 	}
-	else // remained parts
-	{
-#ifdef _USE_FLASH_
-		if(HTTPSock_Status[get_seqnum]->storage_type == DATAFLASH)
-		{
-			addr = HTTPSock_Status[get_seqnum].file_start + HTTPSock_Status[get_seqnum].file_offset;
-		}
-#endif
-		send_len = HTTPSock_Status[get_seqnum].file_len - HTTPSock_Status[get_seqnum].file_offset;
 
-		if(send_len > DATA_BUF_SIZE - 1)
-		{
-			send_len = DATA_BUF_SIZE - 1;
-			//HTTPSock_Status[get_seqnum]->file_offset += send_len;
-		}
-		else
-		{
-#ifdef _HTTPSERVER_DEBUG_
-			printf("> HTTPSocket[%d] : HTTP Response end - file len [ %ld ]byte\r\n", s, HTTPSock_Status[get_seqnum].file_len);
-#endif
-			// Send process end
-			flag_datasend_end = 1;
-		}
-#ifdef _HTTPSERVER_DEBUG_
-			printf("> HTTPSocket[%d] : HTTP Response body - send len [ %ld ]byte\r\n", s, send_len);
-#endif
-	}
+	// Only what the socket TX buffer takes now is sent; the next calls send the rest
+	remain_len = HTTPSock_Status[get_seqnum].file_len - HTTPSock_Status[get_seqnum].file_offset;
+	tx_free = http_tx_free(s);
+	tx_free = (tx_free > http_response_head_len) ? (tx_free - http_response_head_len) : 0;
+	send_len = (remain_len > tx_free) ? tx_free : remain_len;
+
+	// Without a pending header, wait for a quarter of the TX buffer rather than sending small parts
+	if(!http_response_head_len && (send_len < remain_len) && (send_len < getSn_TxMAX(s) / 4)) return;
+
+	// The copied storages read the part behind the pending header in buf
+	if((!WEB_CONTENT_MAPPED || (HTTPSock_Status[get_seqnum].storage_type != CODEFLASH)) &&
+	   (send_len > DATA_BUF_SIZE - 1 - http_response_head_len))
+		send_len = DATA_BUF_SIZE - 1 - http_response_head_len;
 
 /*****************************************************/
-	//HTTPSock_Status[get_seqnum]->storage_type == NONE
-	//HTTPSock_Status[get_seqnum]->storage_type == CODEFLASH
-	//HTTPSock_Status[get_seqnum]->storage_type == SDCARD
-	//HTTPSock_Status[get_seqnum]->storage_type == DATAFLASH
+	//HTTPSock_Status[get_seqnum].storage_type == NONE
+	//HTTPSock_Status[get_seqnum].storage_type == CODEFLASH
+	//HTTPSock_Status[get_seqnum].storage_type == SDCARD
+	//HTTPSock_Status[get_seqnum].storage_type == DATAFLASH
 /*****************************************************/
 
 	if(HTTPSock_Status[get_seqnum].storage_type == CODEFLASH)
 	{
-		if(HTTPSock_Status[get_seqnum].file_len) start_addr = HTTPSock_Status[get_seqnum].file_start;
-		read_userReg_webContent(start_addr, &buf[0], HTTPSock_Status[get_seqnum].file_offset, send_len);
+#if WEB_CONTENT_MAPPED
+		// Registered content is already in memory; send it in place instead of copying it to buf
+		httpServer_webContent entry;
+
+		get_webContent((uint16_t)HTTPSock_Status[get_seqnum].file_start, &entry);
+		body = (uint8_t *)entry.content + HTTPSock_Status[get_seqnum].file_offset;
+#else
+		body = buf + http_response_head_len;
+		send_len = read_userReg_webContent((uint16_t)HTTPSock_Status[get_seqnum].file_start, body,
+										   HTTPSock_Status[get_seqnum].file_offset, (uint16_t)send_len);
+#endif
 	}
 #ifdef _USE_SDCARD_
 	else if(HTTPSock_Status[get_seqnum].storage_type == SDCARD)
 	{
-		// Data read from SD Card
-		fr = f_read(&fs, &buf[0], send_len, (void *)&blocklen);
+		body = buf + http_response_head_len;
+		// Data read from SD Card; the file of another socket may have taken fs meanwhile
+		if(fs_owner != get_seqnum)
+			fr = open_http_file(get_seqnum, HTTPSock_Status[get_seqnum].file_name, HTTPSock_Status[get_seqnum].file_offset);
+		else if(f_tell(&fs) != HTTPSock_Status[get_seqnum].file_offset)
+			fr = f_lseek(&fs, HTTPSock_Status[get_seqnum].file_offset);
+		else fr = FR_OK;
+		if(fr == FR_OK) fr = f_read(&fs, body, send_len, &blocklen);
 		if(fr != FR_OK)
 		{
 			send_len = 0;
@@ -409,19 +703,16 @@ static void send_http_response_body(uint8_t s, uint8_t * uri_name, uint8_t * buf
 		printf("> HTTPSocket[%d] : [FatFs] Error code return: %d (File Read) / HTTP Send Failed - %s\r\n", s, fr, HTTPSock_Status[get_seqnum].file_name);
 #endif
 		}
-		else
-		{
-			*(buf+send_len+1) = 0; // Insert '/0' for indicates the 'End of String' (null terminated)
-		}
+		else send_len = blocklen;
 	}
 #endif
 
 #ifdef _USE_FLASH_
-	else if(HTTPSock_Status[get_seqnum]->storage_type == DATAFLASH)
+	else if(HTTPSock_Status[get_seqnum].storage_type == DATAFLASH)
 	{
+		body = buf + http_response_head_len;
 		// Data read from external data flash memory
-		read_from_flashbuf(addr, &buf[0], send_len);
-		*(buf+send_len+1) = 0; // Insert '/0' for indicates the 'End of String' (null terminated)
+		dataflash_read(HTTPSock_Status[get_seqnum].file_start + HTTPSock_Status[get_seqnum].file_offset, body, (uint16_t)send_len);
 	}
 #endif
 	else
@@ -430,47 +721,110 @@ static void send_http_response_body(uint8_t s, uint8_t * uri_name, uint8_t * buf
 	}
 	// Requested content send to HTTP client
 #ifdef _HTTPSERVER_DEBUG_
-	printf("> HTTPSocket[%d] : [Send] HTTP Response body [ %ld ]byte\r\n", s, send_len);
+	printf("> HTTPSocket[%d] : [Send] HTTP Response body [ %lu ]byte\r\n", s, (unsigned long)send_len);
 #endif
 
-	if(send_len) send(s, buf, send_len);
+	// Pending header and body go out with a single SEND command
+	if(http_response_head_len)
+	{
+		http_iov[iovcnt].buf = http_response;
+		http_iov[iovcnt].len = http_response_head_len;
+		iovcnt++;
+	}
+	if(send_len)
+	{
+		http_iov[iovcnt].buf = body;
+		http_iov[iovcnt].len = (uint16_t)send_len;
+		iovcnt++;
+	}
 	else flag_datasend_end = 1;
 
-	if(flag_datasend_end)
+	if(iovcnt)
 	{
-		HTTPSock_Status[get_seqnum].file_start = 0;
-		HTTPSock_Status[get_seqnum].file_len = 0;
-		HTTPSock_Status[get_seqnum].file_offset = 0;
-		flag_datasend_end = 0;
+		ret = sendv(s, http_iov, iovcnt);
+		if(ret < 0)
+		{
+			// The socket is closed or lost; the response ends here
+#ifdef _HTTPSERVER_DEBUG_
+			printf("> HTTPSocket[%d] : [Send] HTTP Response failed [ %ld ]\r\n", s, (long)ret);
+#endif
+			flag_datasend_end = 1;
+		}
+		else if(ret == SOCK_BUSY)
+		{
+			// Nothing went out; the header stays pending and the same part is sent on the next call
+			return;
+		}
+		else HTTPSock_Status[get_seqnum].file_offset += ret - http_response_head_len;
+		http_response_head_len = 0;
 	}
-	else
+
+	if(flag_datasend_end || (HTTPSock_Status[get_seqnum].file_offset >= HTTPSock_Status[get_seqnum].file_len))
 	{
-		HTTPSock_Status[get_seqnum].file_offset += send_len;
 #ifdef _HTTPSERVER_DEBUG_
-		printf("> HTTPSocket[%d] : HTTP Response body - offset [ %ld ]\r\n", s, HTTPSock_Status[get_seqnum].file_offset);
+		printf("> HTTPSocket[%d] : HTTP Response end - file len [ %lu ]byte\r\n", s, (unsigned long)HTTPSock_Status[get_seqnum].file_len);
 #endif
+		end_http_response_body(get_seqnum);
+		flag_datasend_end = 0;
 	}
+#ifdef _HTTPSERVER_DEBUG_
+	else printf("> HTTPSocket[%d] : HTTP Response body - offset [ %lu ]\r\n", s, (unsigned long)HTTPSock_Status[get_seqnum].file_offset);
+#endif
+}
 
+// Forget the content of a response, sent or cut short
+static void end_http_response_body(int8_t seqnum)
+{
+	HTTPSock_Status[seqnum].file_start = 0;
+	HTTPSock_Status[seqnum].file_len = 0;
+	HTTPSock_Status[seqnum].file_offset = 0;
 // ## 20141219 Eric added, for 'File object structure' (fs) allocation reduced (8 -> 1)
 #ifdef _USE_SDCARD_
-	f_close(&fs);
+	if(fs_owner == seqnum)
+	{
+		f_close(&fs);
+		fs_owner = -1;
+	}
 #endif
-// ## 20141219 added end
 }
 
+#ifdef _USE_SDCARD_
+// Open a file at an offset in the file object shared by the sockets
+static FRESULT open_http_file(int8_t seqnum, uint8_t * name, uint32_t offset)
+{
+	if(fs_owner >= 0) f_close(&fs);
+	fs_owner = -1;
+	if((fr = f_open(&fs, (const char *)name, FA_READ)) != FR_OK) return fr;
+	if(offset && ((fr = f_lseek(&fs, offset)) != FR_OK))
+	{
+		f_close(&fs);
+		return fr;
+	}
+	fs_owner = seqnum;
+	return FR_OK;
+}
+#endif
+
 static void send_http_response_cgi(uint8_t s, uint8_t * buf, uint8_t * http_body, uint16_t file_len)
 {
 	uint16_t send_len = 0;
+	wiz_IOVec http_iov[2];
 
 #ifdef _HTTPSERVER_DEBUG_
 	printf("> HTTPSocket[%d] : HTTP Response Header + Body - CGI\r\n", s);
 #endif
-	send_len = sprintf((char *)buf, "%s%d\r\n\r\n%s", RES_CGIHEAD_OK, file_len, http_body);
+	// Only the header is formatted into buf; the body is sent from where the CGI handler left it
+	send_len = sprintf((char *)buf, "%s%d\r\n%s\r\n", RES_CGIHEAD_OK, file_len,
+					   HTTPSock_Status[getHTTPSequenceNum(s)].keep_alive ? RES_CONNECTION_KEEPALIVE : RES_CONNECTION_CLOSE);
 #ifdef _HTTPSERVER_DEBUG_
-	printf("> HTTPSocket[%d] : HTTP Response Header + Body - send len [ %d ]byte\r\n", s, send_len);
+	printf("> HTTPSocket[%d] : HTTP Response Header + Body - send len [ %d ]byte\r\n", s, send_len + file_len);
 #endif
 
-	send(s, buf, send_len);
+	http_iov[0].buf = buf;
+	http_iov[0].len = send_len;
+	http_iov[1].buf = http_body;
+	http_iov[1].len = file_len;
+	sendv(s, http_iov, 2);
 }
 
 
@@ -483,6 +837,26 @@ static int8_t http_disconnect(uint8_t sn)
 	return SOCK_OK;
 }
 
+// Free space of the socket TX buffer, none while its last SEND command is in progress
+static uint16_t http_tx_free(uint8_t s)
+{
+#if _WIZCHIP_ == 5300
+	if(getSn_TX_FSR(s) != getSn_TxMAX(s)) return 0;
+#else
+	if(getSn_TX_RD(s) != getSn_TX_WR(s)) return 0;
+#endif
+	return getSn_TX_FSR(s);
+}
+
+// Copy a complete error page with the Connection header of the response added to its header
+static uint16_t make_http_error_page(uint8_t * buf, const char * page, uint8_t keep_alive)
+{
+	uint16_t head_len = (uint16_t)(strstr(page, "\r\n\r\n") + 2 - page);
+
+	return (uint16_t)sprintf((char *)buf, "%.*s%s%s", head_len, page,
+							 keep_alive ? RES_CONNECTION_KEEPALIVE : RES_CONNECTION_CLOSE, page + head_len);
+}
+
 
 static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 {
@@ -490,6 +864,13 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 	uint32_t content_addr = 0;
 	uint16_t content_num = 0;
 	uint32_t file_len = 0;
+	uint16_t gz_num = 0;
+	uint32_t gz_len = 0;
+	uint16_t name_len;
+	char etag[11];
+	uint32_t range_first = 0;
+	uint32_t range_last = 0;
+	uint32_t body_len;
 
 	uint8_t uri_buf[MAX_URI_SIZE]={0x00, };
 
@@ -527,6 +908,32 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 			printf("> HTTPSocket[%d] : Request URI = %s\r\n", s, uri_name);
 #endif
 
+#if _USE_MODBUS_EVENTS_
+			if(!strcmp((char *)uri_name, HTTP_EVENTS_URI))
+			{
+				start_http_events(s, get_seqnum, p_http_request->METHOD);
+				break;
+			}
+#endif
+#if _USE_WEBSOCKET_
+			if(!strcmp((char *)uri_name, HTTP_WS_URI))
+			{
+				start_http_websocket(s, get_seqnum, p_http_request);
+				break;
+			}
+#endif
+#if _USE_CGI_STREAM_
+			if(p_http_request->TYPE == PTYPE_CGI)
+			{
+				http_cgi_stream handler = http_get_cgi_stream(uri_name);
+
+				if(handler)
+				{
+					start_http_cgi_stream(s, get_seqnum, handler, p_http_request);
+					break;
+				}
+			}
+#endif
 			if(p_http_request->TYPE == PTYPE_CGI)
 			{
 				content_found = http_get_cgi_handler(uri_name, pHTTP_TX, &file_len);
@@ -541,73 +948,125 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 			}
 			else
 			{
-				// Find the User registered index for web content
-				if(find_userReg_webContent(uri_buf, &content_num, &file_len))
+				// Look for the gzip variant "<name>.gz" first
+				HTTPSock_Status[get_seqnum].gzip = 0;
+				HTTPSock_Status[get_seqnum].etag = 0;
+				HTTPSock_Status[get_seqnum].range_total = 0;
+				content_found = 0;
+				if((name_len = strlen((char *)uri_name)) + 3 < MAX_URI_SIZE)
+				{
+					strcpy((char *)uri_name + name_len, ".gz");
+					if(find_userReg_webContent(uri_name, &gz_num, &gz_len)) HTTPSock_Status[get_seqnum].gzip = HTTP_GZIP_VARIANT;
+					uri_name[name_len] = 0;
+				}
+
+				// Find the User registered index for web content; the gzip variant is sent when the client takes it
+				if(HTTPSock_Status[get_seqnum].gzip && p_http_request->ACCEPT_GZIP)
+				{
+					HTTPSock_Status[get_seqnum].gzip |= HTTP_GZIP_ENCODED;
+					content_num = gz_num;
+					file_len = gz_len;
+					content_found = 1;
+				}
+				else if(find_userReg_webContent(uri_buf, &content_num, &file_len)) content_found = 1;
+
+				if(content_found)
 				{
 					content_found = 1; // Web content found in code flash memory
 					content_addr = (uint32_t)content_num;
 					HTTPSock_Status[get_seqnum].storage_type = CODEFLASH;
+					HTTPSock_Status[get_seqnum].etag = get_userReg_webContent_etag(content_num);
 				}
 				// Not CGI request, Web content in 'SD card' or 'Data flash' requested
 #ifdef _USE_SDCARD_
 #ifdef _HTTPSERVER_DEBUG_
 				printf("\r\n> HTTPSocket[%d] : Searching the requested content\r\n", s);
 #endif
-				if((fr = f_open(&fs, (const char *)uri_name, FA_READ)) == 0)
+				// The file stays open for the body
+				if(!content_found && (open_http_file(get_seqnum, uri_name, 0) == FR_OK))
 				{
 					content_found = 1; // file open succeed
 
 					file_len = fs.fsize;
-					content_addr = fs.sclust;
+					content_addr = 0;
 					HTTPSock_Status[get_seqnum].storage_type = SDCARD;
 				}
-#elif _USE_FLASH_
-				else if(/* Read content from Dataflash */)
+#endif
+#ifdef _USE_FLASH_
+				if(!content_found && dataflash_find && dataflash_find(uri_name, &content_addr, &file_len))
 				{
 					content_found = 1;
-					HTTPSock_Status[get_seqnum]->storage_type = DATAFLASH;
-					; // To do
+					HTTPSock_Status[get_seqnum].storage_type = DATAFLASH;
 				}
 #endif
-				else
-				{
-					content_found = 0; // fail to find content
-				}
 
 				if(!content_found)
 				{
 #ifdef _HTTPSERVER_DEBUG_
 					printf("> HTTPSocket[%d] : Unknown Page Request\r\n", s);
 #endif
-					http_status = STATUS_NOT_FOUND;
+					// Stored gzip encoded only, for a client which doesn't take it
+					http_status = HTTPSock_Status[get_seqnum].gzip ? STATUS_NOT_ACCEPT : STATUS_NOT_FOUND;
 				}
 				else
 				{
 #ifdef _HTTPSERVER_DEBUG_
-					printf("> HTTPSocket[%d] : Find Content [%s] ok - Start [%ld] len [ %ld ]byte\r\n", s, uri_name, content_addr, file_len);
+					printf("> HTTPSocket[%d] : Find Content [%s] ok - Start [%lu] len [ %lu ]byte\r\n", s, uri_name, (unsigned long)content_addr, (unsigned long)file_len);
 #endif
 					http_status = STATUS_OK;
+					if(HTTPSock_Status[get_seqnum].etag) sprintf(etag, "\"%08lx\"", (unsigned long)HTTPSock_Status[get_seqnum].etag);
+					else etag[0] = 0;
+
+					// Conditional GET: the client's copy is current when it holds the tag of the content
+					if(etag[0] && p_http_request->IF_NONE_MATCH[0])
+					{
+						if(match_http_etag(p_http_request->IF_NONE_MATCH, etag)) http_status = STATUS_NOT_MODIF;
+					}
+
+					// Range: a part of the content, e.g. the rest of a download cut short; If-Range asks for
+					// the part only while the content still has the given tag, else the whole content is sent
+					if((http_status == STATUS_OK) && p_http_request->RANGE[0] &&
+					   (!p_http_request->IF_RANGE[0] || (etag[0] && !strcmp(p_http_request->IF_RANGE, etag))))
+					{
+						switch(get_http_range(p_http_request->RANGE, file_len, &range_first, &range_last))
+						{
+							case HTTP_RANGE_OK :
+								http_status = STATUS_PARTIAL;
+								HTTPSock_Status[get_seqnum].range_first = range_first;
+								HTTPSock_Status[get_seqnum].range_last = range_last;
+								HTTPSock_Status[get_seqnum].range_total = file_len;
+								break;
+							case HTTP_RANGE_NOT_SATISF :
+								http_status = STATUS_RANGE_NOT_SATISF;
+								HTTPSock_Status[get_seqnum].range_total = file_len;
+								break;
+							default :
+								break;
+						}
+					}
 				}
 
 				// Send HTTP header
+				body_len = (http_status == STATUS_PARTIAL) ? (range_last - range_first + 1) : file_len;
 				if(http_status)
 				{
 #ifdef _HTTPSERVER_DEBUG_
-					printf("> HTTPSocket[%d] : Requested content len = [ %ld ]byte\r\n", s, file_len);
+					printf("> HTTPSocket[%d] : Requested content len = [ %lu ]byte\r\n", s, (unsigned long)body_len);
 #endif
-					send_http_response_header(s, p_http_request->TYPE, file_len, http_status);
+					send_http_response_header(s, p_http_request->TYPE, body_len, http_status);
 				}
 
-				// Send HTTP body (content)
-				if(http_status == STATUS_OK)
+				// Send HTTP body (content); a HEAD response stops at the header
+				if((http_status == STATUS_OK) || (http_status == STATUS_PARTIAL))
 				{
-					send_http_response_body(s, uri_name, http_response, content_addr, file_len);
+					if(p_http_request->METHOD == METHOD_HEAD) flush_http_response_header(s);
+					else send_http_response_body(s, uri_name, http_response, content_addr, range_first, range_first + body_len);
 				}
 			}
 			break;
 
 		case METHOD_POST :
-			mid((char *)p_http_request->URI, "/", " HTTP", (char *)uri_buf);
+			get_http_uri_name(p_http_request->URI, uri_buf);
 			uri_name = uri_buf;
 			find_http_uri_type(&p_http_request->TYPE, uri_name);	// Check file type (HTML, TEXT, GIF, JPEG are included)
 
@@ -621,7 +1080,7 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 			{
 				content_found = http_post_cgi_handler(uri_name, p_http_request, http_response, &file_len);
 #ifdef _HTTPSERVER_DEBUG_
-				printf("> HTTPSocket[%d] : [CGI: %s] / Response len [ %ld ]byte\r\n", s, content_found?"Content found":"Content not found", file_len);
+				printf("> HTTPSocket[%d] : [CGI: %s] / Response len [ %lu ]byte\r\n", s, content_found?"Content found":"Content not found", (unsigned long)file_len);
 #endif
 				if(content_found && (file_len <= (DATA_BUF_SIZE-(strlen(RES_CGIHEAD_OK)+8))))
 				{
@@ -655,36 +1114,58 @@ void httpServer_time_handler(void)
 
 uint32_t get_httpServer_timecount(void)
 {
+#if _USE_TIMER_WHEEL_
+	return wheel_now() / 1000;
+#else
 	return httpServer_tick_1s;
+#endif
 }
 
-void reg_httpServer_webContent(uint8_t * content_name, uint8_t * content)
+#if _USE_TIMER_WHEEL_
+static void http_timeout_fn(void * arg)
 {
-	uint16_t name_len;
-	uint32_t content_len;
+	// Nothing to do: http_timed_out() sees the timer no longer armed
+}
+#endif
 
-	if(content_name == NULL || content == NULL)
-	{
-		return;
-	}
-	else if(total_content_cnt >= MAX_CONTENT_CALLBACK)
-	{
-		return;
-	}
+// Start the idle timeout of the socket: the wait of the next request, or of the client taking the response
+static void start_http_timeout(uint8_t seqnum, uint8_t sec)
+{
+#if _USE_TIMER_WHEEL_
+	wheel_arm(&HTTPSock_Timer[seqnum], sec * 1000UL, http_timeout_fn, NULL);
+#else
+	HTTPSock_Status[seqnum].idle_since = get_httpServer_timecount();
+	HTTPSock_Status[seqnum].idle_limit = sec;
+#endif
+}
 
-	name_len = strlen((char *)content_name);
-	content_len = strlen((char *)content);
+static void stop_http_timeout(uint8_t seqnum)
+{
+#if _USE_TIMER_WHEEL_
+	wheel_cancel(&HTTPSock_Timer[seqnum]);
+#endif
+}
 
-	web_content[total_content_cnt].content_name = malloc(name_len+1);
-	strcpy((char *)web_content[total_content_cnt].content_name, (const char *)content_name);
-	web_content[total_content_cnt].content_len = content_len;
-	web_content[total_content_cnt].content = content;
+static uint8_t http_timed_out(uint8_t seqnum)
+{
+#if _USE_TIMER_WHEEL_
+	return !wheel_armed(&HTTPSock_Timer[seqnum]);
+#else
+	return ((get_httpServer_timecount() - HTTPSock_Status[seqnum].idle_since) > HTTPSock_Status[seqnum].idle_limit);
+#endif
+}
 
-	total_content_cnt++;
+void reg_httpServer_webContent(const httpServer_webContent * table, uint16_t cnt)
+{
+	// The table of web_content_gen is sorted by name for find_userReg_webContent()
+	web_content = table;
+	total_content_cnt = table ? cnt : 0;
 }
 
 uint8_t display_reg_webContent_list(void)
 {
+	httpServer_webContent entry;
+	char name[MAX_CONTENT_NAME_LEN];
 	uint16_t i;
 	uint8_t ret;
 
@@ -698,12 +1179,12 @@ uint8_t display_reg_webContent_list(void)
 		printf("\r\n=== List of Web content in code flash ===\r\n");
 		for(i = 0; i < total_content_cnt; i++)
 		{
+			get_webContent(i, &entry);
+			web_content_strncpy(name, entry.content_name, sizeof(name) - 1);
+			name[sizeof(name) - 1] = 0;
 			printf(" [%d] ", i+1);
-			printf("%s, ", web_content[i].content_name);
-			printf("%ld byte, ", web_content[i].content_len);
-
-			if(web_content[i].content_len < 30) printf("[%s]\r\n", web_content[i].content);
-			else printf("[ ... ]\r\n");
+			printf("%s, ", name);
+			printf("%lu byte\r\n", (unsigned long)entry.content_len);
 		}
 		printf("=========================================\r\n\r\n");
 		ret = 1;
@@ -714,36 +1195,514 @@ uint8_t display_reg_webContent_list(void)
 
 uint8_t find_userReg_webContent(uint8_t * content_name, uint16_t * content_num, uint32_t * file_len)
 {
+	httpServer_webContent entry;
+	uint16_t low = 0;
+	uint16_t high = total_content_cnt;
 	uint16_t i;
-	uint8_t ret = 0; // '0' means 'File Not Found'
+	int cmp;
 
-	for(i = 0; i < total_content_cnt; i++)
+	// Binary search of the name in the sorted table; '0' means 'File Not Found'
+	while(low < high)
 	{
-		if(!strcmp((char *)content_name, (char *)web_content[i].content_name))
+		i = low + (high - low) / 2;
+		get_webContent(i, &entry);
+		cmp = web_content_strcmp((char *)content_name, entry.content_name);
+		if(cmp == 0)
 		{
-			*file_len = web_content[i].content_len;
+			*file_len = entry.content_len;
 			*content_num = i;
-			ret = 1; // If the requested content found, ret set to '1' (Found)
-			break;
+			return 1;
 		}
+		if(cmp < 0) high = i;
+		else low = i + 1;
 	}
-	return ret;
+	return 0;
 }
 
 
 uint16_t read_userReg_webContent(uint16_t content_num, uint8_t * buf, uint32_t offset, uint16_t size)
 {
-	uint16_t ret = 0;
-	uint8_t * ptr;
+	httpServer_webContent entry;
 
-	if(content_num > total_content_cnt) return 0;
+	if(content_num >= total_content_cnt) return 0;
 
-	ptr = web_content[content_num].content;
-	if(offset) ptr += offset;
+	get_webContent(content_num, &entry);
+	if(offset >= entry.content_len) return 0;
+	if(size > entry.content_len - offset) size = (uint16_t)(entry.content_len - offset);
 
-	strncpy((char *)buf, (char *)ptr, size);
-	*(buf+size) = 0; // Insert '/0' for indicates the 'End of String' (null terminated)
+	// Exactly size bytes; the content may be binary
+	web_content_memcpy(buf, entry.content + offset, size);
+	return size;
+}
 
-	ret = strlen((void *)buf);
-	return ret;
+uint32_t get_userReg_webContent_etag(uint16_t content_num)
+{
+	httpServer_webContent entry;
+
+	if(content_num >= total_content_cnt) return 0;
+	get_webContent(content_num, &entry);
+	return entry.content_etag;
+}
+
+// Header fields of the content sent: encoding, entity tag and byte ranges
+static void make_http_content_fields(char * fields, int8_t seqnum)
+{
+	strcpy(fields, RES_ACCEPT_RANGES);
+	if(HTTPSock_Status[seqnum].gzip & HTTP_GZIP_ENCODED) strcat(fields, RES_CONTENT_ENCODING_GZIP);
+	if(HTTPSock_Status[seqnum].gzip) strcat(fields, RES_VARY_ENCODING);
+	if(HTTPSock_Status[seqnum].etag) sprintf(fields + strlen(fields), "ETag: \"%08lx\"\r\n", (unsigned long)HTTPSock_Status[seqnum].etag);
+	// The part of a 206 response; its Content-Length is the length of the part
+	if(HTTPSock_Status[seqnum].range_total)
+		sprintf(fields + strlen(fields), "Content-Range: bytes %lu-%lu/%lu\r\n", (unsigned long)HTTPSock_Status[seqnum].range_first,
+				(unsigned long)HTTPSock_Status[seqnum].range_last, (unsigned long)HTTPSock_Status[seqnum].range_total);
+}
+
+// Copy an entry of the web content table, which is in program memory on AVR
+static void get_webContent(uint16_t content_num, httpServer_webContent * entry)
+{
+	web_content_memcpy(entry, &web_content[content_num], sizeof(httpServer_webContent));
+}
+
+#if _USE_MODBUS_EVENTS_ || _USE_WEBSOCKET_
+// Number of the sockets in a streaming state
+static uint8_t count_http_streams(uint8_t sock_status)
+{
+	uint8_t i, cnt = 0;
+
+	for(i = 0; i < _WIZCHIP_SOCK_NUM_; i++)
+		if(HTTPSock_Status[i].sock_status == sock_status) cnt++;
+	return cnt;
 }
+
+// Keep the register values sent to the client, for the changes of the next event
+static void commit_http_events(st_http_events * ev, uint16_t * holding, uint16_t * input_reg, uint32_t now)
+{
+	memcpy(ev->holding, holding, sizeof(ev->holding));
+	memcpy(ev->input_reg, input_reg, sizeof(ev->input_reg));
+	ev->full = 0;
+	ev->sent = now;
+}
+#endif
+
+#if _USE_MODBUS_EVENTS_
+// Answer GET /events: the stream starts, or 503 when HTTP_EVENTS_MAX_CLIENTS streams are open
+static void start_http_events(uint8_t s, int8_t seqnum, uint8_t method)
+{
+	if(count_http_streams(STATE_HTTP_EVENTS) >= HTTP_EVENTS_MAX_CLIENTS)
+	{
+		send_http_response_header(s, 0, 0, STATUS_SERV_UNAVAIL);
+		return;
+	}
+
+#ifdef _HTTPSERVER_DEBUG_
+	printf("> HTTPSocket[%d] : HTTP Response Header - Server-Sent Events\r\n", s);
+#endif
+	// The stream ends with the connection
+	HTTPSock_Status[seqnum].keep_alive = 0;
+	// The header is pending until the socket takes it whole; a HEAD answer is sent from STATE_HTTP_RES_DONE,
+	// the events from STATE_HTTP_EVENTS once it has gone out
+	strcpy((char *)http_response, RES_EVENTSHEAD_OK);
+	http_response_head_len = (uint16_t)strlen(RES_EVENTSHEAD_OK);
+	http_response_head_sock = s;
+	if(method == METHOD_HEAD) return;
+
+	// The first event lists all the registers and goes out right away
+	HTTPSock_Events[seqnum].full = 1;
+	HTTPSock_Events[seqnum].sent = http_events_now() - HTTP_EVENTS_PERIOD;
+	HTTPSock_Status[seqnum].sock_status = STATE_HTTP_EVENTS;
+}
+
+// Send the registers changed since the last event of the stream, once HTTP_EVENTS_INTERVAL_MS has passed
+static void send_http_events(uint8_t s, uint8_t seqnum)
+{
+	st_http_events * ev = &HTTPSock_Events[seqnum];
+	uint16_t holding[MODBUS_HOLDING_NUM];
+	uint16_t input_reg[MODBUS_INPUT_REG_NUM];
+	char * buf = (char *)pHTTP_RX;
+	uint32_t now = http_events_now();
+	uint16_t len;
+	uint16_t i;
+
+	// Nothing is expected from the client; what it sends is dropped
+	if((len = getSn_RX_RSR(s)) > 0) recvskip(s, len);
+
+	// The changes meanwhile are coalesced: a register changed several times goes out with its last value
+	if((now - ev->sent) < HTTP_EVENTS_PERIOD) return;
+
+	// No event while the image is left in the middle of a write
+	if((modbus_read_holding(0, holding, MODBUS_HOLDING_NUM) < 0) ||
+	   (modbus_read_input_reg(0, input_reg, MODBUS_INPUT_REG_NUM) < 0)) return;
+
+	len = sprintf(buf, "data: ");
+	for(i = 0; i < MODBUS_HOLDING_NUM; i++)
+		if(ev->full || (holding[i] != ev->holding[i]))
+			len += sprintf(buf + len, "%sh%u=%u", (len > 6) ? "," : "", i, holding[i]);
+	for(i = 0; i < MODBUS_INPUT_REG_NUM; i++)
+		if(ev->full || (input_reg[i] != ev->input_reg[i]))
+			len += sprintf(buf + len, "%si%u=%u", (len > 6) ? "," : "", i, input_reg[i]);
+
+	if(len > 6) len += sprintf(buf + len, "\n\n");
+	else if((now - ev->sent) >= HTTP_EVENTS_HEARTBEAT) len = sprintf(buf, ":\n\n");
+	else return;
+
+	// An event goes out whole; it waits for the room in the TX buffer, still coalescing, and is made again
+	// on the next call when the socket doesn't take it
+	if(http_tx_free(s) < len) return;
+	if(send(s, (uint8_t *)buf, len) != len) return;
+
+#ifdef _HTTPSERVER_DEBUG_
+	printf("> HTTPSocket[%d] : [Send] Event [ %d ]byte\r\n", s, len);
+#endif
+	commit_http_events(ev, holding, input_reg, now);
+}
+#endif
+
+#if _USE_WEBSOCKET_
+// Answer GET /ws: 101 and the WebSocket starts, 400 without a valid upgrade, 503 when HTTP_WS_MAX_CLIENTS are open
+static void start_http_websocket(uint8_t s, int8_t seqnum, st_http_request * p_http_request)
+{
+	char accept[29];
+
+	if((p_http_request->METHOD != METHOD_GET) || !p_http_request->WS_KEY[0])
+	{
+		send_http_response_header(s, 0, 0, STATUS_BAD_REQ);
+		return;
+	}
+	if(count_http_streams(STATE_HTTP_WEBSOCKET) >= HTTP_WS_MAX_CLIENTS)
+	{
+		send_http_response_header(s, 0, 0, STATUS_SERV_UNAVAIL);
+		return;
+	}
+
+#ifdef _HTTPSERVER_DEBUG_
+	printf("> HTTPSocket[%d] : HTTP Response Header - STATUS_SWITCHING / WebSocket\r\n", s);
+#endif
+	make_websocket_accept(p_http_request->WS_KEY, accept);
+	// The header is pending until the socket takes it whole; run_http_websocket() sends no frame before it
+	http_response_head_len = (uint16_t)sprintf((char *)http_response, "%s%s\r\n%s\r\n", RES_WEBSOCKETHEAD, accept,
+											   p_http_request->WS_PROTOCOL ? RES_WS_PROTOCOL : "");
+	http_response_head_sock = s;
+
+	// The connection is the WebSocket's from now on; the first updates hold the whole banks
+	HTTPSock_Status[seqnum].keep_alive = 0;
+	HTTPSock_Events[seqnum].full = 1;
+	HTTPSock_Events[seqnum].sent = http_events_now() - HTTP_EVENTS_PERIOD;
+	HTTPSock_Events[seqnum].close = 0;
+	HTTPSock_Status[seqnum].sock_status = STATE_HTTP_WEBSOCKET;
+}
+
+static void run_http_websocket(uint8_t s, uint8_t seqnum)
+{
+	st_http_events * ev = &HTTPSock_Events[seqnum];
+	uint16_t holding[MODBUS_HOLDING_NUM];
+	uint16_t input_reg[MODBUS_INPUT_REG_NUM];
+	uint8_t * buf = pHTTP_RX;
+	uint8_t * payload = buf + 6;
+	uint8_t * p;
+	uint32_t now;
+	uint16_t len;
+	uint8_t op;
+	uint8_t i;
+	uint8_t sent;
+
+	// The 101 the socket didn't take goes out first; the connection is the WebSocket's once it has
+	if(!flush_http_response_header(s)) return;
+
+	// A close frame the socket didn't take goes out before anything else
+	if(ev->close)
+	{
+		close_http_websocket(s, seqnum, ev->close);
+		return;
+	}
+
+	// A frame of the client is taken whole, once the TX buffer has room for its answer
+	while(((len = getSn_RX_RSR(s)) >= 2) && (http_tx_free(s) >= HTTP_WS_MAX_FRAME))
+	{
+		if(recvpeek(s, buf, 2, 0) != 2) break;
+		op = buf[0] & 0x0F;
+
+		// The frames of the client are masked; fragmented messages and payloads over 125 bytes aren't taken
+		if((buf[0] & 0x70) || !(buf[1] & WS_MASK))
+		{
+			close_http_websocket(s, seqnum, WS_CLOSE_PROTOCOL);
+			return;
+		}
+		if(!(buf[0] & WS_FIN) || (op == WS_OP_CONT) || ((buf[1] & 0x7F) > 125))
+		{
+			close_http_websocket(s, seqnum, WS_CLOSE_TOO_BIG);
+			return;
+		}
+		if(len < 6 + (buf[1] & 0x7F)) break;
+		len = buf[1] & 0x7F;
+		recvpeek(s, buf, 6 + len, 0);
+		for(i = 0; i < len; i++) payload[i] ^= buf[2 + (i & 3)];
+
+		// The frame stays in the socket until its answer has gone out; the socket busy, it is run again on the next call
+		switch(op)
+		{
+			case WS_OP_BINARY :
+				if(!send_ws_frame(s, WS_OP_BINARY, buf + HTTP_WS_ANSWER, run_ws_request(payload, len, buf + HTTP_WS_ANSWER))) return;
+				break;
+			case WS_OP_PING :
+				if(!send_ws_frame(s, WS_OP_PONG, payload, len)) return;
+				break;
+			case WS_OP_PONG :
+				break;
+			case WS_OP_CLOSE :
+				// The close of the client is echoed with its status code
+				recvskip(s, 6 + len);
+				close_http_websocket(s, seqnum, (len >= 2) ? (((uint16_t)payload[0] << 8) | payload[1]) : WS_CLOSE_NORMAL);
+				return;
+			case WS_OP_TEXT :
+				close_http_websocket(s, seqnum, WS_CLOSE_UNSUPPORTED);
+				return;
+			default :
+				close_http_websocket(s, seqnum, WS_CLOSE_PROTOCOL);
+				return;
+		}
+		recvskip(s, 6 + len);
+	}
+
+	// The registers changed are pushed as the events of HTTP_EVENTS_URI, coalesced the same way
+	now = http_events_now();
+	if(((now - ev->sent) < HTTP_EVENTS_PERIOD) || (http_tx_free(s) < HTTP_WS_MAX_UPDATE)) return;
+
+	if((modbus_read_holding(0, holding, MODBUS_HOLDING_NUM) < 0) ||
+	   (modbus_read_input_reg(0, input_reg, MODBUS_INPUT_REG_NUM) < 0)) return;
+	p = put_ws_update(buf, WS_FC_READ_HOLDING, holding, ev->holding, MODBUS_HOLDING_NUM, ev->full);
+	p = put_ws_update(p, WS_FC_READ_INPUT_REG, input_reg, ev->input_reg, MODBUS_INPUT_REG_NUM, ev->full);
+
+	if(p != buf) sent = (send(s, buf, p - buf) == (p - buf));
+	else if((now - ev->sent) >= HTTP_EVENTS_HEARTBEAT) sent = send_ws_frame(s, WS_OP_PING, buf + 4, 0); // A client gone is found out
+	else return;
+	// The changes the socket didn't take are made again on the next call
+	if(sent) commit_http_events(ev, holding, input_reg, now);
+}
+
+// Send a close frame with the status code; the connection closes once it has gone out, until then it stays pending
+static void close_http_websocket(uint8_t s, uint8_t seqnum, uint16_t code)
+{
+	uint8_t * payload = pHTTP_RX + 4;
+
+#ifdef _HTTPSERVER_DEBUG_
+	printf("> HTTPSocket[%d] : WebSocket close [ %d ]\r\n", s, code);
+#endif
+	payload[0] = (uint8_t)(code >> 8);
+	payload[1] = (uint8_t)code;
+	HTTPSock_Events[seqnum].close = code;
+	if(!send_ws_frame(s, WS_OP_CLOSE, payload, 2)) return;
+	HTTPSock_Events[seqnum].close = 0;
+	HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE;
+	start_http_timeout(seqnum, HTTP_MAX_TIMEOUT_SEC);
+}
+
+// Send a frame of the server, unmasked; its header is put in the 4 bytes before the payload. 1 when the socket took it whole
+static uint8_t send_ws_frame(uint8_t s, uint8_t op, uint8_t * payload, uint16_t len)
+{
+	uint8_t * frame = payload - 2;
+
+	if(len > 125)
+	{
+		frame -= 2;
+		frame[1] = 126;
+		frame[2] = (uint8_t)(len >> 8);
+		frame[3] = (uint8_t)len;
+	}
+	else frame[1] = (uint8_t)len;
+	frame[0] = WS_FIN | op;
+	len += payload - frame;
+	return (send(s, frame, len) == len);
+}
+
+// Run a request of the sub-protocol, make its answer in res, and give the length of the answer
+static uint16_t run_ws_request(uint8_t * req, uint16_t len, uint8_t * res)
+{
+	uint16_t regs[HTTP_WS_MAX_REGS];
+	uint16_t addr, qty, i;
+	uint8_t exc = WS_EXC_VALUE;
+	int8_t ret;
+
+	res[0] = (len > 0) ? req[0] : 0;
+	res[1] = (len > 1) ? req[1] : 0;
+	if(len >= 6)
+	{
+		memcpy(res + 2, req + 2, 4);
+		addr = ((uint16_t)req[2] << 8) | req[3];
+		qty = ((uint16_t)req[4] << 8) | req[5];
+		switch(req[1])
+		{
+			case WS_FC_READ_HOLDING :
+			case WS_FC_READ_INPUT_REG :
+				if((len != 6) || !qty || (qty > HTTP_WS_MAX_REGS)) break;
+				exc = WS_EXC_ADDRESS;
+				if((uint32_t)addr + qty > ((req[1] == WS_FC_READ_HOLDING) ? MODBUS_HOLDING_NUM : MODBUS_INPUT_REG_NUM)) break;
+				// Within the registers, a read fails only on an image left in the middle of a write
+				if(req[1] == WS_FC_READ_HOLDING) ret = modbus_read_holding(addr, regs, qty);
+				else ret = modbus_read_input_reg(addr, regs, qty);
+				exc = WS_EXC_DEVICE;
+				if(ret < 0) break;
+				for(i = 0; i < qty; i++)
+				{
+					res[6 + 2 * i] = (uint8_t)(regs[i] >> 8);
+					res[7 + 2 * i] = (uint8_t)regs[i];
+				}
+				return 6 + 2 * qty;
+
+			case WS_FC_WRITE_HOLDING :
+				if(!qty || (qty > HTTP_WS_MAX_REGS) || (len != 6 + 2 * qty)) break;
+				for(i = 0; i < qty; i++) regs[i] = ((uint16_t)req[6 + 2 * i] << 8) | req[7 + 2 * i];
+				exc = WS_EXC_ADDRESS;
+				if(modbus_write_holding(addr, regs, qty) < 0) break;
+				return 6;
+
+			default :
+				exc = WS_EXC_FUNCTION;
+				break;
+		}
+	}
+
+	// Exception answer
+	res[1] |= WS_FC_EXCEPTION;
+	res[2] = exc;
+	return 3;
+}
+
+// Put the update frame of a bank at p, with the span of the registers changed; give the end of the frame
+static uint8_t * put_ws_update(uint8_t * p, uint8_t fc, uint16_t * val, uint16_t * last, uint16_t num, uint8_t full)
+{
+	uint16_t first = 0, end = num, i;
+
+	if(!full)
+	{
+		while((first < num) && (val[first] == last[first])) first++;
+		if(first == num) return p;
+		while(val[end - 1] == last[end - 1]) end--;
+	}
+
+	p[0] = WS_FIN | WS_OP_BINARY;
+	p[1] = (uint8_t)(6 + 2 * (end - first));
+	p[2] = 0;
+	p[3] = fc;
+	p[4] = (uint8_t)(first >> 8);
+	p[5] = (uint8_t)first;
+	p[6] = (uint8_t)((end - first) >> 8);
+	p[7] = (uint8_t)(end - first);
+	for(i = first; i < end; i++)
+	{
+		p[8 + 2 * (i - first)] = (uint8_t)(val[i] >> 8);
+		p[9 + 2 * (i - first)] = (uint8_t)val[i];
+	}
+	return p + 8 + 2 * (end - first);
+}
+#endif
+
+#if _USE_CGI_STREAM_
+uint8_t http_cgi_write(st_http_cgi_writer * writer, const uint8_t * data, uint16_t len)
+{
+	if(len > writer->size - writer->len) return 0;
+	memcpy(writer->buf + writer->len, data, len);
+	writer->len += len;
+	return 1;
+}
+
+uint8_t http_cgi_printf(st_http_cgi_writer * writer, const char * format, ...)
+{
+	va_list ap;
+	int n;
+
+	// The null ending the text goes in the byte kept behind the room
+	va_start(ap, format);
+	n = vsnprintf((char *)writer->buf + writer->len, writer->size - writer->len + 1, format, ap);
+	va_end(ap);
+	if((n < 0) || (n > writer->size - writer->len)) return 0;
+	writer->len += n;
+	return 1;
+}
+
+static void start_http_cgi_stream(uint8_t s, int8_t seqnum, http_cgi_stream handler, st_http_request * p_http_request)
+{
+	HTTPSock_Cgi[seqnum].handler = handler;
+	HTTPSock_Cgi[seqnum].cursor = 0;
+	// An HTTP/1.0 client doesn't take chunks; the end of the connection ends its body
+	HTTPSock_Cgi[seqnum].chunked = p_http_request->VERSION;
+	if(!HTTPSock_Cgi[seqnum].chunked) HTTPSock_Status[seqnum].keep_alive = 0;
+
+#ifdef _HTTPSERVER_DEBUG_
+	printf("> HTTPSocket[%d] : HTTP Response Header - Streamed CGI\r\n", s);
+#endif
+	// The header is pending until the socket takes it; a HEAD response is sent from STATE_HTTP_RES_DONE
+	http_response_head_len = (uint16_t)sprintf((char *)http_response, "%s%s%s\r\n", RES_CGIHEAD_STREAM,
+											   HTTPSock_Cgi[seqnum].chunked ? RES_TRANSFER_CHUNKED : "",
+											   HTTPSock_Status[seqnum].keep_alive ? RES_CONNECTION_KEEPALIVE : RES_CONNECTION_CLOSE);
+	http_response_head_sock = s;
+	if(p_http_request->METHOD == METHOD_HEAD) return;
+
+	// The first part goes out with the header; the next ones from STATE_HTTP_CGI
+	if(!send_http_cgi_stream(s, seqnum)) HTTPSock_Status[seqnum].sock_status = STATE_HTTP_CGI;
+}
+
+// Send the next part of a streamed CGI, behind the pending header in the buffer if any; 1 after the last part has gone out
+static uint8_t send_http_cgi_stream(uint8_t s, uint8_t seqnum)
+{
+	st_http_cgi * cgi = &HTTPSock_Cgi[seqnum];
+	st_http_cgi_writer writer;
+	uint16_t head_len = http_response_head_len;
+	uint8_t * buf = http_response;
+	uint8_t * p = buf + head_len;
+	uint16_t frame = cgi->chunked ? (HTTP_CGI_CHUNK_HEAD + HTTP_CGI_CHUNK_TAIL) : 0;
+	uint16_t room = http_tx_free(s);
+	uint8_t ret = HTTP_CGI_MORE;
+	int32_t sent;
+	char chunk_head[HTTP_CGI_CHUNK_HEAD + 1];
+
+	// A part is made in the buffer shared by the sockets and sent at once; one byte is kept for a null
+	if(room > DATA_BUF_SIZE - 1) room = DATA_BUF_SIZE - 1;
+	room = (room > head_len + frame) ? (room - head_len - frame) : 0;
+
+	if(room >= HTTP_CGI_MIN_PART)
+	{
+		writer.buf = p + (cgi->chunked ? HTTP_CGI_CHUNK_HEAD : 0);
+		writer.size = room;
+		writer.len = 0;
+		writer.cursor = cgi->cursor;
+		ret = cgi->handler(&writer);
+
+		if(writer.len)
+		{
+			if(cgi->chunked)
+			{
+				sprintf(chunk_head, "%04x\r\n", writer.len);
+				memcpy(p, chunk_head, HTTP_CGI_CHUNK_HEAD);
+				p += HTTP_CGI_CHUNK_HEAD + writer.len;
+				memcpy(p, "\r\n", 2);
+				p += 2;
+			}
+			else p += writer.len;
+		}
+		if((ret == HTTP_CGI_DONE) && cgi->chunked)
+		{
+			memcpy(p, "0\r\n\r\n", 5);
+			p += 5;
+		}
+	}
+
+	if(p > buf)
+	{
+#ifdef _HTTPSERVER_DEBUG_
+		printf("> HTTPSocket[%d] : [Send] Streamed CGI [ %d ]byte\r\n", s, (uint16_t)(p - buf));
+#endif
+		sent = send(s, buf, (uint16_t)(p - buf));
+		if(sent < 0)
+		{
+			// The socket is closed or lost; the response ends here
+			http_response_head_len = 0;
+			return 1;
+		}
+		// The cursor stays where it was and the same part is made again on the next call
+		if(sent != (p - buf)) return 0;
+		http_response_head_len = 0;
+	}
+	if(room >= HTTP_CGI_MIN_PART) cgi->cursor = writer.cursor;
+	return (ret == HTTP_CGI_DONE);
+}
+#endif
@@ -4,6 +4,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #ifndef	__HTTPSERVER_H__
 #define	__HTTPSERVER_H__
@@ -41,6 +42,9 @@ extern "C" {
 #define STATE_HTTP_REQ_DONE    		2           /* The end of HTTP request parse */
 #define STATE_HTTP_RES_INPROC  		3           /* Sending the HTTP response to HTTP client (in progress) */
 #define STATE_HTTP_RES_DONE    		4           /* The end of HTTP response send (HTTP transaction ended) */
+#define STATE_HTTP_EVENTS			5           /* Streaming Server-Sent Events, until the client closes */
+#define STATE_HTTP_WEBSOCKET		6           /* WebSocket of the Modbus registers, until either side closes */
+#define STATE_HTTP_CGI				7           /* Sending the output of a streamed CGI handler (in progress) */
 
 /*********************************************
 * HTTP Simple Return Value
@@ -59,6 +63,62 @@ extern "C" {
 *********************************************/
 #define HTTP_MAX_TIMEOUT_SEC		3			// Sec.
 
+/*********************************************
+* HTTP Persistent connection
+*********************************************/
+#define HTTP_KEEPALIVE_TIMEOUT_SEC	5			// Sec. a connection waits for its next request
+#define HTTP_KEEPALIVE_MAX_REQ		100			// Requests served on one connection before it is closed
+
+/*********************************************
+* Server-Sent Events of the Modbus registers
+*********************************************/
+// GET /events opens a text/event-stream of the holding and input registers of modbus_store.h.
+// Each event lists the registers changed since the last one, "h<addr>=<value>" for a holding and
+// "i<addr>=<value>" for an input register, e.g. "data: h0=12,i3=400"; the first one lists them all.
+// Built with -D_USE_MODBUS_EVENTS_=1 in the CFLAGS; the server links modbus_store.c then.
+#ifndef _USE_MODBUS_EVENTS_
+#define _USE_MODBUS_EVENTS_			0
+#endif
+#define HTTP_EVENTS_URI				"events"
+#define HTTP_EVENTS_MAX_CLIENTS		2			// Streams open at once; the next clients are answered 503
+#define HTTP_EVENTS_INTERVAL_MS		250			// Least time between two events of a stream; the changes meanwhile are coalesced
+#define HTTP_EVENTS_HEARTBEAT_SEC	15			// A comment line is sent on a stream without changes
+
+/*********************************************
+* WebSocket access to the Modbus registers
+*********************************************/
+// GET /ws upgrades to a WebSocket (RFC 6455) of binary messages, one per frame, big endian:
+//   request	tid(1) fc(1) addr(2) qty(2) [value(2) x qty]; tid 1-255
+//				fc 0x03 reads holding registers, 0x04 input registers, 0x10 writes holding registers
+//   answer		tid fc addr qty [value x qty] with the values read, or tid fc|0x80 code(1) with the Modbus
+//				exception code: 1 function, 2 address, 3 value
+//   update		0 fc addr qty value x qty, pushed with the span of a bank changed since the last update,
+//				as often as the events of HTTP_EVENTS_URI; the first ones hold the whole banks
+// The registers are written from the loop of httpServer_run(), the writer of modbus_store.h with the Modbus server.
+// Built with -D_USE_WEBSOCKET_=1 in the CFLAGS, like _USE_MODBUS_EVENTS_.
+#ifndef _USE_WEBSOCKET_
+#define _USE_WEBSOCKET_				0
+#endif
+#define HTTP_WS_URI					"ws"
+#define HTTP_WS_MAX_CLIENTS			2			// WebSockets open at once; the next clients are answered 503
+#define HTTP_WS_MAX_REGS			59			// Registers of a message; it fits a 125 byte frame
+
+/*********************************************
+* Streamed CGI
+*********************************************/
+// A GET of a CGI given by http_get_cgi_stream() of httpUtil.c is answered with the output of its handler,
+// without a length: in chunks of Transfer-Encoding: chunked, or up to the close of the connection for an
+// HTTP/1.0 client. The handler is called again each time the TX buffer has room for a part. It writes what
+// fits with http_cgi_write() / http_cgi_printf(), keeps its place in the cursor of the writer and returns
+// HTTP_CGI_MORE, or HTTP_CGI_DONE after the last part. It must not wait; the server is stopped meanwhile.
+// Built with -D_USE_CGI_STREAM_=1 in the CFLAGS; the registers.cgi example of httpUtil.c links modbus_store.c then.
+#ifndef _USE_CGI_STREAM_
+#define _USE_CGI_STREAM_			0
+#endif
+#define HTTP_CGI_MIN_PART			128			// Least room of a part; a single write must not be longer
+#define HTTP_CGI_DONE				0
+#define HTTP_CGI_MORE				1
+
 typedef enum
 {
    NONE,		///< Web storage none
@@ -75,31 +135,102 @@ typedef struct _st_http_socket
 	uint32_t 		file_len;
 	uint32_t 		file_offset; // (start addr + sent size...)
 	uint8_t			storage_type; // Storage type; Code flash, SDcard, Data flash ...
+	uint8_t			keep_alive; // The connection stays open after the current response
+	uint8_t			requests; // Requests served on the connection
+#if !_USE_TIMER_WHEEL_
+	uint32_t		idle_since; // Tick of the connection or of its last response, for the idle timeout
+	uint8_t			idle_limit; // Sec. of the idle timeout from idle_since
+#endif
+	uint8_t			gzip; // HTTP_GZIP_xxx of the content sent
+	uint32_t		etag; // Strong entity tag of the content sent, 0 for none
+	uint32_t		range_first; // First byte of the part of a 206 response
+	uint32_t		range_last; // Last byte of the part of a 206 response
+	uint32_t		range_total; // Length of the whole content of a 206 response, 0 for a full one
 }st_http_socket;
 
-// Web content structure for file in code flash memory
-#define MAX_CONTENT_CALLBACK		20
+/*********************************************
+* Web content in code flash memory
+*********************************************/
+// The table, the names and the data stay in program memory on AVR and are read with the _P functions
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#define WEB_CONTENT_MEM							PROGMEM
+#define WEB_CONTENT_MAPPED						0		// Content can't be sent in place
+#define web_content_memcpy(dst, src, n)			memcpy_P(dst, src, n)
+#define web_content_strcmp(str, name)			strcmp_P(str, name)
+#define web_content_strncpy(dst, name, n)		strncpy_P(dst, name, n)
+#else
+#define WEB_CONTENT_MEM
+#define WEB_CONTENT_MAPPED						1
+#define web_content_memcpy(dst, src, n)			memcpy(dst, src, n)
+#define web_content_strcmp(str, name)			strcmp(str, name)
+#define web_content_strncpy(dst, name, n)		strncpy(dst, name, n)
+#endif
+
+// A content "<name>" may have a gzip variant "<name>.gz", sent as it is to the clients which accept it
+#define HTTP_GZIP_VARIANT						0x01	// The response varies on Accept-Encoding
+#define HTTP_GZIP_ENCODED						0x02	// The body is the gzip variant
 
+// Web content structure for file in code flash memory
 typedef struct _httpServer_webContent
 {
-	uint8_t	*	content_name;
-	uint32_t	content_len;
-	uint8_t * 	content;
+	const char *	content_name;
+	uint32_t		content_len;	// Exact length; the content may hold zero bytes
+	const uint8_t *	content;
+	uint32_t		content_etag;	// Strong entity tag, a hash of the data; never 0
 }httpServer_webContent;
 
+#if _USE_CGI_STREAM_
+// Part of the output of a streamed CGI handler
+typedef struct _st_http_cgi_writer
+{
+	uint8_t *		buf;		// Room of the part
+	uint16_t		size;		// Length of the room, at least HTTP_CGI_MIN_PART
+	uint16_t		len;		// Bytes written in the part
+	uint32_t		cursor;		// Place of the handler in its output, 0 on the first call; kept across the calls
+}st_http_cgi_writer;
+
+typedef uint8_t (*http_cgi_stream)(st_http_cgi_writer * writer);
+#endif
+
+// Content table generated at build time by host/web_content_gen.c, sorted by name
+extern const httpServer_webContent web_content_table[];
+extern const uint16_t web_content_table_cnt;
+
 
 void httpServer_init(uint8_t * tx_buf, uint8_t * rx_buf, uint8_t cnt, uint8_t * socklist);
 void reg_httpServer_cbfunc(void(*mcu_reset)(void), void(*wdt_reset)(void));
 void httpServer_run(uint8_t seqnum);
 
-void reg_httpServer_webContent(uint8_t * content_name, uint8_t * content);
+void reg_httpServer_webContent(const httpServer_webContent * table, uint16_t cnt);
 uint8_t find_userReg_webContent(uint8_t * content_name, uint16_t * content_num, uint32_t * file_len);
 uint16_t read_userReg_webContent(uint16_t content_num, uint8_t * buf, uint32_t offset, uint16_t size);
+uint32_t get_userReg_webContent_etag(uint16_t content_num);
 uint8_t display_reg_webContent_list(void);
 
+#if _USE_CGI_STREAM_
+/*
+ * @brief Write to the part of a streamed CGI
+ * @return 1, or 0 when it doesn't fit; nothing is written then and the handler goes on in the next part
+ */
+uint8_t http_cgi_write(st_http_cgi_writer * writer, const uint8_t * data, uint16_t len);
+uint8_t http_cgi_printf(st_http_cgi_writer * writer, const char * format, ...);
+#endif
+
+#ifdef _USE_FLASH_
+/*
+ * @brief Register the web content of an external data flash
+ * @note  find gives the address and the length of a content by its name, 0 when there is none;
+ *        read copies len bytes from an address. Both are called from httpServer_run().
+ */
+void reg_httpServer_dataflash(uint8_t(*find)(uint8_t * name, uint32_t * addr, uint32_t * len),
+							  void(*read)(uint32_t addr, uint8_t * buf, uint16_t len));
+#endif
+
 /*
  * @brief HTTP Server 1sec Tick Timer handler
  * @note SHOULD BE register to your system 1s Tick timer handler
+ *       Not needed with _USE_TIMER_WHEEL_: the idle timeouts are armed on the wheel.
  */
 void httpServer_time_handler(void);
 uint32_t get_httpServer_timecount(void);
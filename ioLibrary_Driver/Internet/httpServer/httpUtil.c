@@ -14,6 +14,12 @@
 #include <stdlib.h>
 #include "httpUtil.h"
 
+#if _USE_CGI_STREAM_
+#include "modbus_store.h"
+
+static uint8_t registers_cgi(st_http_cgi_writer * writer);
+#endif
+
 uint8_t http_get_cgi_handler(uint8_t * uri_name, uint8_t * buf, uint32_t * file_len)
 {
 	uint8_t ret = HTTP_OK;
@@ -44,7 +50,7 @@ uint8_t http_post_cgi_handler(uint8_t * uri_name, st_http_request * p_http_reque
 	uint16_t len = 0;
 	uint8_t val = 0;
 
-	if(predefined_set_cgi_processor(uri_name, p_http_request->URI, buf, &len))
+	if(predefined_set_cgi_processor(uri_name, p_http_request->BODY, buf, &len))
 	{
 		;
 	}
@@ -64,12 +70,54 @@ uint8_t http_post_cgi_handler(uint8_t * uri_name, st_http_request * p_http_reque
 	return ret;
 }
 
+#if _USE_CGI_STREAM_
+/* Streamed CGI handler of a GET, NULL for the CGI answered by http_get_cgi_handler() */
+http_cgi_stream http_get_cgi_stream(uint8_t * uri_name)
+{
+	if(strcmp((const char *)uri_name, "registers.cgi") == 0) return registers_cgi;
+	// Add the streamed CGI of the application here
+	return NULL;
+}
+
+/* All the Modbus registers, a line each; the cursor counts the lines written */
+static uint8_t registers_cgi(st_http_cgi_writer * writer)
+{
+	uint16_t i;
+	uint16_t val;
+	uint8_t ok;
+
+	while(writer->cursor < MODBUS_HOLDING_NUM + MODBUS_INPUT_REG_NUM + 2)
+	{
+		i = (uint16_t)writer->cursor;
+		if(i == 0) ok = http_cgi_printf(writer, "<HTML>\r\n<BODY>\r\n<PRE>\r\n");
+		else if(i <= MODBUS_HOLDING_NUM)
+		{
+			// A register left in the middle of a write shows as ?
+			if(modbus_read_holding(i - 1, &val, 1) < 0) ok = http_cgi_printf(writer, "holding %u = ?\r\n", i - 1);
+			else ok = http_cgi_printf(writer, "holding %u = %u\r\n", i - 1, val);
+		}
+		else if(i <= MODBUS_HOLDING_NUM + MODBUS_INPUT_REG_NUM)
+		{
+			if(modbus_read_input_reg(i - 1 - MODBUS_HOLDING_NUM, &val, 1) < 0)
+				ok = http_cgi_printf(writer, "input %u = ?\r\n", i - 1 - MODBUS_HOLDING_NUM);
+			else ok = http_cgi_printf(writer, "input %u = %u\r\n", i - 1 - MODBUS_HOLDING_NUM, val);
+		}
+		else ok = http_cgi_printf(writer, "</PRE>\r\n</BODY>\r\n</HTML>\r\n");
+
+		// The line goes in the next part
+		if(!ok) return HTTP_CGI_MORE;
+		writer->cursor++;
+	}
+	return HTTP_CGI_DONE;
+}
+#endif
+
 uint8_t predefined_get_cgi_processor(uint8_t * uri_name, uint8_t * buf, uint16_t * len)
 {
-	;
+	return 0;
 }
 
-uint8_t predefined_set_cgi_processor(uint8_t * uri_name, uint8_t * uri, uint8_t * buf, uint16_t * en)
+uint8_t predefined_set_cgi_processor(uint8_t * uri_name, uint8_t * body, uint8_t * buf, uint16_t * en)
 {
-	;
+	return 0;
 }
@@ -21,9 +21,12 @@ extern "C" {
 
 uint8_t http_get_cgi_handler(uint8_t * uri_name, uint8_t * buf, uint32_t * file_len);
 uint8_t http_post_cgi_handler(uint8_t * uri_name, st_http_request * p_http_request, uint8_t * buf, uint32_t * file_len);
+#if _USE_CGI_STREAM_
+http_cgi_stream http_get_cgi_stream(uint8_t * uri_name);
+#endif
 
 uint8_t predefined_get_cgi_processor(uint8_t * uri_name, uint8_t * buf, uint16_t * len);
-uint8_t predefined_set_cgi_processor(uint8_t * uri_name, uint8_t * uri, uint8_t * buf, uint16_t * len);
+uint8_t predefined_set_cgi_processor(uint8_t * uri_name, uint8_t * body, uint8_t * buf, uint16_t * len);
 
 #ifdef __cplusplus
 }
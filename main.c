@@ -8,6 +8,11 @@
 #include "ioLibrary_Driver/Ethernet/wizchip_conf.h"
 #include "ioLibrary_Driver/Application/loopback/loopback.h"
 #include "ioLibrary_Driver/Application/modbus/modbus.h"
+#include "wizchip_spi_port.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+#include "uart.h"
+#include "bufpool.h"
 
 #define BIT0POS 0x01
 #define BIT0NEG 0xFE
@@ -42,14 +47,6 @@
     SCN(ss) ------- D53 --> [PB0]
  */
 
-static int uart_putchar(char c, FILE *stream);
-static FILE mystdout = FDEV_SETUP_STREAM(uart_putchar, NULL,
-                                         _FDEV_SETUP_WRITE);
-
-// printing to UART
-static int uart_putchar(char c, FILE *stream);
-void baud_setup(void);
-
 // IO & SPI
 void io_setup(void);
 void spi_setup(void);
@@ -82,12 +79,6 @@ uint8_t blink_counter = 0;
 #define PORT_UDPS       3000
 
 
-////////////////////////////////////////////////
-// Shared Buffer Definition for LOOPBACK TEST //
-////////////////////////////////////////////////
-
-uint8_t gDATABUF[DATA_BUF_SIZE];
-
 ///////////////////////////////////
 // Default Network Configuration //
 ///////////////////////////////////
@@ -119,36 +110,19 @@ uint8_t buttonStable;
 
 uint8_t delay;
 
-volatile uint8_t increment = 0;
-volatile uint8_t timer_ticks = 0; // Variable to count the number of 1ms ticks
-#define TICKS_S 100
-
-
-void timer2_init(void) { // increments from 100 to 256 and sets the TOV2 flag, we clear it manually. Takes about 9.984mS to overflow. 
-    TCCR2A = 0x00;  // normal operation
-    TCCR2B = 0x07;  // prescaler of 1024
-    TIMSK2 = 0x00;  // no interrupts
-    TCNT2 = 100;
-    // TIFR2 = 1; set to 1 when an overflow occurs, write a 1 to clear it
-}
-
-static int uart_putchar(char c, FILE *stream)
-{
-  if (c == '\n')
-    uart_putchar('\r', stream);
-  loop_until_bit_is_set(UCSR0A, UDRE0);
-  UDR0 = c;
-  return 0;
-}
-
-void baud_setup(void) {
-    // 9600 buad setup
-    UCSR0A = 2;     // normal speed
-    UCSR0B = 0x18;  // recv, xmit enable, 8 data bits
-    UCSR0C = 6;     // asynch, no parity, 1 stop 8 bits
-    UBRR0H = 0;
-    UBRR0L = 207;   // 9600 baud: Using 16MHz clock
-}
+// Periods (ms) and run time budgets (us) of the tasks of main()
+#define BLINK_PERIOD        50
+#define BUTTON_PERIOD       10      // 6 samples debounce the button
+#define PHY_PERIOD          100
+#define STATS_PERIOD        10000
+#define TIMERS_PERIOD       1
+#define SOCKBUF_PERIOD      100
+#define SOCKBUF_PLAN        300     // samples between two rebalances, 30S
+#define NET_BUDGET          20000   // a request and its debug output
+#define IO_BUDGET           200
+#define PHY_BUDGET          1000
+#define TIMERS_BUDGET       2000    // the callbacks of the protocol timeouts
+#define SOCKBUF_BUDGET      2000    // a rebalance reopens the listening sockets
 
 void io_setup(void) {
     // PORTA - Not used
@@ -192,8 +166,14 @@ void spi_setup(void) {
     DDRB |= (1 << SCK);
     DDRB |= (1 << SS);
 
+#if WIZCHIP_SPI_FAST
+    // SPI mode 0; MSB sent first; Clk is 16Mhz / 2
+    SPCR = (1<<SPE)|(1<<MSTR);
+    SPSR |= (1<<SPI2X);
+#else
     // SPI mode 0; MSB sent first; Clk is 16Mhz / 16
     SPCR = (1<<SPE)|(1<<MSTR)|(1<<SPR0);
+#endif
 
     // SS high
     PORTB |= (1 << SS);
@@ -206,46 +186,27 @@ void spi_setup(void) {
 }
 
 void wizchip_deselect(void) {
-    PORTB |= (1<<SS);
+    wizchip_port_deselect();
 }
 
 void wizchip_select(void) {
-    PORTB &= ~(1<<SS);
+    wizchip_port_select();
 }
 
 void wizchip_write(uint8_t data) {
-    /* start transmission */
-    SPDR = data;
-    /* wait for transmission complete */
-    while (!(SPSR & (1<<SPIF)));
+    wizchip_port_write(data);
 }
 
 void wizchip_burst_write(uint8_t *buffer, uint16_t length) {
-    uint16_t i;
-    for (i = 0; i < length; i++) {
-        wizchip_write(*buffer++);
-    }
+    wizchip_port_write_burst(buffer, length);
 }
 
 uint8_t wizchip_read(void) {
-    uint8_t read;
-    SPDR = 0x00;
-    while (!(SPSR & (1<<SPIF)));  // Wait for transmission complete
-    read = SPDR;
-    //dputstr("SPI Read-->");
-    //char buffer[3]; 
-    //sprintf(buffer, "%02x", read);
-    //dputstr(buffer);
-    //dputstr("<--END\r\n");
-    return read;
+    return wizchip_port_read();
 }
 
 void wizchip_burst_read(uint8_t *buffer, uint16_t length) {
-    uint16_t i;
-    for (i = 0; i < length; i++) {
-        buffer[i] = wizchip_read();
-    }
-    // do something w/ buffer ? 
+    wizchip_port_read_burst(buffer, length);
 }
 
 /////////////////////////////////////////////////////////////
@@ -257,8 +218,6 @@ void wizchip_burst_read(uint8_t *buffer, uint16_t length) {
 #define PORT_TCPS		    5000
 #define PORT_UDPS           3000
 
-#define ETH_MAX_BUF_SIZE	512
-
 #define SOCK_MODBUS         2
 #define PORT_MODBUS         502
 
@@ -271,19 +230,18 @@ wiz_NetInfo netInfo = {
 		.dhcp = NETINFO_STATIC,       //Static IP configuration
     };  
 
-unsigned char ethBuf0[ETH_MAX_BUF_SIZE];
-unsigned char ethBuf1[ETH_MAX_BUF_SIZE];
-unsigned char ethBuf2[ETH_MAX_BUF_SIZE];
-
 
 void IO_LIBRARY_Init(void) {
 	uint8_t bufSize[] = {2, 2, 2, 2, 2, 2, 2, 2};
+	// Echo sockets are pinned to 1KB, the others are resized from their traffic by sockbuf_task().
+	static uint8_t bufPolicy[] = {1, 1, SOCKBUF_LEARN, SOCKBUF_LEARN, SOCKBUF_LEARN, SOCKBUF_LEARN, SOCKBUF_LEARN, SOCKBUF_LEARN};
 
 	reg_wizchip_cs_cbfunc(wizchip_select, wizchip_deselect);
 	reg_wizchip_spi_cbfunc(wizchip_read, wizchip_write);
 	reg_wizchip_spiburst_cbfunc(wizchip_burst_read, wizchip_burst_write);
 
 	wizchip_init(bufSize, bufSize);
+	wizchip_sockbuf_setpolicy(bufPolicy, bufPolicy);
 	wizchip_setnetinfo(&netInfo);
 	//wizchip_setinterruptmask(IK_SOCK_0);
 }
@@ -356,12 +314,8 @@ void read_uart_buffer(void) {
 
 void USART_Transmit( unsigned char data )
 {
-/* Wait for empty transmit buffer */
-while (!( UCSR0A & (1<<UDRE0))) {
-    // nothing
-}
-/* Put data into buffer, sends the data */
-    UDR0 = data;
+    // after the debug output already queued, never dropped
+    uart_write(data);
 }
 
 void request_rcu_status(void) {
@@ -394,106 +348,146 @@ void check_button_input(void) {
     //printf("Button History: 0x%02x\n", buttonHistory);
 }
 
-int main(void) {
+int8_t getIP[4];
+uint8_t phy_previous_state = 0;
+
+/* Loopback Test: TCP Server and UDP, and the MODBUS server; runs on each pass.
+   Each service borrows a pool block for its transaction only. */
+void net_task(void) {
+    uint8_t *buf;
+
+    if ((buf = bufpool_alloc()) != NULL) {
+        if (loopback_tcps(SOCK_TCPS, buf, PORT_TCPS) == 10) {
+            printf("TCPS: %s\n", buf);
+            if(strcmp((char *)buf, (char *)blink_slow) == 0) {
+                blink_delay = 30;
+                printf("delay --> slow\n");
+            }
+            if(strcmp((char *)buf, (char *)blink_default) == 0) {
+                blink_delay = 10;
+                printf("delay --> default\n");
+            }
+            if(strcmp((char *)buf, (char *)blink_fast) == 0) {
+                blink_delay = 4;
+                printf("delay --> fast\n");
+            }
+        }
+        bufpool_free(buf);
+    }
+    if ((buf = bufpool_alloc()) != NULL) {
+        if (loopback_udps(SOCK_UDPS, buf, PORT_UDPS) == 10) {
+            printf("UPS: %s\n", buf);
+            if(strcmp((char *)buf, (char *)led_on) == 0) {
+                PORTH |= 0x20;
+                printf("LED --> ON\n");
+            }
+            if(strcmp((char *)buf, (char *)led_off) == 0) {
+                PORTH &= ~(0x20);
+                printf("LED --> OFF\n");
+            }
+        }
+        bufpool_free(buf);
+    }
+    if ((buf = bufpool_alloc()) != NULL) {
+        loopback_modbus(SOCK_MODBUS, buf, PORT_MODBUS, getIP);
+        bufpool_free(buf);
+    }
+}
+
+/* every 50mS; blink_delay (slow / default / fast) counts the 50mS between toggles */
+void blink_task(void) {
+    blink_counter++;
+    if (blink_counter >= (blink_delay ? blink_delay : 10)) {
+        blink_counter = 0;
+        PORTH ^= 0x40;
+    }
+    //send_modbus_request(SOCK_MODBUS, buf, PORT_MODBUS, getIP);
+
+    /* Add remote RCU new here */
+    //request_rcu_status();
+}
+
+/* every 100mS */
+void phy_task(void) {
     uint8_t phy_status;
-    uint8_t previous_state;
-    uint8_t monitor_tcps;
-    uint8_t monitor_udps;
 
-    int8_t getIP[4];
+    phy_status = wizphy_getphylink();
+    if(phy_status == PHY_LINK_ON && !phy_previous_state) {
+        printf("|PHY LINK ON|\n");
+        phy_previous_state = 1;
+    } else if (phy_status == PHY_LINK_OFF && phy_previous_state){
+        printf("|PHY LINK OFF|\n");
+        phy_previous_state = 0;
+    }
+}
+
+/* every 100mS; samples the socket buffer usage and resizes the buffers from it every 30S */
+void sockbuf_task(void) {
+    static uint16_t samples = 0;
+
+    wizchip_sockbuf_sample();
+    if (++samples >= SOCKBUF_PLAN) {
+        samples = 0;
+        wizchip_sockbuf_rebalance();
+    }
+}
+
+/* every 10S; shows the task times when a task overran its budget or ran late,
+   the debug output lost on a full UART ring and the use of the buffer pool */
+void stats_task(void) {
+    static uint16_t reported = 0;
+    static uint16_t dropped = 0;
+    static bufpool_stats pool_reported;
+    bufpool_stats pool;
+    uint16_t faults = sched_faults();
+    uint8_t policy;
+
+    // the report itself is not dropped
+    policy = uart_set_policy(UART_TX_BLOCK);
+    if (faults != reported) {
+        reported = faults;
+        sched_print_stats();
+    }
+    if (uart_dropped() != dropped) {
+        dropped = uart_dropped();
+        printf_P(PSTR("uart: %u characters dropped\n"), dropped);
+    }
+    bufpool_get_stats(&pool);
+    if (pool.high_water != pool_reported.high_water || pool.failures != pool_reported.failures ||
+        pool.bad_frees != pool_reported.bad_frees) {
+        pool_reported = pool;
+        printf_P(PSTR("pool: %u of %u blocks at most, %u allocs failed, %u bad frees\n"),
+                 pool.high_water, BUFPOOL_BLOCKS, pool.failures, pool.bad_frees);
+    }
+    uart_set_policy(policy);
+}
+
+int main(void) {
     memcpy(getIP, netInfo.ip, 4);  // Copy IP address
-    
-    previous_state = 0;
-    baud_setup();
+
+    uart_init(UART_BAUD);
     io_setup();
     spi_setup();
-    timer2_init();
-    stdout = &mystdout;
+    sched_init();
+    wheel_init();
+    bufpool_init();
+    sei();
+    stdout = &uart_stdout;
     printf("Hello\n");
     /* wiznet section start */
     IO_LIBRARY_Init();
     print_network_information();
     /* wiznet section end */
     test_it();
+
+    sched_add(PSTR("net"), net_task, 0, 0, NET_BUDGET);
+    sched_add(PSTR("blink"), blink_task, BLINK_PERIOD, 0, IO_BUDGET);
+    sched_add(PSTR("button"), check_button_input, BUTTON_PERIOD, 0, IO_BUDGET);
+    sched_add(PSTR("phy"), phy_task, PHY_PERIOD, 0, PHY_BUDGET);
+    sched_add(PSTR("timers"), wheel_run, TIMERS_PERIOD, 0, TIMERS_BUDGET);
+    sched_add(PSTR("sockbuf"), sockbuf_task, SOCKBUF_PERIOD, 0, SOCKBUF_BUDGET);
+    sched_add(PSTR("stats"), stats_task, STATS_PERIOD, 0, 0);
     while(1) {
-        /* Loopback Test: TCP Server and UDP */
-		// Test for Ethernet data transfer validation
-		{
-            if (TIFR2 & (1 << TOV2)) {
-                TIFR2 = 0x01;
-                TCNT2 = 100;
-                timer_ticks++;
-            }
-            //printf("Timer ticks: %d\n", timer_ticks);
-            monitor_tcps = loopback_tcps(SOCK_TCPS,ethBuf0,PORT_TCPS);
-		    monitor_udps = loopback_udps(SOCK_UDPS,ethBuf1,PORT_UDPS);
-            loopback_modbus(SOCK_MODBUS,ethBuf2,PORT_MODBUS, getIP);
-            if (monitor_tcps == 10) {
-                printf("TCPS: %s\n", ethBuf0);
-                if(strcmp((char *)ethBuf0, (char *)blink_slow) == 0) {
-                    blink_delay = 30;
-                    printf("delay --> slow\n");
-                }
-                if(strcmp((char *)ethBuf0, (char *)blink_default) == 0) {
-                    blink_delay = 10;
-                    printf("delay --> default\n");
-                }
-                if(strcmp((char *)ethBuf0, (char *)blink_fast) == 0) {
-                    blink_delay = 4;
-                    printf("delay --> fast\n");
-                }
-                uint16_t i;
-                for (i = 0; i < ETH_MAX_BUF_SIZE; i++) {
-                    ethBuf0[i] = 0; // clear buffer
-                }
-            }
-            if (monitor_udps == 10) {
-                printf("UPS: %s\n", ethBuf1);
-                if(strcmp((char *)ethBuf1, (char *)led_on) == 0) {
-                    PORTH |= 0x20;
-                    printf("LED --> ON\n");
-                }
-                if(strcmp((char *)ethBuf1, (char *)led_off) == 0) {
-                    PORTH &= ~(0x20);
-                    printf("LED --> OFF\n");
-                }
-                uint16_t i;
-                for (i = 0; i < ETH_MAX_BUF_SIZE; i++) {
-                    ethBuf1[i] = 0; // clear buffer
-                }
-            }
-            //printf("timer_ticks: %d\n", timer_ticks);
-            if ((timer_ticks & 0x0F) == 5) { // every 50mS
-                blink_counter++;    // increment every 50mS
-                if ((blink_counter & 0x7F) == 40) { 
-                    PORTH ^= 0x40;
-                }
-                #if(0)
-                if ((blink_counter & 0x0F) == 2) { // enter every 100 mS
-                    delay++;
-                    if ((delay & 0x0F) == 1) { 
-                        PORTH ^= 0x40;
-                    }
-                #endif
-                    //send_modbus_request(SOCK_MODBUS, ethBuf2, PORT_MODBUS, getIP);
-                    
-                    /* Add remote RCU new here */
-                    //request_rcu_status();
-            }
-            if ((timer_ticks & 0x02) == 0) {
-                check_button_input();
-            }
-            if (timer_ticks & 0x40) {
-                // Run your code here for every 100ms
-                phy_status = wizphy_getphylink();
-                if(phy_status == PHY_LINK_ON && !previous_state) {
-                    printf("|PHY LINK ON|\n");
-                    previous_state = 1;
-                } else if (phy_status == PHY_LINK_OFF && previous_state){
-                    printf("|PHY LINK OFF|\n");
-                    previous_state = 0;
-                }
-            }
-        }
+        sched_run();
     }
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+
+#define SCHED_US_PER_COUNT  8       // TCNT2 at 16MHz / 128
+#define SCHED_TOP           124     // OCR2A: 125 counts, 1ms
+
+static sched_task       sched_tasks[SCHED_MAX_TASKS];
+static uint8_t          sched_count = 0;
+static volatile uint32_t sched_ticks = 0;
+static volatile uint8_t  sched_pending = 0;
+
+ISR(TIMER2_COMPA_vect) {
+    sched_ticks++;
+}
+
+void sched_init(void) {
+    TCCR2A = (1 << WGM21);                  // CTC, TOP = OCR2A
+    TCCR2B = (1 << CS22) | (1 << CS20);     // prescaler of 128
+    OCR2A = SCHED_TOP;
+    TCNT2 = 0;
+    TIFR2 = (1 << OCF2A);
+    TIMSK2 = (1 << OCIE2A);
+}
+
+uint32_t sched_now(void) {
+    uint32_t t;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        t = sched_ticks;
+    }
+    return t;
+}
+
+uint32_t sched_us(void) {
+    uint32_t t;
+    uint8_t count;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        count = TCNT2;
+        t = sched_ticks;
+        // compare match not served yet: the counter has already restarted
+        if ((TIFR2 & (1 << OCF2A)) && count < SCHED_TOP) {
+            t++;
+        }
+    }
+    return t * 1000 + (uint16_t)count * SCHED_US_PER_COUNT;
+}
+
+int8_t sched_add(PGM_P name, sched_fn fn, uint16_t period, uint8_t events, uint16_t budget) {
+    sched_task *t;
+
+    if (sched_count >= SCHED_MAX_TASKS) {
+        return -1;
+    }
+    t = &sched_tasks[sched_count];
+    memset(t, 0, sizeof(*t));
+    t->name = name;
+    t->fn = fn;
+    t->period = period;
+    t->events = events;
+    t->budget = budget;
+    t->release = sched_now() + period;
+    return (int8_t)sched_count++;
+}
+
+void sched_post(uint8_t events) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        sched_pending |= events;
+    }
+}
+
+static void sched_exec(sched_task *t) {
+    uint32_t start, spent;
+
+    start = sched_us();
+    t->fn();
+    spent = sched_us() - start;
+    if (spent > 0xFFFF) {
+        spent = 0xFFFF;
+    }
+    t->runs++;
+    t->total_us += spent;
+    if (spent > t->max_us) {
+        t->max_us = (uint16_t)spent;
+    }
+    if (t->budget && spent > t->budget) {
+        t->overruns++;
+    }
+}
+
+void sched_run(void) {
+    sched_task *t;
+    uint32_t now;
+    uint8_t i, ev;
+
+    for (i = 0; i < sched_count; i++) {
+        t = &sched_tasks[i];
+        now = sched_now();
+        if (t->events) {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                ev = sched_pending & t->events;
+                sched_pending &= ~ev;
+            }
+            if (ev) {
+                sched_exec(t);
+                continue;
+            }
+        }
+        if (t->period) {
+            if ((int32_t)(now - t->release) < 0) {
+                continue;
+            }
+            // deadline: the next release; past it the periods missed are dropped
+            if (now - t->release >= t->period) {
+                t->late++;
+                t->release = now;
+            }
+            t->release += t->period;
+            sched_exec(t);
+        } else if (!t->events) {
+            sched_exec(t);
+        }
+    }
+}
+
+uint16_t sched_faults(void) {
+    uint16_t faults = 0;
+    uint8_t i;
+
+    for (i = 0; i < sched_count; i++) {
+        faults += sched_tasks[i].overruns + sched_tasks[i].late;
+    }
+    return faults;
+}
+
+const sched_task* sched_get(uint8_t id) {
+    return (id < sched_count) ? &sched_tasks[id] : NULL;
+}
+
+void sched_print_stats(void) {
+    sched_task *t;
+    uint8_t i;
+
+    printf_P(PSTR("task     runs  overrun  late  max(us)  avg(us)\n"));
+    for (i = 0; i < sched_count; i++) {
+        t = &sched_tasks[i];
+        printf_P(PSTR("%-6S %6u %8u %5u %8u %8lu\n"), t->name, t->runs, t->overruns, t->late,
+                 t->max_us, t->runs ? t->total_us / t->runs : 0UL);
+    }
+}
+
+void sched_clear_stats(void) {
+    uint8_t i;
+
+    for (i = 0; i < sched_count; i++) {
+        sched_tasks[i].runs = 0;
+        sched_tasks[i].overruns = 0;
+        sched_tasks[i].late = 0;
+        sched_tasks[i].max_us = 0;
+        sched_tasks[i].total_us = 0;
+    }
+}
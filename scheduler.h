@@ -0,0 +1,67 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <avr/pgmspace.h>
+#include <stdint.h>
+
+/*
+    Cooperative task scheduler of the main loop.
+
+    Timer2 in CTC mode interrupts every 1ms (16MHz / 128 / 125) and counts the
+    ticks, so no tick is lost while a task runs long. A task is released by
+    its period, by an event posted with sched_post() (from an ISR as well), or
+    on each pass of the loop when it has neither (background work such as
+    polling the sockets). The tasks run to completion in the order they were
+    added.
+
+    Each run is timed to 8us (TCNT2). A run longer than the budget of the task
+    is an overrun; a periodic task released after its deadline (one period
+    after its release time) is late and skips the periods missed.
+ */
+
+#ifndef SCHED_MAX_TASKS
+#define SCHED_MAX_TASKS     8
+#endif
+
+typedef void (*sched_fn)(void);
+
+typedef struct {
+    PGM_P    name;          // name in flash, for sched_print_stats()
+    sched_fn fn;
+    uint16_t period;        // ms, 0 if not periodic
+    uint8_t  events;        // events of sched_post() releasing it
+    uint16_t budget;        // us of run time, 0 for no limit
+    uint32_t release;       // tick of the next periodic release
+    uint16_t runs;
+    uint16_t overruns;      // runs longer than the budget
+    uint16_t late;          // periodic releases past their deadline
+    uint16_t max_us;        // longest run
+    uint32_t total_us;      // run time since sched_clear_stats()
+} sched_task;
+
+/* Start the 1ms tick of Timer2. Enable the interrupts after. */
+void     sched_init(void);
+
+/* Add a task. Returns its id, or -1 if the table is full. */
+int8_t   sched_add(PGM_P name, sched_fn fn, uint16_t period, uint8_t events, uint16_t budget);
+
+/* Release the tasks waiting on events; callable from an ISR. */
+void     sched_post(uint8_t events);
+
+/* Run the tasks released, once each. Called for ever by main(). */
+void     sched_run(void);
+
+/* Milliseconds since sched_init() */
+uint32_t sched_now(void);
+
+/* Microseconds since sched_init(), with a resolution of 8us; wraps after 71 minutes */
+uint32_t sched_us(void);
+
+/* Overruns and late releases of all the tasks since sched_clear_stats() */
+uint16_t sched_faults(void);
+
+const sched_task* sched_get(uint8_t id);
+void     sched_print_stats(void);
+void     sched_clear_stats(void);
+
+#endif
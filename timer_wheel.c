@@ -0,0 +1,133 @@
+#include <stddef.h>
+
+#include "scheduler.h"
+#include "timer_wheel.h"
+
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_RANGE     (1UL << (WHEEL_BITS * WHEEL_LEVELS))
+
+static wheel_timer *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint32_t     wheel_time;     // next ms to expire
+
+uint32_t wheel_now(void) {
+    return sched_now();
+}
+
+void wheel_init(void) {
+    uint16_t l, s;                  // WHEEL_SLOTS is 256 with 8 bits
+
+    for (l = 0; l < WHEEL_LEVELS; l++) {
+        for (s = 0; s < WHEEL_SLOTS; s++) {
+            wheel[l][s] = NULL;
+        }
+    }
+    wheel_time = wheel_now();
+}
+
+static void wheel_link(wheel_timer **head, wheel_timer *t) {
+    t->next = *head;
+    if (t->next) {
+        t->next->pprev = &t->next;
+    }
+    t->pprev = head;
+    *head = t;
+}
+
+static void wheel_unlink(wheel_timer *t) {
+    *t->pprev = t->next;
+    if (t->next) {
+        t->next->pprev = t->pprev;
+    }
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+static void wheel_insert(wheel_timer *t) {
+    uint32_t expires = t->expires;
+    uint32_t delta = expires - wheel_time;
+    uint8_t level;
+
+    if ((int32_t)delta < 0) {
+        expires = wheel_time;           // due already: the next slot to expire
+        delta = 0;
+    } else if (delta >= WHEEL_RANGE) {
+        expires = wheel_time + WHEEL_RANGE - 1;     // placed again when it gets there
+        delta = WHEEL_RANGE - 1;
+    }
+    for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+        if (delta < (1UL << (WHEEL_BITS * (level + 1)))) {
+            break;
+        }
+    }
+    wheel_link(&wheel[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK], t);
+}
+
+void wheel_arm(wheel_timer *t, uint32_t ms, wheel_fn fn, void *arg) {
+    if (t->pprev) {
+        wheel_unlink(t);
+    }
+    t->expires = wheel_now() + ms;
+    t->period = 0;
+    t->fn = fn;
+    t->arg = arg;
+    wheel_insert(t);
+}
+
+void wheel_every(wheel_timer *t, uint32_t period, wheel_fn fn, void *arg) {
+    wheel_arm(t, period, fn, arg);
+    t->period = period;
+}
+
+void wheel_cancel(wheel_timer *t) {
+    if (t->pprev) {
+        wheel_unlink(t);
+    }
+}
+
+/* Moves the timers of a slot one level down; returns the slot index. */
+static uint8_t wheel_cascade(uint8_t level) {
+    uint8_t slot = (wheel_time >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    wheel_timer *list = wheel[level][slot];
+    wheel_timer *t;
+
+    wheel[level][slot] = NULL;
+    while ((t = list) != NULL) {
+        list = t->next;
+        t->next = NULL;
+        t->pprev = NULL;
+        wheel_insert(t);
+    }
+    return slot;
+}
+
+void wheel_run(void) {
+    uint32_t now = wheel_now();
+    wheel_timer *pending;
+    wheel_timer *t;
+    uint8_t level;
+
+    while ((int32_t)(now - wheel_time) >= 0) {
+        // level 0 wraps: bring down the next slot of the levels above
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            if ((wheel_time & ((1UL << (WHEEL_BITS * level)) - 1)) != 0 || wheel_cascade(level) != 0) {
+                break;
+            }
+        }
+        // the callbacks may arm and cancel any timer, the expired ones as well;
+        // a timer due at once goes to the next slot
+        pending = wheel[0][wheel_time & WHEEL_MASK];
+        wheel[0][wheel_time & WHEEL_MASK] = NULL;
+        wheel_time++;
+        if (pending) {
+            pending->pprev = &pending;
+        }
+        while ((t = pending) != NULL) {
+            wheel_unlink(t);
+            if (t->period) {
+                t->expires += t->period;
+                wheel_insert(t);
+            }
+            t->fn(t->arg);
+        }
+    }
+}
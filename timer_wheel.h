@@ -0,0 +1,72 @@
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Timeouts of all the protocol modules on one millisecond clock.
+
+    A hierarchical timer wheel: WHEEL_LEVELS levels of WHEEL_SLOTS slots, the
+    slots of level n are WHEEL_SLOTS^n ms wide. Arming links the timer in the
+    slot of its expiry and cancelling unlinks it, both O(1) whatever the count
+    of timers. The timers of a slot of a higher level move down a level each
+    time the level below wraps, and expire from level 0. Expiries past the
+    range of the wheel wait in its last level and are placed again.
+
+    The clock is sched_now(), counted by the Timer2 ISR. wheel_run() runs the
+    callbacks in the main loop, so they may call any API; arm and cancel from
+    the main loop only, not from an ISR.
+
+    The ioLibrary modules built with _USE_TIMER_WHEEL_ arm a timer for each
+    wait of a transaction (the retries of DHCP, DNS and TFTP, the lease of
+    DHCP, the idle connections of the HTTP server) and cancel it when the
+    answer comes; SNMP and MQTT read the clock directly. Their tick handlers
+    are then left unused.
+ */
+
+#ifndef WHEEL_BITS
+#define WHEEL_BITS      5           // 32 slots per level
+#endif
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#ifndef WHEEL_LEVELS
+#define WHEEL_LEVELS    4           // 2^20 ms, 17 minutes with 5 bits
+#endif
+
+#if WHEEL_BITS > 8 || WHEEL_BITS * WHEEL_LEVELS > 31
+#error "WHEEL_BITS must be 8 at most, and WHEEL_BITS * WHEEL_LEVELS 31 at most"
+#endif
+
+typedef void (*wheel_fn)(void *arg);
+
+typedef struct wheel_timer {
+    struct wheel_timer  *next;
+    struct wheel_timer **pprev;     // link pointing to it, NULL if not armed
+    uint32_t            expires;    // ms of the clock
+    uint32_t            period;     // ms, 0 for a one-shot timer
+    wheel_fn            fn;
+    void                *arg;
+} wheel_timer;
+
+/* Start the wheel at the current time of the clock. */
+void     wheel_init(void);
+
+/* Milliseconds of the clock */
+uint32_t wheel_now(void);
+
+/* Call fn(arg) once in ms milliseconds. Arming an armed timer moves it. */
+void     wheel_arm(wheel_timer *t, uint32_t ms, wheel_fn fn, void *arg);
+
+/* Call fn(arg) every period milliseconds, without drift. */
+void     wheel_every(wheel_timer *t, uint32_t period, wheel_fn fn, void *arg);
+
+void     wheel_cancel(wheel_timer *t);
+
+static inline uint8_t wheel_armed(const wheel_timer *t) {
+    return t->pprev != 0;
+}
+
+/* Expire the timers due, up to the current time. Called by the main loop. */
+void     wheel_run(void);
+
+#endif
@@ -0,0 +1,112 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "uart.h"
+
+#define UART_TX_MASK    (UART_TX_SIZE - 1)
+
+#if (UART_TX_SIZE & UART_TX_MASK) || UART_TX_SIZE > 256
+#error "UART_TX_SIZE must be a power of 2, 256 at most"
+#endif
+
+// TXC0 is cleared by writing it 1; FE0, DOR0 and UPE0 must be written 0, U2X0 and MPCM0 kept
+#define UART_CLEAR_TXC()    (UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0))
+
+static int uart_putchar(char c, FILE *stream);
+
+FILE uart_stdout = FDEV_SETUP_STREAM(uart_putchar, NULL, _FDEV_SETUP_WRITE);
+
+static uint8_t          tx_buf[UART_TX_SIZE];
+static volatile uint8_t tx_head;    // written by the main loop
+static volatile uint8_t tx_tail;    // written by the ISR
+static uint8_t          tx_policy = UART_TX_POLICY;
+static uint16_t         tx_dropped; // written by the main loop
+static uint8_t          tx_used;    // a byte was queued, so TXC0 tells when the line is idle
+
+ISR(USART0_UDRE_vect) {
+    uint8_t tail = tx_tail;
+
+    if (tail == tx_head) {
+        UCSR0B &= ~(1 << UDRIE0);       // empty: wait for uart_put()
+        return;
+    }
+    UDR0 = tx_buf[tail];
+    UART_CLEAR_TXC();                   // cleared after the write: set again once this byte is out
+    tx_tail = (tail + 1) & UART_TX_MASK;
+}
+
+void uart_init(uint32_t baud) {
+    UCSR0A = (1 << U2X0);
+    UBRR0 = (uint16_t)((F_CPU + 4 * baud) / (8 * baud) - 1);
+    UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+    UCSR0B = (1 << RXEN0) | (1 << TXEN0);
+    tx_head = 0;
+    tx_tail = 0;
+}
+
+uint8_t uart_set_policy(uint8_t policy) {
+    uint8_t previous = tx_policy;
+
+    tx_policy = policy;
+    return previous;
+}
+
+// Sends the oldest byte of the ring by polling, with the interrupts disabled.
+static void uart_drain_one(void) {
+    loop_until_bit_is_set(UCSR0A, UDRE0);
+    UDR0 = tx_buf[tx_tail];
+    UART_CLEAR_TXC();
+    tx_tail = (tx_tail + 1) & UART_TX_MASK;
+}
+
+// Returns 0 if the ring is full and the byte not queued.
+static uint8_t uart_put(uint8_t c, uint8_t block) {
+    uint8_t next = (tx_head + 1) & UART_TX_MASK;
+
+    while (next == tx_tail) {
+        if (!block) {
+            return 0;
+        }
+        if (!(SREG & (1 << SREG_I))) {
+            uart_drain_one();
+        }
+    }
+    tx_buf[tx_head] = c;
+    tx_head = next;
+    tx_used = 1;
+    UCSR0B |= (1 << UDRIE0);
+    return 1;
+}
+
+static int uart_putchar(char c, FILE *stream) {
+    uint8_t block = tx_policy == UART_TX_BLOCK;
+
+    if (c == '\n' && !uart_put('\r', block)) {
+        tx_dropped += 2;
+        return 0;
+    }
+    if (!uart_put(c, block)) {
+        tx_dropped++;
+    }
+    return 0;
+}
+
+void uart_write(uint8_t c) {
+    uart_put(c, 1);
+}
+
+void uart_flush(void) {
+    while (tx_tail != tx_head) {
+        if (!(SREG & (1 << SREG_I))) {
+            uart_drain_one();
+        }
+    }
+    // UDRE0 is set as soon as the last byte moves to the shift register; TXC0 once it has left it
+    if (tx_used) {
+        loop_until_bit_is_set(UCSR0A, TXC0);
+    }
+}
+
+uint16_t uart_dropped(void) {
+    return tx_dropped;
+}
@@ -0,0 +1,54 @@
+#ifndef _UART_H_
+#define _UART_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+    Buffered output of USART0.
+
+    The characters written to uart_stdout and by uart_write() go to a ring
+    emptied by the UDRE interrupt, so printf() costs the formatting only and
+    the main loop does not wait on the line. U2X is always on: 16MHz gives
+    115200 (2.1%), 250000, 500000 and 1M baud exactly.
+
+    When the ring is full, the stdio output follows the policy: UART_TX_DROP
+    counts the characters lost in uart_dropped() and returns at once,
+    UART_TX_BLOCK waits for room. uart_write() always waits, for the bytes of
+    a protocol. With the interrupts disabled (before sei(), in an ISR) the
+    output waits on the data register and empties the ring itself.
+ */
+
+#ifndef UART_BAUD
+#define UART_BAUD       115200UL
+#endif
+
+#ifndef UART_TX_SIZE
+#define UART_TX_SIZE    256         // power of 2, 256 at most
+#endif
+
+#define UART_TX_DROP    0
+#define UART_TX_BLOCK   1
+
+#ifndef UART_TX_POLICY
+#define UART_TX_POLICY  UART_TX_DROP
+#endif
+
+extern FILE uart_stdout;
+
+/* 8 data bits, no parity, 1 stop bit; receiver and transmitter enabled */
+void     uart_init(uint32_t baud);
+
+/* Sets the policy of the stdio output; returns the one it replaces. */
+uint8_t  uart_set_policy(uint8_t policy);
+
+/* Queues a byte, waiting for room if needed. */
+void     uart_write(uint8_t c);
+
+/* Waits until the ring and the shift register are empty. */
+void     uart_flush(void);
+
+/* Characters of the stdio output dropped on a full ring */
+uint16_t uart_dropped(void);
+
+#endif
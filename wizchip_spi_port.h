@@ -0,0 +1,81 @@
+#ifndef _WIZCHIP_SPI_PORT_H_
+#define _WIZCHIP_SPI_PORT_H_
+
+#include <avr/io.h>
+#include <stdint.h>
+
+/*
+    W5500 SPI transport of the ATmega2560, bound at compile time.
+
+    Included by w5500.c when _WIZCHIP_SPI_STATIC_ is set so the register
+    access functions compile to inline loops, and by main.c for the
+    callbacks registered with reg_wizchip_xxx_cbfunc().
+
+    SCN(ss) ------- D53 --> [PB0]
+ */
+
+#define WIZCHIP_SS  PB0
+
+/*
+    SPI clock of the W5500 (up to 80MHz).
+    1 : 16Mhz / 2 with SPI2X, a byte shifts in 16 CPU cycles
+    0 : 16Mhz / 16
+ */
+#ifndef WIZCHIP_SPI_FAST
+#define WIZCHIP_SPI_FAST  1
+#endif
+
+static inline void wizchip_port_select(void) {
+    PORTB &= ~(1 << WIZCHIP_SS);
+}
+
+static inline void wizchip_port_deselect(void) {
+    PORTB |= (1 << WIZCHIP_SS);
+}
+
+static inline void wizchip_port_write(uint8_t data) {
+    SPDR = data;
+    while (!(SPSR & (1 << SPIF)));  // Wait for transmission complete
+}
+
+static inline uint8_t wizchip_port_read(void) {
+    SPDR = 0x00;
+    while (!(SPSR & (1 << SPIF)));  // Wait for transmission complete
+    return SPDR;
+}
+
+/*
+    The burst loops are pipelined: the next byte is loaded into SPDR right
+    after SPIF, and the loop bookkeeping runs while it shifts. The SPI is
+    single buffered for transmit but double buffered for receive, so the
+    byte just received is still in SPDR after the next transfer is started.
+
+    Per byte: out SPDR (1) + ld/st X+ (2) + sbiw/brne (4) + SPIF poll
+    (sbis/rjmp, 3) = 10 cycles, inside the 16 cycles a byte takes at
+    fosc/2, so back-to-back bytes leave at most one poll step on the bus.
+ */
+static inline void wizchip_port_write_burst(uint8_t *buffer, uint16_t length) {
+    uint8_t data;
+    if (!length) return;
+    SPDR = *buffer++;
+    while (--length) {
+        data = *buffer++;               // fetch while the current byte shifts
+        while (!(SPSR & (1 << SPIF)));
+        SPDR = data;
+    }
+    while (!(SPSR & (1 << SPIF)));
+}
+
+static inline void wizchip_port_read_burst(uint8_t *buffer, uint16_t length) {
+    if (!length) return;
+    SPDR = 0x00;
+    while (--length) {
+        while (!(SPSR & (1 << SPIF)));
+        SPDR = 0x00;                    // start the next byte first
+        *buffer++ = SPDR;               // then store the one just received
+    }
+    while (!(SPSR & (1 << SPIF)));
+    *buffer = SPDR;
+}
+
+#endif